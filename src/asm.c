@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "optimize.h"
+#include "memory.h"
+
+/*
+ * This file contains the native code generator that translates
+ * MiniPL programs to x86-64 assembly for the GNU assembler. The
+ * generated code is linked with the freestanding runtime object
+ * built from runtime.c, so only as and ld are needed to build the
+ * executable. The executable prints the same output and error
+ * messages and returns the same exit code as the interpreter.
+ *
+ * Registers are allocated statically. The counters of the three
+ * outermost for loops are kept in %ebx, %r12d and %r13d, and the
+ * control variable is read from the counter inside the loop. The
+ * temporaries of expressions are kept in a stack of registers
+ * that spills to the stack frame.
+ */
+
+#define COUNTER_REGISTERS 3
+#define TEMP_REGISTERS    6
+
+/* The first four temporary registers are not preserved by calls. */
+#define CALLER_SAVED      4
+
+static const char *counter_registers[] = {"%ebx", "%r12d", "%r13d"};
+static const char *temp_registers[][2] = {
+    {"%r8d",  "%r8" }, {"%r9d",  "%r9" }, {"%r10d", "%r10"},
+    {"%r11d", "%r11"}, {"%r14d", "%r14"}, {"%r15d", "%r15"}
+};
+
+/*
+ * The stack frame. The callee saved registers are pushed below
+ * the frame pointer, then come the end values of the for loops
+ * and the temporaries that did not fit in registers.
+ */
+#define SAVED_SIZE 40
+
+/* Helper functions used only in this translation unit. */
+static void  stmts       (ir_stmt *stmt                             );
+static void  statement   (ir_stmt *stmt                             );
+static void  for_        (ir_stmt *stmt                             );
+static void  check       (ir_stmt *stmt, char *message, int type    );
+static int   expression  (ir_expr *expn                             );
+static void  range       (int op, char *end                         );
+static void  call        (char *function, int live                  );
+static void  move        (char *dst, char *src, int wide            );
+static char *temp        (int t, int wide                           );
+static char *variable    (int slot, int wide                        );
+static int   literal     (char *s                                   );
+static int   loopDepth   (ir_stmt *stmt                             );
+static void  string      (FILE *f, char *s                          );
+
+enum error_type {SEMANTIC_ERROR, RUNTIME_ERROR};
+
+/*
+ * State of the code generation. The function body is written to
+ * a memory stream first, because the size of the stack frame is
+ * known only after it. String literals are collected to data.
+ */
+static FILE  *output;
+static FILE  *data;
+static int    labels;
+static int    literals;
+static int    top;          // Number of live temporaries.
+static int    max_temps;
+static int    depth;        // Nesting depth of for loops.
+static int    max_depth;
+static int   *counter;      // Counter register of each slot, or -1.
+
+/*
+ * Main function of the assembly code generation.
+ *
+ * Writes the assembly of the program *pn to the standard output
+ * and frees the syntax tree. Returns 1 if the program was
+ * translated, 0 if it can not be lowered to the IR.
+ */
+int emitAsm(program_node *pn){
+    ir_program *ir = lower(pn);
+    char       *body, *strings;
+    size_t      body_size, strings_size;
+    int         frame, i;
+
+    freeSyntaxTree(pn, NULL);
+
+    if(ir == NULL){
+	fprintf(stderr, "The program can not be compiled to assembly.\n");
+	return 0;
+    }
+
+    optimize(ir);
+
+    labels    = 0;
+    literals  = 0;
+    top       = 0;
+    max_temps = 0;
+    depth     = 0;
+    max_depth = loopDepth(ir->stmts);
+    counter   = (int*)malloc(sizeof(int) * (ir->nslots +1));
+    for(i = 0; i < ir->nslots; i++)
+	counter[i] = -1;
+
+    output = open_memstream(&body, &body_size);
+    data   = open_memstream(&strings, &strings_size);
+    stmts(ir->stmts);
+    fclose(output);
+    fclose(data);
+
+    /* The frame keeps the stack aligned to 16 bytes at calls. */
+    frame = 8 * (max_depth + (max_temps > TEMP_REGISTERS ? max_temps - TEMP_REGISTERS : 0));
+    if(frame % 16 == 0)
+	frame += 8;
+
+    printf("# Generated by minipl --emit-asm.\n\n");
+    printf("\t.section .rodata\n");
+    printf(".Lempty:\n\t.string \"\"\n");
+    fputs(strings, stdout);
+
+    printf("\n\t.data\n\t.align 8\n");
+    for(i = 0; i < ir->nslots; i++)
+	printf("v%d:\t.quad %s\t# %s\n", i, ir->types[i] == STRING ? ".Lempty" : "0", ir->names[i]);
+
+    printf("\n\t.bss\n\t.align 4\nfault:\t.zero 4\n");
+
+    printf("\n\t.text\n\t.globl mpl_main\nmpl_main:\n");
+    printf("\tpushq %%rbp\n\tmovq %%rsp, %%rbp\n");
+    printf("\tpushq %%rbx\n\tpushq %%r12\n\tpushq %%r13\n\tpushq %%r14\n\tpushq %%r15\n");
+    printf("\tsubq $%d, %%rsp\n", frame);
+    fputs(body, stdout);
+    printf("\tmovl $1, %%eax\n\tjmp .Lleave\n");
+    printf(".Lfail:\n\txorl %%eax, %%eax\n");
+    printf(".Lleave:\n\taddq $%d, %%rsp\n", frame);
+    printf("\tpopq %%r15\n\tpopq %%r14\n\tpopq %%r13\n\tpopq %%r12\n\tpopq %%rbx\n");
+    printf("\tpopq %%rbp\n\tret\n");
+    printf("\t.section .note.GNU-stack,\"\",@progbits\n");
+
+    free(body);
+    free(strings);
+    free(counter);
+    freeIr(ir);
+
+    return 1;
+}
+
+/*
+ * STATEMENTS ----------------------------------------------------------
+ *
+ * The temporaries of a statement are free after it. A failing
+ * statement jumps to .Lfail, which returns 0 from mpl_main.
+ */
+
+static void stmts(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	statement(stmt);
+}
+
+static void statement(ir_stmt *stmt){
+    int v, l;
+
+    fprintf(output, "# line %d\n", stmt->line);
+    top = 0;
+
+    switch(stmt->kind){
+    case IR_DECLARE:
+    case IR_ASSIGN:
+	if(stmt->expn->fault)
+	    fprintf(output, "\tmovl $0, fault(%%rip)\n");
+	v = expression(stmt->expn);
+	if(stmt->expn->fault)
+	    check(stmt, stmt->kind == IR_DECLARE ? "Incompatible types in declaration"
+		  : "Incompatible types in assignment", SEMANTIC_ERROR);
+	move(variable(stmt->slot, stmt->lt == STRING), temp(v, stmt->lt == STRING), stmt->lt == STRING);
+	break;
+    case IR_FOR:
+	for_(stmt);
+	break;
+    case IR_READ:
+	fprintf(output, "\tleaq v%d(%%rip), %%rdi\n", stmt->slot);
+	fprintf(output, "\tmovl $%d, %%esi\n", stmt->line);
+	call(stmt->lt == STRING ? "mpl_read_string" : "mpl_read_int", 0);
+	fprintf(output, "\ttestl %%eax, %%eax\n\tje .Lfail\n");
+	break;
+    case IR_PRINT:
+	if(stmt->expn->fault)
+	    fprintf(output, "\tmovl $0, fault(%%rip)\n");
+	v = expression(stmt->expn);
+	if(stmt->expn->fault)
+	    check(stmt, "Invalid value in printable expression", RUNTIME_ERROR);
+	if(stmt->lt == STRING){
+	    fprintf(output, "\tmovq %s, %%rdi\n", temp(v, 1));
+	    call("mpl_print_string", 0);
+	} else{
+	    fprintf(output, "\tmovl %s, %%edi\n", temp(v, 0));
+	    call("mpl_print_int", 0);
+	}
+	break;
+    case IR_ASSERT:
+	l = labels++;
+	fprintf(output, "\tmovl $0, fault(%%rip)\n");
+	v = expression(stmt->expn);
+	fprintf(output, "\tcmpl $0, fault(%%rip)\n\tjne .L%d_failed\n", l);
+	fprintf(output, "\tcmpl $1, %s\n\tje .L%d\n", temp(v, 0), l);
+	fprintf(output, ".L%d_failed:\n", l);
+	fprintf(output, "\tmovl $%d, %%edi\n", stmt->line);
+	fprintf(output, "\tleaq .Lstr%d(%%rip), %%rsi\n", literal("Assertion failed"));
+	fprintf(output, "\tmovl $%d, %%edx\n", SEMANTIC_ERROR);
+	call("mpl_error", 0);
+	fprintf(output, "\tjmp .Lfail\n.L%d:\n", l);
+	break;
+    case IR_TRAP:
+	fprintf(output, "\tleaq .Lstr%d(%%rip), %%rdi\n", literal(stmt->msg));
+	call("mpl_write_error", 0);
+	fprintf(output, "\tjmp .Lfail\n");
+	break;
+    }
+}
+
+/*
+ * The control variable keeps the value of the counter after
+ * the loop, as in the interpreter. The end of the range is
+ * kept in the stack frame.
+ */
+static void for_(ir_stmt *stmt){
+    int  fault = stmt->expn->fault || stmt->expn2->fault;
+    int  start, end, l = labels++;
+    int  reg = depth < COUNTER_REGISTERS ? depth : -1;
+    char count[16], limit[16];
+
+    if(fault)
+	fprintf(output, "\tmovl $0, fault(%%rip)\n");
+    start = expression(stmt->expn);
+    end   = expression(stmt->expn2);
+    if(fault)
+	check(stmt, "For range should be integer", SEMANTIC_ERROR);
+
+    sprintf(limit, "%d(%%rbp)", -SAVED_SIZE - 8 * (depth +1));
+    strcpy(count, reg >= 0 ? counter_registers[reg] : variable(stmt->slot, 0));
+
+    move(limit, temp(end, 0), 0);
+    move(count, temp(start, 0), 0);
+
+    fprintf(output, ".L%d_test:\n", l);
+    fprintf(output, "\tmovl %s, %%eax\n", count);
+    fprintf(output, "\tcmpl %s, %%eax\n", limit);
+    fprintf(output, "\tjg .L%d_done\n", l);
+
+    depth++;
+    counter[stmt->slot] = reg;
+    stmts(stmt->body);
+    counter[stmt->slot] = -1;
+    depth--;
+
+    fprintf(output, "\taddl $1, %s\n", count);
+    fprintf(output, "\tjmp .L%d_test\n", l);
+    fprintf(output, ".L%d_done:\n", l);
+    if(reg >= 0)
+	move(variable(stmt->slot, 0), count, 0);
+}
+
+/* Reports the follow up error of a failed expression. */
+static void check(ir_stmt *stmt, char *message, int type){
+    int l = labels++;
+
+    fprintf(output, "\tcmpl $0, fault(%%rip)\n\tje .L%d\n", l);
+    fprintf(output, "\tmovl $%d, %%edi\n", stmt->line);
+    fprintf(output, "\tleaq .Lstr%d(%%rip), %%rsi\n", literal(message));
+    fprintf(output, "\tmovl $%d, %%edx\n", type);
+    call("mpl_error", 0);
+    fprintf(output, "\tjmp .Lfail\n.L%d:\n", l);
+}
+
+/*
+ * EXPRESSIONS ---------------------------------------------------------
+ *
+ * The value of each expression is left in a new temporary whose
+ * number is returned. The right operand of a binary operator is
+ * evaluated before the left one, as in the interpreter.
+ */
+
+static int newTemp(void){
+    if(++top > max_temps)
+	max_temps = top;
+
+    return top -1;
+}
+
+static int expression(ir_expr *expn){
+    int   wide = expn->lt == STRING;
+    int   v, l, r, lbl;
+    char  dst[32];
+
+    switch(expn->op){
+    case IR_CONST:
+	v = newTemp();
+	if(wide){
+	    fprintf(output, "\tleaq .Lstr%d(%%rip), %%rax\n", literal(expn->s));
+	    move(temp(v, 1), "%rax", 1);
+	} else
+	    fprintf(output, "\tmovl $%d, %s\n", expn->i, temp(v, 0));
+	return v;
+    case IR_VAR:
+	v = newTemp();
+	if(!wide && counter[expn->slot] >= 0)
+	    move(temp(v, 0), (char*)counter_registers[counter[expn->slot]], 0);
+	else
+	    move(temp(v, wide), variable(expn->slot, wide), wide);
+	return v;
+    case IR_NOT:
+	if(!expn->fault){
+	    v = expression(expn->l);
+	    fprintf(output, "\txorl $1, %s\n", temp(v, 0));
+	    return v;
+	}
+
+	/* The interpreter reports every unary operator whose operand failed. */
+	lbl = labels++;
+	v   = newTemp();
+	move(temp(v, 0), "fault(%rip)", 0);
+	fprintf(output, "\tmovl $0, fault(%%rip)\n");
+	l = expression(expn->l);
+	fprintf(output, "\tcmpl $0, fault(%%rip)\n\tje .L%d_ok\n", lbl);
+	fprintf(output, "\tmovl $%d, %%edi\n", expn->line);
+	fprintf(output, "\tleaq .Lstr%d(%%rip), %%rsi\n",
+		literal("The argument type of unary expression must be bool"));
+	fprintf(output, "\tmovl $%d, %%edx\n", SEMANTIC_ERROR);
+	call("mpl_error", v);
+	fprintf(output, "\tmovl $0, %s\n\tjmp .L%d\n", temp(v, 0), lbl);
+	fprintf(output, ".L%d_ok:\n", lbl);
+	move("fault(%rip)", temp(v, 0), 0);
+	fprintf(output, "\tmovl %s, %%eax\n\txorl $1, %%eax\n", temp(l, 0));
+	fprintf(output, "\tmovl %%eax, %s\n.L%d:\n", temp(v, 0), lbl);
+	top = v +1;
+	return v;
+    }
+
+    /*
+     * Division by zero is reported only if neither of the operands
+     * failed. The fault indicator is cleared for the evaluation of
+     * the operands to find that out.
+     */
+    if(expn->op == IR_DIV && expn->fault && !expn->nonzero){
+	lbl = labels++;
+	v   = newTemp();
+	move(temp(v, 0), "fault(%rip)", 0);
+	fprintf(output, "\tmovl $0, fault(%%rip)\n");
+	r = expression(expn->r);
+	l = expression(expn->l);
+	fprintf(output, "\tcmpl $0, fault(%%rip)\n\tjne .L%d_zero\n", lbl);
+	fprintf(output, "\tcmpl $0, %s\n\tjne .L%d_divide\n", temp(r, 0), lbl);
+	fprintf(output, "\tmovl $%d, %%edi\n", expn->line);
+	fprintf(output, "\tleaq .Lstr%d(%%rip), %%rsi\n", literal("Division by zero"));
+	fprintf(output, "\tmovl $%d, %%edx\n", RUNTIME_ERROR);
+	call("mpl_error", v);
+	fprintf(output, "\tmovl $1, fault(%%rip)\n\tjmp .L%d_zero\n", lbl);
+	fprintf(output, ".L%d_divide:\n", lbl);
+	move("fault(%rip)", temp(v, 0), 0);
+	fprintf(output, "\tmovl %s, %%eax\n\tcltd\n\tidivl %s\n", temp(l, 0), temp(r, 0));
+	fprintf(output, "\tmovl %%eax, %s\n\tjmp .L%d\n", temp(v, 0), lbl);
+	fprintf(output, ".L%d_zero:\n\tmovl $0, %s\n.L%d:\n", lbl, temp(v, 0), lbl);
+	top = v +1;
+	return v;
+    }
+
+    r = expression(expn->r);
+    l = expression(expn->l);
+    strcpy(dst, temp(r, 0));
+
+    if(expn->l->lt == STRING){
+	fprintf(output, "\tmovq %s, %%rdi\n", temp(l, 1));
+	fprintf(output, "\tmovq %s, %%rsi\n", temp(r, 1));
+	switch(expn->op){
+	case IR_ADD:  call("mpl_concat", r); break;
+	case IR_LESS: call("mpl_less",   r); break;
+	case IR_EQ:   call("mpl_equal",  r); break;
+	}
+	move(temp(r, wide), wide ? "%rax" : "%eax", wide);
+	top = r +1;
+	return r;
+    }
+
+    fprintf(output, "\tmovl %s, %%eax\n", temp(l, 0));
+    switch(expn->op){
+    case IR_ADD:  fprintf(output, "\taddl %s, %%eax\n",  temp(r, 0)); break;
+    case IR_SUB:  fprintf(output, "\tsubl %s, %%eax\n",  temp(r, 0)); break;
+    case IR_MUL:  fprintf(output, "\timull %s, %%eax\n", temp(r, 0)); break;
+    case IR_AND:  fprintf(output, "\tandl %s, %%eax\n",  temp(r, 0)); break;
+    case IR_DIV:  fprintf(output, "\tcltd\n\tidivl %s\n", temp(r, 0)); break;
+    case IR_LESS:
+    case IR_EQ:
+	fprintf(output, "\tcmpl %s, %%eax\n", temp(r, 0));
+	fprintf(output, "\t%s %%al\n\tmovzbl %%al, %%eax\n", expn->op == IR_LESS ? "setl" : "sete");
+	break;
+    case IR_MAX:
+	fprintf(output, "\tcmpl %s, %%eax\n\tcmovll %s, %%eax\n", temp(r, 0), temp(r, 0));
+	break;
+    case IR_TRIPS:
+    case IR_SUM:
+	range(expn->op, temp(r, 0));
+	break;
+    }
+    fprintf(output, "\tmovl %%eax, %s\n", dst);
+
+    top = r +1;
+    return r;
+}
+
+/*
+ * The trip count or the sum of the range %eax..end, computed
+ * as in rangeSum() with 64 bit arithmetic.
+ */
+static void range(int op, char *end){
+    int l = labels++;
+
+    fprintf(output, "\tmovl %s, %%ecx\n\tcmpl %%ecx, %%eax\n\tjg .L%d_empty\n", end, l);
+    if(op == IR_TRIPS)
+	fprintf(output, "\tsubl %%eax, %%ecx\n\tleal 1(%%rcx), %%eax\n");
+    else{
+	fprintf(output, "\tmovslq %%eax, %%rdx\n\tmovslq %%ecx, %%rcx\n\tsubq %%rdx, %%rcx\n");
+	fprintf(output, "\tleaq 1(%%rcx), %%rax\n\timulq %%rcx, %%rax\n\tshrq $1, %%rax\n");
+	fprintf(output, "\taddq $1, %%rcx\n\timulq %%rdx, %%rcx\n\taddq %%rcx, %%rax\n");
+    }
+    fprintf(output, "\tjmp .L%d\n.L%d_empty:\n\txorl %%eax, %%eax\n.L%d:\n", l, l, l);
+}
+
+/*
+ * HELPERS -------------------------------------------------------------
+ */
+
+/*
+ * Calls a runtime function. The live temporaries below live that
+ * are in caller saved registers are pushed around the call.
+ */
+static void call(char *function, int live){
+    int saved = live < CALLER_SAVED ? live : CALLER_SAVED;
+    int i;
+
+    if(saved % 2)
+	fprintf(output, "\tsubq $8, %%rsp\n");
+    for(i = 0; i < saved; i++)
+	fprintf(output, "\tpushq %s\n", temp_registers[i][1]);
+
+    fprintf(output, "\tcall %s\n", function);
+
+    for(i = saved -1; i >= 0; i--)
+	fprintf(output, "\tpopq %s\n", temp_registers[i][1]);
+    if(saved % 2)
+	fprintf(output, "\taddq $8, %%rsp\n");
+}
+
+/* Moves between two operands, through %rax if both are in memory. */
+static void move(char *dst, char *src, int wide){
+    char *mov = wide ? "movq" : "movl";
+
+    if(strcmp(dst, src) == 0)
+	return;
+
+    if(strchr(dst, '(') && strchr(src, '(')){
+	fprintf(output, "\t%s %s, %s\n", mov, src, wide ? "%rax" : "%eax");
+	fprintf(output, "\t%s %s, %s\n", mov, wide ? "%rax" : "%eax", dst);
+    } else
+	fprintf(output, "\t%s %s, %s\n", mov, src, dst);
+}
+
+/* The operand of temporary t. The returned string is reused. */
+static char *temp(int t, int wide){
+    static char buffer[4][32];
+    static int  next;
+    char       *r = buffer[next++ % 4];
+
+    if(t < TEMP_REGISTERS)
+	strcpy(r, temp_registers[t][wide]);
+    else
+	sprintf(r, "%d(%%rbp)", -SAVED_SIZE - 8 * (max_depth + t - TEMP_REGISTERS +1));
+
+    return r;
+}
+
+static char *variable(int slot, int wide){
+    static char buffer[2][32];
+    static int  next;
+    char       *r = buffer[next++ % 2];
+
+    sprintf(r, "v%d(%%rip)", slot);
+    return r;
+}
+
+/* Adds a string literal to the data and returns its number. */
+static int literal(char *s){
+    fprintf(data, ".Lstr%d:\n\t.string ", literals);
+    string(data, s);
+    fprintf(data, "\n");
+
+    return literals++;
+}
+
+static int loopDepth(ir_stmt *stmt){
+    int max = 0, d;
+
+    for(; stmt != NULL; stmt = stmt->next)
+	if(stmt->kind == IR_FOR && (d = 1 + loopDepth(stmt->body)) > max)
+	    max = d;
+
+    return max;
+}
+
+/* Writes s as a string of the assembler. */
+static void string(FILE *f, char *s){
+    fputc('"', f);
+
+    for(; *s != '\0'; s++){
+	if(*s == '"' || *s == '\\')
+	    fprintf(f, "\\%c", *s);
+	else if((unsigned char)*s < ' ' || (unsigned char)*s >= 127)
+	    fprintf(f, "\\%03o", (unsigned char)*s);
+	else
+	    fputc(*s, f);
+    }
+
+    fputc('"', f);
+}
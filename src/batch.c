@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "optimize.h"
+#include "closure.h"
+#include "batch.h"
+#include "memory.h"
+#include "output.h"
+#include "input.h"
+
+/*
+ * The tree walking interpreter, which runs the programs that can
+ * not be lowered. Defined in semantics.c.
+ */
+extern int  interpret          (program_node *pn);
+extern void releaseInterpreter (void);
+
+/*
+ * One record of the input and its state in the group being run
+ * in lockstep. The output of a record is kept in out until the
+ * records before it have been written.
+ */
+typedef struct RECORD{
+    char    *line     ;   // The line without the newline.
+    size_t   size     ;   // Size of the buffer of line.
+    char    *cursor   ;   // The next value to read in lockstep.
+    char    *out      ;
+    size_t   length   ;
+    size_t   capacity ;
+    int      diverged ;
+} record;
+
+/* Helper functions used only in this translation unit. */
+static int  readRecords  (void                                         );
+static void freeRecords  (void                                         );
+static int  interpretAll (program_node *pn                             );
+static int  runRecord    (stmt_closure *c, int nslots, record *r       );
+static void runGroup     (ir_stmt *stmts                               );
+static void exec         (ir_stmt *stmt, int level                     );
+static void loop         (ir_stmt *stmt, int level                     );
+static void evaluate     (ir_expr *expn, char *mask, int *v, int t     );
+static void store        (int slot, int *v, char *mask                 );
+static void diverge      (int k                                        );
+static void append       (record *r, char *s, size_t n                 );
+static int  eligible     (ir_stmt *stmt, int level                     );
+static int  eligibleExpr (ir_expr *expn, int d                         );
+
+static int     width = BATCH_WIDTH;
+static record *records;
+static int     lanes;          // Number of records in the group.
+
+/*
+ * The columns of the lockstep execution. The value of slot s of
+ * record k is columns[s * width + k]. The masks tell the records
+ * that run the statements of every nesting level of the loops,
+ * and the counters and the ends are the ranges of the loops being
+ * run. The temporaries hold the operands of the expressions.
+ */
+static int    *columns;
+static char   *masks;
+static int    *counters;
+static int    *ends;
+static int    *temps;
+static int     depth;          // Deepest expression.
+static int     loops;          // Deepest nesting of loops.
+
+void batchOptions(int w){
+    width = w < 1 ? 1 : w > BATCH_MAX_WIDTH ? BATCH_MAX_WIDTH : w;
+}
+
+/*
+ * The program is compiled as the closure engine compiles it.
+ * The closures run the records that can not be run in lockstep.
+ * A program that can not be lowered is interpreted record by
+ * record, as the closure engine would fall back to the interpreter.
+ */
+int runBatch(program_node *pn){
+    ir_program   *ir = lower(pn);
+    stmt_closure *c;
+    int           n, k, lockstep, tmp = 1;
+
+    if(ir == NULL)
+	return interpretAll(pn);
+
+    optimize(ir);
+    c = compileClosures(ir->stmts);
+
+    depth    = loops = 0;
+    lockstep = width > 1 && eligible(ir->stmts, 1);
+    records  = (record*)calloc(width, sizeof(record));
+
+    if(lockstep){
+	columns  = (int*)calloc((size_t)(ir->nslots +1) * width, sizeof(int));
+	masks    = (char*)calloc((size_t)(loops +1) * width, 1);
+	counters = (int*)malloc(sizeof(int) * (loops +1) * width);
+	ends     = (int*)malloc(sizeof(int) * (loops +1) * width);
+	temps    = (int*)malloc(sizeof(int) * (depth +2) * width);
+    }
+
+    while((n = readRecords()) > 0){
+	lanes = n;
+	if(lockstep)
+	    runGroup(ir->stmts);
+
+	for(k = 0; k < n; k++)
+	    if(lockstep && !records[k].diverged)
+		outputString(records[k].out, records[k].length);
+	    else
+		tmp &= runRecord(c, ir->nslots, &records[k]);
+    }
+
+    freeRecords();
+    free(columns);
+    free(masks);
+    free(counters);
+    free(ends);
+    free(temps);
+    columns = temps = counters = ends = NULL;
+    masks   = NULL;
+
+    freeStmtClosures(c);
+    freeIr(ir);
+    freeSyntaxTree(pn, NULL);
+
+    return tmp;
+}
+
+/*
+ * Reads the next group of records. Returns their number. The
+ * output of the previous group is written first.
+ */
+static int readRecords(void){
+    char   *s;
+    size_t  n;
+    int     k;
+
+    outputFlush();
+
+    for(k = 0; k < width && inputLine(&s, &n); k++){
+	if(n +1 > records[k].size){
+	    records[k].size = n +1;
+	    records[k].line = (char*)realloc(records[k].line, n +1);
+	}
+	memcpy(records[k].line, s, n);
+	records[k].line[n] = '\0';
+    }
+
+    return k;
+}
+
+static void freeRecords(void){
+    for(int k = 0; k < width; k++){
+	free(records[k].line);
+	free(records[k].out);
+    }
+    free(records);
+    records = NULL;
+}
+
+/*
+ * Runs the interpreter once for every record. The syntax tree is
+ * kept between the runs, and freed with the rest at the end.
+ */
+static int interpretAll(program_node *pn){
+    char *cursor;
+    int   n, k, tmp = 1;
+
+    records = (record*)calloc(width, sizeof(record));
+
+    while((n = readRecords()) > 0)
+	for(k = 0; k < n; k++){
+	    cursor = records[k].line;
+	    inputFrom(&cursor);
+	    tmp &= interpret(pn);
+	    inputFrom(NULL);
+	}
+
+    freeRecords();
+    freeSyntaxTree(pn, NULL);
+    releaseInterpreter();
+
+    return tmp;
+}
+
+/* Runs the record *r alone, as the closure engine would run it. */
+static int runRecord(stmt_closure *c, int nslots, record *r){
+    char  *cursor = r->line;
+    frame  f;
+    int    tmp;
+
+    f.env      = (cell*)calloc(nslots +1, sizeof(cell));
+    f.buffers  = (buffer*)calloc(nslots +1, sizeof(buffer));
+    f.fault    = 0;
+    f.parallel = 0;
+
+    inputFrom(&cursor);
+    tmp = execClosures(c, &f);
+    inputFrom(NULL);
+
+    releaseStrings(&f, nslots);
+    free(f.env);
+    free(f.buffers);
+
+    return tmp;
+}
+
+/*
+ * LOCKSTEP EXECUTION --------------------------------------------------
+ *
+ * Every operation is applied to the whole group. A record whose
+ * mask is not set computes values that are never stored, and the
+ * operations that could fail are guarded so that the values of
+ * such records do not matter.
+ */
+
+static void runGroup(ir_stmt *stmts){
+    int k;
+
+    for(k = 0; k < lanes; k++){
+	records[k].cursor   = records[k].line;
+	records[k].length   = 0;
+	records[k].diverged = 0;
+	masks[k]            = 1;
+    }
+
+    exec(stmts, 0);
+}
+
+static void exec(ir_stmt *stmt, int level){
+    char *mask = masks + level * width, text[OUTPUT_INT_SIZE];
+    int  *col, k, n;
+
+    for(; stmt != NULL; stmt = stmt->next)
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	    evaluate(stmt->expn, mask, temps, 1);
+	    store(stmt->slot, temps, mask);
+	    break;
+	case IR_FOR:
+	    loop(stmt, level);
+	    break;
+	case IR_READ:
+	    col = columns + stmt->slot * width;
+	    for(k = 0; k < lanes; k++)
+		if(mask[k]){
+		    if(parseInt(&records[k].cursor, &col[k]) != 1)
+			diverge(k);
+		}
+	    break;
+	case IR_PRINT:
+	    if(stmt->lt == STRING){
+		n = strlen(stmt->expn->s);
+		for(k = 0; k < lanes; k++)
+		    if(mask[k])
+			append(&records[k], stmt->expn->s, n);
+		break;
+	    }
+	    evaluate(stmt->expn, mask, temps, 1);
+	    for(k = 0; k < lanes; k++)
+		if(mask[k])
+		    append(&records[k], text, formatInt(text, temps[k]));
+	    break;
+	case IR_ASSERT:
+	    evaluate(stmt->expn, mask, temps, 1);
+	    for(k = 0; k < lanes; k++)
+		if(mask[k] && temps[k] != 1)
+		    diverge(k);
+	    break;
+	case IR_TRAP:
+	    for(k = 0; k < lanes; k++)
+		if(mask[k])
+		    diverge(k);
+	    break;
+	}
+}
+
+/*
+ * The loop runs until the range of every record of the outer mask
+ * has ended. The control variable keeps the value of the counter
+ * after the loop, as in for_() of the closures.
+ */
+static void loop(ir_stmt *stmt, int level){
+    char *outer = masks + level * width, *inner = outer + width;
+    int  *i     = counters + level * width;
+    int  *end   = ends + level * width;
+    int   k, any;
+
+    evaluate(stmt->expn,  outer, i,   1);
+    evaluate(stmt->expn2, outer, end, 1);
+
+    /* The counter of the interpreter would overflow. */
+    for(k = 0; k < lanes; k++)
+	if(outer[k] && end[k] == INT_MAX)
+	    diverge(k);
+
+    for(;;){
+	for(k = any = 0; k < lanes; k++){
+	    inner[k] = outer[k] && i[k] <= end[k];
+	    any     |= inner[k];
+	}
+	if(!any)
+	    break;
+
+	store(stmt->slot, i, inner);
+	exec(stmt->body, level +1);
+
+	for(k = 0; k < lanes; k++)
+	    i[k] += inner[k];
+    }
+
+    store(stmt->slot, i, outer);
+}
+
+/*
+ * Computes the value of the expression for every record to v.
+ * The operands of the right hand side are computed to the
+ * temporaries of level t and up. A record for which the
+ * expression fails diverges.
+ */
+static void evaluate(ir_expr *expn, char *mask, int *v, int t){
+    int *r = temps + t * width;
+    int  k;
+
+    switch(expn->op){
+    case IR_CONST:
+	for(k = 0; k < lanes; k++)
+	    v[k] = expn->i;
+	return;
+    case IR_VAR:
+	memcpy(v, columns + expn->slot * width, sizeof(int) * lanes);
+	return;
+    case IR_NOT:
+	evaluate(expn->l, mask, v, t);
+	for(k = 0; k < lanes; k++)
+	    v[k] ^= 1;
+	return;
+    }
+
+    evaluate(expn->l, mask, v, t);
+    evaluate(expn->r, mask, r, t +1);
+
+    switch(expn->op){
+    case IR_ADD:
+	for(k = 0; k < lanes; k++)
+	    v[k] = (int)((unsigned)v[k] + (unsigned)r[k]);
+	break;
+    case IR_SUB:
+	for(k = 0; k < lanes; k++)
+	    v[k] = (int)((unsigned)v[k] - (unsigned)r[k]);
+	break;
+    case IR_MUL:
+	for(k = 0; k < lanes; k++)
+	    v[k] = (int)((unsigned)v[k] * (unsigned)r[k]);
+	break;
+    case IR_DIV:
+	for(k = 0; k < lanes; k++)
+	    if(r[k] == 0 || (r[k] == -1 && v[k] == INT_MIN)){
+		if(mask[k])
+		    diverge(k);
+		v[k] = 0;
+	    } else
+		v[k] /= r[k];
+	break;
+    case IR_AND:
+	for(k = 0; k < lanes; k++)
+	    v[k] &= r[k];
+	break;
+    case IR_LESS:
+	for(k = 0; k < lanes; k++)
+	    v[k] = v[k] < r[k];
+	break;
+    case IR_EQ:
+	for(k = 0; k < lanes; k++)
+	    v[k] = v[k] == r[k];
+	break;
+    case IR_MAX:
+	for(k = 0; k < lanes; k++)
+	    v[k] = v[k] > r[k] ? v[k] : r[k];
+	break;
+    case IR_TRIPS:
+	for(k = 0; k < lanes; k++)
+	    v[k] = tripCount(v[k], r[k]);
+	break;
+    case IR_SUM:
+	for(k = 0; k < lanes; k++)
+	    v[k] = rangeSum(v[k], r[k]);
+	break;
+    }
+}
+
+static void store(int slot, int *v, char *mask){
+    int *col = columns + slot * width, k;
+
+    for(k = 0; k < lanes; k++)
+	col[k] = mask[k] ? v[k] : col[k];
+}
+
+/*
+ * The record is taken out of every mask. It is run again
+ * alone, and its output so far is dropped.
+ */
+static void diverge(int k){
+    records[k].diverged = 1;
+
+    for(int l = 0; l <= loops; l++)
+	masks[l * width + k] = 0;
+}
+
+static void append(record *r, char *s, size_t n){
+    if(r->length + n > r->capacity){
+	r->capacity = 2 * (r->length + n);
+	r->out      = (char*)realloc(r->out, r->capacity);
+    }
+
+    memcpy(r->out + r->length, s, n);
+    r->length += n;
+}
+
+/*
+ * Tells whether the statements can be run in lockstep, and finds
+ * the deepest expression and the deepest nesting of loops. Only
+ * constant strings may be printed.
+ */
+static int eligible(ir_stmt *stmt, int level){
+    for(; stmt != NULL; stmt = stmt->next)
+	switch(stmt->kind){
+	case IR_TRAP:
+	    break;
+	case IR_FOR:
+	    if(level > loops)
+		loops = level;
+	    if(!eligibleExpr(stmt->expn, 1) || !eligibleExpr(stmt->expn2, 1) ||
+	       !eligible(stmt->body, level +1))
+		return 0;
+	    break;
+	case IR_PRINT:
+	    if(stmt->lt == STRING && stmt->expn->op == IR_CONST)
+		break;
+	default:
+	    if(stmt->lt == STRING || !eligibleExpr(stmt->expn, 1))
+		return 0;
+	}
+
+    return 1;
+}
+
+static int eligibleExpr(ir_expr *expn, int d){
+    if(expn == NULL)
+	return 1;
+
+    if(d > depth)
+	depth = d;
+
+    return expn->lt != STRING && eligibleExpr(expn->l, d +1) && eligibleExpr(expn->r, d +1);
+}
@@ -0,0 +1,40 @@
+#ifndef BATCH_HEADER
+#define BATCH_HEADER
+
+#include "tree.h"
+
+/*
+ * This file contains the declarations of the batch mode. The
+ * program is compiled once and then run once for every line of
+ * the standard input, the record, whose values the read statements
+ * read. The output of the records is in the order of the input.
+ *
+ * The records are run in groups of BATCH_WIDTH in lockstep: every
+ * statement is executed for the whole group at once, with the
+ * variables as columns that have one value for every record. A
+ * for loop runs until the longest range of the group ends, and the
+ * records whose range has ended sit the iterations out. A record
+ * diverges if a statement fails for it, and it is then run again
+ * alone with the closures, which report the error exactly as
+ * the closure engine does. Programs that use strings other than
+ * printing constants are run record by record with the closures,
+ * and programs that can not be lowered, such as the ones that use
+ * arrays, record by record with the interpreter.
+ */
+
+#define BATCH_WIDTH     64
+#define BATCH_MAX_WIDTH 1024
+
+/*
+ * Sets the number of records run in lockstep. With width 1
+ * every record is run alone with the closures.
+ */
+extern void batchOptions (int width);
+
+/*
+ * Main function of the batch mode. Returns 1 if no record
+ * failed, 0 otherwise. The syntax tree is freed.
+ */
+extern int  runBatch     (program_node *pn);
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "label.h"
+#include "ir.h"
+#include "cache.h"
+#include "memory.h"
+
+/*
+ * This file contains the cache of optimized programs. The files
+ * are text: a header line, the slots and the statements in pre-order.
+ * Every statement and expression is written on its own line with
+ * its fields, followed by its subexpressions and the body. A missing
+ * expression is written as - and a statement list ends with a line
+ * that has a single dot. Strings are written as length:bytes.
+ */
+
+/* Helper functions used only in this translation unit. */
+static void     writeStmts  (FILE *f, ir_stmt *stmt);
+static void     writeExpr   (FILE *f, ir_expr *expn);
+static void     writeString (FILE *f, char *s      );
+static ir_stmt *readStmts   (FILE *f               );
+static ir_expr *readExpr    (FILE *f               );
+static char    *readString  (FILE *f               );
+static int      end         (FILE *f, int c        );
+
+/* Path of the cache file of the program, or NULL if disabled. */
+static char *path;
+static int   broken;
+
+/*
+ * The key is the 64 bit FNV-1a hash of the source text, the
+ * optimization level, the unroll factor and the version of the
+ * file format.
+ */
+void cacheOptions(char *dir, char *source, int level, int unroll){
+    unsigned long long hash = 14695981039346656037ULL;
+    FILE *f;
+    int   c;
+
+    free(path);
+    path = NULL;
+
+    if(dir == NULL || (f = fopen(source, "rb")) == NULL)
+	return;
+
+    while((c = getc(f)) != EOF)
+	hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+    fclose(f);
+
+    hash = (hash ^ level) * 1099511628211ULL;
+    hash = (hash ^ unroll) * 1099511628211ULL;
+    hash = (hash ^ CACHE_VERSION) * 1099511628211ULL;
+
+    mkdir(dir, 0777);
+
+    path = (char*)malloc(strlen(dir) + 32);
+    sprintf(path, "%s/%016llx.ir", dir, hash);
+}
+
+ir_program *cacheLoad(void){
+    ir_program *ir;
+    FILE       *f;
+    int         version, n, lt;
+
+    if(path == NULL || (f = fopen(path, "r")) == NULL)
+	return NULL;
+
+    if(fscanf(f, "MPLIR %d %d\n", &version, &n) != 2 || version != CACHE_VERSION || n < 0){
+	fclose(f);
+	return NULL;
+    }
+
+    broken = 0;
+    ir = newIrProgram();
+    for(int i = 0; i < n && !broken; i++){
+	if(fscanf(f, "%d ", &lt) != 1){
+	    broken = 1;
+	    break;
+	}
+	newSlot(ir, "", lt);
+	free(ir->names[i]);
+	ir->names[i] = readString(f);
+    }
+    if(!broken)
+	ir->stmts = readStmts(f);
+
+    fclose(f);
+
+    if(broken){
+	freeIr(ir);
+	return NULL;
+    }
+
+    return ir;
+}
+
+/*
+ * The file is written under a temporary name and renamed, so that
+ * the other runs of the same program never see it half written.
+ */
+void cacheStore(ir_program *ir){
+    char *tmp;
+    FILE *f;
+
+    if(path == NULL)
+	return;
+
+    tmp = (char*)malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%d", path, (int)getpid());
+
+    if((f = fopen(tmp, "w")) == NULL){
+	free(tmp);
+	return;
+    }
+
+    fprintf(f, "MPLIR %d %d\n", CACHE_VERSION, ir->nslots);
+    for(int i = 0; i < ir->nslots; i++){
+	fprintf(f, "%d ", ir->types[i]);
+	writeString(f, ir->names[i]);
+    }
+    writeStmts(f, ir->stmts);
+
+    if(fclose(f) != 0 || rename(tmp, path) != 0)
+	remove(tmp);
+
+    free(tmp);
+}
+
+static void writeStmts(FILE *f, ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next){
+	fprintf(f, "%d %d %d %d\n", stmt->kind, stmt->line, stmt->slot, stmt->lt);
+	writeExpr(f, stmt->expn);
+	writeExpr(f, stmt->expn2);
+	writeString(f, stmt->msg);
+	writeStmts(f, stmt->body);
+    }
+
+    fprintf(f, ".\n");
+}
+
+static void writeExpr(FILE *f, ir_expr *expn){
+    if(expn == NULL){
+	fprintf(f, "-\n");
+	return;
+    }
+
+    fprintf(f, "%d %d %d %d %d %d %d\n", expn->op, expn->lt, expn->line,
+	    expn->fault, expn->nonzero, expn->i, expn->slot);
+    writeString(f, expn->s);
+    writeExpr(f, expn->l);
+    writeExpr(f, expn->r);
+}
+
+static void writeString(FILE *f, char *s){
+    if(s == NULL)
+	fprintf(f, "-\n");
+    else{
+	fprintf(f, "%d:", (int)strlen(s));
+	fwrite(s, 1, strlen(s), f);
+	fprintf(f, "\n");
+    }
+}
+
+static ir_stmt *readStmts(FILE *f){
+    ir_stmt *head = NULL, **tail = &head, *stmt;
+    int      kind, line, slot, lt;
+
+    while(!broken && !end(f, '.')){
+	if(fscanf(f, "%d %d %d %d\n", &kind, &line, &slot, &lt) != 4){
+	    broken = 1;
+	    break;
+	}
+
+	stmt        = newIrStmt((ir_kind)kind);
+	stmt->line  = line;
+	stmt->slot  = slot;
+	stmt->lt    = (label_type)lt;
+	stmt->expn  = readExpr(f);
+	stmt->expn2 = readExpr(f);
+	stmt->msg   = readString(f);
+	stmt->body  = readStmts(f);
+	*tail = stmt;
+	tail  = &stmt->next;
+    }
+
+    return head;
+}
+
+static ir_expr *readExpr(FILE *f){
+    ir_expr *expn;
+    int      op, lt, line, fault, nonzero, i, slot;
+
+    if(broken || end(f, '-'))
+	return NULL;
+
+    if(fscanf(f, "%d %d %d %d %d %d %d\n", &op, &lt, &line, &fault, &nonzero, &i, &slot) != 7){
+	broken = 1;
+	return NULL;
+    }
+
+    expn        = newIrExpr((ir_op)op);
+    expn->lt    = (label_type)lt;
+    expn->line  = line;
+    expn->fault   = fault;
+    expn->nonzero = nonzero;
+    expn->i       = i;
+    expn->slot    = slot;
+    expn->s       = readString(f);
+    expn->l       = readExpr(f);
+    expn->r       = readExpr(f);
+
+    return expn;
+}
+
+static char *readString(FILE *f){
+    char *s;
+    int   n;
+
+    if(broken || end(f, '-'))
+	return NULL;
+
+    if(fscanf(f, "%d:", &n) != 1 || n < 0){
+	broken = 1;
+	return NULL;
+    }
+
+    s = (char*)malloc(n +1);
+    if(fread(s, 1, n, f) != (size_t)n || getc(f) != '\n'){
+	broken = 1;
+	n = 0;
+    }
+    s[n] = '\0';
+
+    return s;
+}
+
+/*
+ * Consumes the line that has only the character c. Returns 0 if
+ * the next line is something else, or at the end of the file.
+ */
+static int end(FILE *f, int c){
+    int next = getc(f);
+
+    if(next != c){
+	if(next == EOF)
+	    broken = 1;
+	else
+	    ungetc(next, f);
+	return 0;
+    }
+
+    if(getc(f) != '\n')
+	broken = 1;
+
+    return 1;
+}
@@ -0,0 +1,33 @@
+#ifndef CACHE_HEADER
+#define CACHE_HEADER
+
+#include "ir.h"
+
+/*
+ * This file contains the declarations of the cache of optimized
+ * programs. The IR of a program is saved after the optimizer to a
+ * file named by a hash of the source text and the optimization
+ * level, so that the next run of the same program skips the
+ * optimizer and the compile time evaluation it does.
+ *
+ * The cache is a directory of files that can be removed at any
+ * time. A file that can not be read is ignored.
+ */
+
+/* Version of the file format. Changed whenever the IR changes. */
+#define CACHE_VERSION 4
+
+/*
+ * Enables the cache in the directory dir for the program in the
+ * file source, optimized at the level with the unroll factor. The
+ * directory is created if it does not exist.
+ */
+extern void        cacheOptions (char *dir, char *source, int level, int unroll);
+
+/* Returns the IR of the program from the cache, or NULL. */
+extern ir_program *cacheLoad    (void);
+
+/* Saves the IR of the program to the cache. */
+extern void        cacheStore   (ir_program *ir);
+
+#endif
@@ -0,0 +1,733 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "optimize.h"
+#include "closure.h"
+#include "jit.h"
+#include "parallel.h"
+#include "vector.h"
+#include "schedule.h"
+#include "pool.h"
+#include "output.h"
+#include "memory.h"
+#include "input.h"
+
+/*
+ * Interface function of the tree walking interpreter. Programs
+ * that can not be lowered are executed with it.
+ */
+extern int run(program_node *pn);
+
+/* Helper functions used only in this translation unit. */
+static expr_closure *compileExpression (ir_expr *expn);
+static stmt_closure *compileStatement  (ir_stmt *stmt);
+
+/*
+ * The JIT mode of the engine. With JIT_CHECK every compiled loop
+ * is executed both natively and with the closures, and the
+ * results are compared.
+ */
+enum jit_mode {JIT_OFF, JIT_ON, JIT_CHECK};
+static enum jit_mode jit;
+static int           native_depth;   // Nesting of natively compiled loops.
+
+enum error_type {SEMANTIC_ERROR, RUNTIME_ERROR};
+static void printError (int line, char *message, enum error_type et);
+static void storeStr   (frame *f, int slot, const char *s, size_t n);
+
+/*
+ * Main function of the closure compiled execution engine.
+ *
+ * The program is lowered, optimized and translated into closures once, and
+ * then the closures are executed, the independent top level statements
+ * concurrently if there are several threads. If the program can not be
+ * lowered, it is executed with the interpreter instead. In both
+ * cases the syntax tree is freed.
+ *
+ * Returns 1 if there was no errors, 0 otherwise.
+ */
+int runClosures(program_node *pn){
+    ir_program *ir = lower(pn);
+    int         tmp;
+
+    if(ir == NULL)
+	return run(pn);
+
+    optimize(ir);
+
+    stmt_closure *c = compileClosures(ir->stmts);
+    schedule     *s = poolThreads() > 1 ? scheduleStatements(ir->stmts, c, ir->nslots) : NULL;
+    frame         f;
+
+    f.env      = (cell*)calloc(ir->nslots +1, sizeof(cell));
+    f.buffers  = (buffer*)calloc(ir->nslots +1, sizeof(buffer));
+    f.fault    = 0;
+    f.parallel = 0;
+
+    tmp = s != NULL ? runSchedule(s, &f) : execClosures(c, &f);
+
+    releaseStrings(&f, ir->nslots);
+    free(f.env);
+    free(f.buffers);
+    free(s);
+    freeStmtClosures(c);
+    freeIr(ir);
+    freeSyntaxTree(pn, NULL);
+
+    return tmp;
+}
+
+/*
+ * Interface functions of the closure engine with the JIT compiler.
+ * Hot for loops with integer bodies are compiled to native code.
+ */
+int runJit(program_node *pn){
+    int tmp;
+
+    jit = JIT_ON;
+    tmp = runClosures(pn);
+    jitRelease();
+    jit = JIT_OFF;
+
+    return tmp;
+}
+
+int runJitChecked(program_node *pn){
+    int tmp;
+
+    jit = JIT_CHECK;
+    tmp = runClosures(pn);
+    jitRelease();
+    jit = JIT_OFF;
+
+    return tmp;
+}
+
+void releaseStrings(frame *f, int nslots){
+    for(int n = 0; n <= nslots; n++)
+	if(f->buffers[n].capacity != 0){
+	    free(f->env[n].s);
+	    f->buffers[n].capacity = 0;
+	}
+}
+
+/*
+ * Statement lists are executed iteratively. The
+ * execution stops at the first failing statement.
+ */
+int execClosures(stmt_closure *c, frame *f){
+    for(; c != NULL; c = c->next)
+	if(c->exec(c, f) == 0)
+	    return 0;
+
+    return 1;
+}
+
+/*
+ * EXPRESSIONS ---------------------------------------------------------
+ *
+ * Integer arithmetic is done with unsigned integers to get
+ * the same wrap around behaviour as in the interpreter.
+ * The right operand is evaluated before the left one.
+ */
+
+static int intConst(expr_closure *c, frame *f){
+    return c->i;
+}
+
+static int intVar(expr_closure *c, frame *f){
+    return f->env[c->slot].i;
+}
+
+static char *strConst(expr_closure *c, frame *f){
+    return c->s;
+}
+
+static char *strVar(expr_closure *c, frame *f){
+    return f->env[c->slot].s;
+}
+
+/*
+ * The integer and boolean binary operators are specialized by the
+ * shape of their operands. V stands for a variable, C for a constant
+ * and G for any other expression.
+ */
+#define BINARY(name, expression)					\
+    static int name##GG(expr_closure *c, frame *f){			\
+	int r = c->r->eval.i(c->r, f);					\
+	int l = c->l->eval.i(c->l, f);					\
+	return expression;						\
+    }									\
+    static int name##VV(expr_closure *c, frame *f){			\
+	int r = f->env[c->r->slot].i;					\
+	int l = f->env[c->l->slot].i;					\
+	return expression;						\
+    }									\
+    static int name##VC(expr_closure *c, frame *f){			\
+	int r = c->r->i;						\
+	int l = f->env[c->l->slot].i;					\
+	return expression;						\
+    }									\
+    static int name##CV(expr_closure *c, frame *f){			\
+	int r = f->env[c->r->slot].i;					\
+	int l = c->l->i;						\
+	return expression;						\
+    }									\
+    static int name##GV(expr_closure *c, frame *f){			\
+	int r = f->env[c->r->slot].i;					\
+	int l = c->l->eval.i(c->l, f);					\
+	return expression;						\
+    }									\
+    static int name##GC(expr_closure *c, frame *f){			\
+	int r = c->r->i;						\
+	int l = c->l->eval.i(c->l, f);					\
+	return expression;						\
+    }
+
+BINARY(add,  (int)((unsigned)l + (unsigned)r))
+BINARY(sub,  (int)((unsigned)l - (unsigned)r))
+BINARY(mul,  (int)((unsigned)l * (unsigned)r))
+BINARY(and,  l & r)
+BINARY(less, l < r)
+BINARY(eq,   l == r)
+BINARY(max,  l > r ? l : r)
+BINARY(trips, tripCount(l, r))
+BINARY(sum,  rangeSum(l, r))
+BINARY(quot, l / r)
+
+/*
+ * Division by a non zero constant can not fail, nor can division
+ * by a divisor the optimizer proved to be never zero (quot).
+ */
+static int divC(expr_closure *c, frame *f){
+    return c->l->eval.i(c->l, f) / c->r->i;
+}
+
+/*
+ * The interpreter reports division by zero only if neither of
+ * the operands failed. The fault indicator is cleared for the
+ * evaluation of the operands to find that out.
+ */
+static int divide(expr_closure *c, frame *f){
+    int fault = f->fault;
+
+    f->fault = 0;
+    int r = c->r->eval.i(c->r, f);
+    int l = c->l->eval.i(c->l, f);
+
+    if(f->fault)
+	return 0;
+
+    if(r == 0){
+	printError(c->line, "Division by zero", RUNTIME_ERROR);
+	f->fault = 1;
+	return 0;
+    }
+
+    f->fault = fault;
+    return l / r;
+}
+
+static int not(expr_closure *c, frame *f){
+    return c->l->eval.i(c->l, f) ^ 1;
+}
+
+/*
+ * The interpreter reports every unary operator
+ * whose operand failed.
+ */
+static int notFault(expr_closure *c, frame *f){
+    int fault = f->fault;
+
+    f->fault = 0;
+    int v = c->l->eval.i(c->l, f);
+
+    if(f->fault){
+	printError(c->line, "The argument type of unary expression must be bool", SEMANTIC_ERROR);
+	return 0;
+    }
+
+    f->fault = fault;
+    return v ^ 1;
+}
+
+/*
+ * The result is valid until the closure is evaluated again, so the
+ * statements copy it before they store it.
+ */
+static char *concat(expr_closure *c, frame *f){
+    char  *r = c->r->eval.s(c->r, f);
+    char  *l = c->l->eval.s(c->l, f);
+    size_t ll = strlen(l), rl = strlen(r);
+
+    if(ll + rl +1 > c->size){
+	c->size = 2 * (ll + rl +1);
+	free(c->buf);
+	c->buf  = (char*)malloc(c->size);
+    }
+
+    memcpy(c->buf,      l, ll);
+    memcpy(c->buf + ll, r, rl +1);
+
+    return c->buf;
+}
+
+static int strLess(expr_closure *c, frame *f){
+    char *r = c->r->eval.s(c->r, f);
+    char *l = c->l->eval.s(c->l, f);
+
+    return l != r && strcmp(l, r) < 0;
+}
+
+static int strEq(expr_closure *c, frame *f){
+    char *r = c->r->eval.s(c->r, f);
+    char *l = c->l->eval.s(c->l, f);
+
+    return l == r || strcmp(l, r) == 0;
+}
+
+/*
+ * Selects the specialized function of an integer or
+ * boolean operator by the shapes of the operands.
+ */
+#define SELECT(c, name)							\
+    do{									\
+	if(c->l->eval.i == intVar && c->r->eval.i == intVar)		\
+	    c->eval.i = name##VV;					\
+	else if(c->l->eval.i == intVar && c->r->eval.i == intConst)	\
+	    c->eval.i = name##VC;					\
+	else if(c->l->eval.i == intConst && c->r->eval.i == intVar)	\
+	    c->eval.i = name##CV;					\
+	else if(c->r->eval.i == intVar)					\
+	    c->eval.i = name##GV;					\
+	else if(c->r->eval.i == intConst)				\
+	    c->eval.i = name##GC;					\
+	else								\
+	    c->eval.i = name##GG;					\
+    } while(0)
+
+static expr_closure *compileExpression(ir_expr *expn){
+    expr_closure *c = newExprClosure();
+
+    c->line = expn->line;
+
+    if(expn->l != NULL) c->l = compileExpression(expn->l);
+    if(expn->r != NULL) c->r = compileExpression(expn->r);
+
+    switch(expn->op){
+    case IR_CONST:
+	if(expn->lt == STRING){
+	    c->s      = expn->s;
+	    c->eval.s = strConst;
+	} else{
+	    c->i      = expn->i;
+	    c->eval.i = intConst;
+	}
+	break;
+    case IR_VAR:
+	c->slot = expn->slot;
+	if(expn->lt == STRING)
+	    c->eval.s = strVar;
+	else
+	    c->eval.i = intVar;
+	break;
+    case IR_NOT:
+	c->eval.i = expn->fault ? notFault : not;
+	break;
+    case IR_ADD:
+	if(expn->lt == STRING)
+	    c->eval.s = concat;
+	else
+	    SELECT(c, add);
+	break;
+    case IR_SUB:
+	SELECT(c, sub);
+	break;
+    case IR_MUL:
+	SELECT(c, mul);
+	break;
+    case IR_DIV:
+	if(expn->r->op == IR_CONST && expn->r->i != 0)
+	    c->eval.i = divC;
+	else if(expn->nonzero)
+	    SELECT(c, quot);
+	else
+	    c->eval.i = divide;
+	break;
+    case IR_AND:
+	SELECT(c, and);
+	break;
+    case IR_LESS:
+	if(expn->l->lt == STRING)
+	    c->eval.i = strLess;
+	else
+	    SELECT(c, less);
+	break;
+    case IR_EQ:
+	if(expn->l->lt == STRING)
+	    c->eval.i = strEq;
+	else
+	    SELECT(c, eq);
+	break;
+    case IR_MAX:
+	SELECT(c, max);
+	break;
+    case IR_TRIPS:
+	SELECT(c, trips);
+	break;
+    case IR_SUM:
+	SELECT(c, sum);
+	break;
+    }
+
+    return c;
+}
+
+/*
+ * STATEMENTS ----------------------------------------------------------
+ *
+ * If the expression of a statement failed, the statement reports
+ * the same follow up error as the interpreter does.
+ */
+
+static int assignInt(stmt_closure *c, frame *f){
+    f->env[c->slot].i = c->e1->eval.i(c->e1, f);
+    return 1;
+}
+
+static int assignIntFault(stmt_closure *c, frame *f){
+    f->fault = 0;
+    int v = c->e1->eval.i(c->e1, f);
+
+    if(f->fault){
+	printError(c->line, c->msg, SEMANTIC_ERROR);
+	return 0;
+    }
+
+    f->env[c->slot].i = v;
+    return 1;
+}
+
+static int assignStr(stmt_closure *c, frame *f){
+    char *s = c->e1->eval.s(c->e1, f);
+
+    storeStr(f, c->slot, s, strlen(s));
+    return 1;
+}
+
+/*
+ * The assignment s := s + e appends to the buffer of s in place
+ * while it has room. Otherwise the string is copied to a new
+ * buffer with twice the room it needs, so that building a string
+ * with repeated appends takes amortized linear time. The left
+ * operand is the slot itself and is not evaluated. The right one
+ * may be the slot too, so it is moved after the buffer.
+ */
+static int appendStr(stmt_closure *c, frame *f){
+    char   *r  = c->e1->r->eval.s(c->e1->r, f);
+    char   *s  = f->env[c->slot].s;
+    buffer *b  = &f->buffers[c->slot];
+    size_t  rl = strlen(r);
+
+    if(b->capacity == 0){
+	b->length   = strlen(s);
+	b->capacity = 2 * (b->length + rl) +1;
+	s = (char*)memcpy(malloc(b->capacity +1), s, b->length);
+    } else if(b->length + rl > b->capacity){
+	b->capacity = 2 * (b->length + rl);
+	if(r == s)
+	    r = s = (char*)realloc(s, b->capacity +1);
+	else
+	    s = (char*)realloc(s, b->capacity +1);
+    }
+
+    memmove(s + b->length, r, rl);
+    b->length += rl;
+    s[b->length] = '\0';
+    f->env[c->slot].s = s;
+    return 1;
+}
+
+/*
+ * The control variable keeps the value of the
+ * counter after the loop, as in the interpreter.
+ */
+static int for_(stmt_closure *c, frame *f){
+    int start, end, i;
+
+    f->fault = 0;
+    start = c->e1->eval.i(c->e1, f);
+    end   = c->e2->eval.i(c->e2, f);
+
+    if(f->fault){
+	printError(c->line, "For range should be integer", SEMANTIC_ERROR);
+	return 0;
+    }
+
+    for(i = start; i <= end; i++){
+	f->env[c->slot].i = i;
+	if(execClosures(c->body, f) == 0)
+	    return 0;
+    }
+
+    f->env[c->slot].i = i;
+    return 1;
+}
+
+/*
+ * A reduction loop is run on the thread pool if it is long
+ * enough. Its range can not fail, so evaluating it again in
+ * the serial loop does not matter.
+ */
+static int forParallel(stmt_closure *c, frame *f){
+    int start = c->e1->eval.i(c->e1, f);
+    int end   = c->e2->eval.i(c->e2, f);
+
+    if(parallelRun(c, f, start, end))
+	return 1;
+
+    return c->vector != NULL ? vectorRun(c, f, start, end) : for_(c, f);
+}
+
+/* A vectorized loop. Its range can not fail either. */
+static int forVector(stmt_closure *c, frame *f){
+    int start = c->e1->eval.i(c->e1, f);
+    int end   = c->e2->eval.i(c->e2, f);
+
+    return vectorRun(c, f, start, end);
+}
+
+/*
+ * Finds the k:th statement of the loop in the order the JIT
+ * compiler numbers them, the loop itself being the 0th.
+ */
+static stmt_closure *nthStatement(stmt_closure *c, int *k){
+    stmt_closure *tmp;
+
+    if((*k)-- == 0)
+	return c;
+
+    for(c = c->body; c != NULL; c = c->next)
+	if((tmp = nthStatement(c, k)) != NULL)
+	    return tmp;
+
+    return NULL;
+}
+
+/*
+ * Natively compiled loop. When the native code finds an error,
+ * the failing statement is executed again with the closures
+ * to report the same errors as the interpreter.
+ */
+static int forNative(stmt_closure *c, frame *f){
+    int k = c->native->code(f->env);
+
+    if(k < 0)
+	return 1;
+
+    stmt_closure *s = nthStatement(c, &k);
+
+    return s == c ? for_(c, f) : s->exec(s, f);
+}
+
+/*
+ * Executes the loop natively, then again with the closures from
+ * the same state, and reports the variables that differ.
+ */
+static int forCheck(stmt_closure *c, frame *f){
+    native_loop *nl = c->native;
+    cell        *before = (cell*)malloc(sizeof(cell) * nl->nslots);
+    cell        *after  = (cell*)malloc(sizeof(cell) * nl->nslots);
+    int          i, native, tmp;
+
+    for(i = 0; i < nl->nslots; i++)
+	before[i] = f->env[nl->slots[i]];
+
+    native = nl->code(f->env);
+
+    for(i = 0; i < nl->nslots; i++){
+	after[i] = f->env[nl->slots[i]];
+	f->env[nl->slots[i]] = before[i];
+    }
+
+    tmp = for_(c, f);
+
+    if((native < 0) != tmp)
+	fprintf(stderr, "JIT mismatch in line %3d: loop %s.\n", c->line,
+		tmp ? "failed natively" : "did not fail natively");
+    else if(tmp)
+	for(i = 0; i < nl->nslots; i++)
+	    if(after[i].i != f->env[nl->slots[i]].i)
+		fprintf(stderr, "JIT mismatch in line %3d: slot %d is %d, expected %d.\n",
+			c->line, nl->slots[i], after[i].i, f->env[nl->slots[i]].i);
+
+    free(before);
+    free(after);
+
+    return tmp;
+}
+
+static int readInt(stmt_closure *c, frame *f){
+    if(inputInt(&f->env[c->slot].i) != 1){
+	printError(c->line, "Failed to read integer", RUNTIME_ERROR);
+	return 0;
+    }
+
+    return 1;
+}
+
+static int readStr(stmt_closure *c, frame *f){
+    char   *s;
+    size_t  n;
+
+    if(inputWord(&s, &n) != 1){
+	printError(c->line, "Failed to read string", RUNTIME_ERROR);
+	return 0;
+    }
+
+    storeStr(f, c->slot, s, n);
+    return 1;
+}
+
+static int printInt(stmt_closure *c, frame *f){
+    f->fault = 0;
+    int v = c->e1->eval.i(c->e1, f);
+
+    if(f->fault){
+	printError(c->line, "Invalid value in printable expression", RUNTIME_ERROR);
+	return 0;
+    }
+
+    outputInt(v);
+    return 1;
+}
+
+static int printStr(stmt_closure *c, frame *f){
+    char *s = c->e1->eval.s(c->e1, f);
+
+    outputString(s, strlen(s));
+    return 1;
+}
+
+static int assert(stmt_closure *c, frame *f){
+    f->fault = 0;
+    int v = c->e1->eval.i(c->e1, f);
+
+    if(f->fault || v != 1){
+	printError(c->line, "Assertion failed", SEMANTIC_ERROR);
+	return 0;
+    }
+
+    return 1;
+}
+
+static int trap(stmt_closure *c, frame *f){
+    outputFlush();
+    fputs(c->msg, stderr);
+    return 0;
+}
+
+stmt_closure *compileClosures(ir_stmt *stmt){
+    stmt_closure *head = NULL, **tail = &head;
+
+    for(; stmt != NULL; stmt = stmt->next){
+	*tail = compileStatement(stmt);
+	tail  = &(*tail)->next;
+    }
+
+    return head;
+}
+
+static stmt_closure *compileStatement(ir_stmt *stmt){
+    stmt_closure *c = newStmtClosure();
+
+    c->slot = stmt->slot;
+    c->line = stmt->line;
+
+    if(stmt->expn  != NULL) c->e1 = compileExpression(stmt->expn);
+    if(stmt->expn2 != NULL) c->e2 = compileExpression(stmt->expn2);
+
+    switch(stmt->kind){
+    case IR_DECLARE:
+    case IR_ASSIGN:
+	c->msg = stmt->kind == IR_DECLARE ?
+	    "Incompatible types in declaration" : "Incompatible types in assignment";
+	if(stmt->lt == STRING && stmt->kind == IR_ASSIGN && stmt->expn->op == IR_ADD &&
+	   stmt->expn->l->op == IR_VAR && stmt->expn->l->slot == stmt->slot)
+	    c->exec = appendStr;
+	else if(stmt->lt == STRING)
+	    c->exec = assignStr;
+	else
+	    c->exec = stmt->expn->fault ? assignIntFault : assignInt;
+	break;
+    case IR_FOR:
+	c->exec = for_;
+	if(jit != JIT_OFF && native_depth == 0 && (c->native = jitCompile(stmt)) != NULL)
+	    c->exec = jit == JIT_CHECK ? forCheck : forNative;
+	else if(native_depth == 0){
+	    if(poolThreads() > 1)
+		c->parallel = parallelLoop(stmt);
+	    c->vector = vectorLoop(stmt);
+	    c->exec   = c->parallel != NULL ? forParallel : c->vector != NULL ? forVector : for_;
+	}
+
+	/* The closures of the body are kept for reporting errors. */
+	native_depth += c->native != NULL;
+	c->body = compileClosures(stmt->body);
+	native_depth -= c->native != NULL;
+	break;
+    case IR_READ:
+	c->exec = stmt->lt == STRING ? readStr : readInt;
+	break;
+    case IR_PRINT:
+	c->exec = stmt->lt == STRING ? printStr : printInt;
+	break;
+    case IR_ASSERT:
+	c->exec = assert;
+	break;
+    case IR_TRAP:
+	c->exec = trap;
+	c->msg  = stmt->msg;
+	break;
+    }
+
+    return c;
+}
+
+/*
+ * This function prints the error information associated to the line.
+ */
+static void printError(int line, char *message, enum error_type et){
+
+    outputFlush();
+
+    if(et == SEMANTIC_ERROR)
+	fprintf(stderr, "Semantic error in line %3d: %s.\n", line, message);
+    else
+	fprintf(stderr, "Runtime error  in line %3d: %s.\n", line, message);
+}
+
+/*
+ * Copies the n characters of *s to the buffer of the slot, which
+ * is reused if it is owned and has room. The characters may be
+ * the string of the slot itself.
+ */
+static void storeStr(frame *f, int slot, const char *s, size_t n){
+    buffer *b = &f->buffers[slot];
+
+    if(b->capacity < n || b->capacity == 0){
+	if(b->capacity != 0)
+	    free(f->env[slot].s);
+	b->capacity = n > 0 ? n : 1;
+	f->env[slot].s = (char*)malloc(b->capacity +1);
+    }
+
+    memmove(f->env[slot].s, s, n);
+    f->env[slot].s[n] = '\0';
+    b->length = n;
+}
@@ -0,0 +1,98 @@
+#ifndef CLOSURE_HEADER
+#define CLOSURE_HEADER
+
+#include <stddef.h>
+
+#include "ir.h"
+
+/*
+ * This file contains the type declarations of the closure
+ * compiled execution engine. The IR of the program is
+ * translated once into a tree of closures. Each closure is a
+ * pointer to a C function that is specialized for the operation
+ * and the operand types, and the operands the function needs.
+ * No closure needs to look at the shape of the syntax tree
+ * when it is executed.
+ */
+
+/*
+ * One variable slot of the running program. Integers and
+ * booleans are stored in i and strings in s.
+ */
+typedef union CELL{
+    int           i;
+    char         *s;
+} cell;
+
+/*
+ * The string buffer of a slot. A slot owns the strings stored to
+ * it, and keeps their length and the capacity of the buffer, so
+ * that the buffer can be reused and the string appended in place.
+ * The capacity is 0 when the slot does not own its string, which
+ * is then a constant or a string of the interpreter.
+ */
+typedef struct BUFFER{
+    size_t        length;
+    size_t        capacity;
+} buffer;
+
+/*
+ * The execution state passed to every closure. The flag fault
+ * is set when an expression fails at runtime (division by zero)
+ * and is used to produce the same error messages as the
+ * interpreter does. The flag parallel is set in the frames of
+ * the chunks of a parallel loop, see parallel.h.
+ */
+typedef struct FRAME{
+    cell         *env;
+    buffer       *buffers;
+    int           fault;
+    int           parallel;
+} frame;
+
+typedef struct EXPR_CLOSURE expr_closure;
+typedef struct STMT_CLOSURE stmt_closure;
+
+struct EXPR_CLOSURE{
+    union{
+	int   (*i)(expr_closure *c, frame *f);  // Integer and boolean expressions.
+	char *(*s)(expr_closure *c, frame *f);  // String expressions.
+    } eval;
+    expr_closure *l    ;
+    expr_closure *r    ;
+    int           i    ;
+    char         *s    ;
+    int           slot ;
+    int           line ;
+    char         *buf  ;   // The result of a concatenation, reused by every evaluation.
+    size_t        size ;
+};
+
+/*
+ * Statement closures return 0 if the statement failed and
+ * the program must be stopped, 1 otherwise.
+ */
+struct STMT_CLOSURE{
+    int         (*exec)(stmt_closure *c, frame *f);
+    expr_closure *e1   ;
+    expr_closure *e2   ;
+    stmt_closure *body ;
+    int           slot ;
+    int           line ;
+    char         *msg  ;
+    struct NATIVE_LOOP *native;  // Native code of a for loop, or NULL.
+    struct PARALLEL_LOOP *parallel;  // Slot roles of a parallel for loop, or NULL.
+    struct VECTOR_LOOP *vector;      // Lane operations of a vectorized for loop, or NULL.
+    stmt_closure *next ;
+};
+
+/* Translates a list of IR statements into closures. */
+extern stmt_closure *compileClosures (ir_stmt *stmt                );
+
+/* Executes a list of statement closures. */
+extern int           execClosures    (stmt_closure *c, frame *f    );
+
+/* Frees the strings the slots of the frame own. */
+extern void          releaseStrings  (frame *f, int nslots         );
+
+#endif
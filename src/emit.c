@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "optimize.h"
+#include "memory.h"
+
+/*
+ * This file contains the ahead-of-time compiler that translates
+ * MiniPL programs to C. The IR of the program is written out as
+ * a single C translation unit that contains a small runtime and
+ * the function main. The generated program prints the same output
+ * and error messages and returns the same exit code as the
+ * interpreter, and it can be built with any C99 compiler.
+ *
+ * Every expression node is computed into its own temporary in
+ * the order the interpreter evaluates them, so the C compiler is
+ * free to optimize the code but the error messages come out in
+ * the same order.
+ */
+
+/* Helper functions used only in this translation unit. */
+static void stmts       (ir_stmt *stmt                      );
+static void statement   (ir_stmt *stmt                      );
+static void for_        (ir_stmt *stmt                      );
+static void check       (ir_stmt *stmt, char *message, char *type);
+static int  expression  (ir_expr *expn                      );
+static void indent      (void                               );
+static void string      (char *s                            );
+static void integer     (int i                              );
+
+/*
+ * State of the code generation. Temporaries are numbered
+ * uniquely in the whole program.
+ */
+static FILE *output;
+static int   temps;
+static int   depth;
+
+/*
+ * The runtime of the generated programs. The strings are
+ * immutable and carry their length.
+ */
+static const char *runtime =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "typedef struct{\n"
+    "    int         length;\n"
+    "    const char *chars;\n"
+    "} mpl_string;\n"
+    "\n"
+    "enum error_type {SEMANTIC_ERROR, RUNTIME_ERROR};\n"
+    "\n"
+    "static void mpl_error(int line, const char *message, enum error_type et){\n"
+    "    if(et == SEMANTIC_ERROR)\n"
+    "\tfprintf(stderr, \"Semantic error in line %3d: %s.\\n\", line, message);\n"
+    "    else\n"
+    "\tfprintf(stderr, \"Runtime error  in line %3d: %s.\\n\", line, message);\n"
+    "}\n"
+    "\n"
+    "static inline mpl_string mpl_concat(mpl_string l, mpl_string r){\n"
+    "    char      *s = (char*)malloc(l.length + r.length +1);\n"
+    "    mpl_string v;\n"
+    "\n"
+    "    memcpy(s,            l.chars, l.length);\n"
+    "    memcpy(s + l.length, r.chars, r.length);\n"
+    "    s[l.length + r.length] = '\\0';\n"
+    "\n"
+    "    v.length = l.length + r.length;\n"
+    "    v.chars  = s;\n"
+    "    return v;\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_less(mpl_string l, mpl_string r){\n"
+    "    int c = memcmp(l.chars, r.chars, l.length < r.length ? l.length : r.length);\n"
+    "\n"
+    "    return c < 0 || (c == 0 && l.length < r.length);\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_equal(mpl_string l, mpl_string r){\n"
+    "    return l.length == r.length && memcmp(l.chars, r.chars, l.length) == 0;\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_max(int l, int r){\n"
+    "    return l > r ? l : r;\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_trips(int s, int e){\n"
+    "    return e < s ? 0 : (int)((unsigned)e - (unsigned)s + 1);\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_sum(int s, int e){\n"
+    "    unsigned long long n = (unsigned long long)((long long)e - s) + 1;\n"
+    "    return e < s ? 0 : (int)(unsigned)(n * (unsigned long long)(long long)s + n * (n - 1) / 2);\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_space(int c){\n"
+    "    return c == ' ' || (c >= '\\t' && c <= '\\r');\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_read_int(int *v, int line){\n"
+    "    unsigned u = 0, limit = 2147483647u;\n"
+    "    int      c, negative = 0, digits = 0;\n"
+    "\n"
+    "    while((c = getchar()) != EOF && mpl_space(c))\n"
+    "\t;\n"
+    "\n"
+    "    if(c == '+' || c == '-'){\n"
+    "\tnegative = c == '-';\n"
+    "\tc = getchar();\n"
+    "    }\n"
+    "\n"
+    "    limit += negative;\n"
+    "    for(; c >= '0' && c <= '9'; c = getchar(), digits++){\n"
+    "\tif(u > (limit - (c - '0')) / 10){\n"
+    "\t    digits = 0;\n"
+    "\t    break;\n"
+    "\t}\n"
+    "\tu = u * 10 + (c - '0');\n"
+    "    }\n"
+    "\n"
+    "    if(c != EOF)\n"
+    "\tungetc(c, stdin);\n"
+    "\n"
+    "    if(digits == 0){\n"
+    "\tmpl_error(line, \"Failed to read integer\", RUNTIME_ERROR);\n"
+    "\treturn 0;\n"
+    "    }\n"
+    "\n"
+    "    *v = negative ? (int)(0u - u) : (int)u;\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "static inline int mpl_read_string(mpl_string *v, int line){\n"
+    "    char *s;\n"
+    "    int   c, n = 0, size = 16;\n"
+    "\n"
+    "    while((c = getchar()) != EOF && mpl_space(c))\n"
+    "\t;\n"
+    "\n"
+    "    if(c == EOF){\n"
+    "\tmpl_error(line, \"Failed to read string\", RUNTIME_ERROR);\n"
+    "\treturn 0;\n"
+    "    }\n"
+    "\n"
+    "    s = (char*)malloc(size);\n"
+    "    for(; c != EOF && !mpl_space(c); c = getchar()){\n"
+    "\tif(n +1 == size)\n"
+    "\t    s = (char*)realloc(s, size *= 2);\n"
+    "\ts[n++] = (char)c;\n"
+    "    }\n"
+    "    s[n] = '\\0';\n"
+    "\n"
+    "    if(c != EOF)\n"
+    "\tungetc(c, stdin);\n"
+    "\n"
+    "    v->length = n;\n"
+    "    v->chars  = s;\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "static inline void mpl_print_string(mpl_string s){\n"
+    "    fwrite(s.chars, 1, s.length, stdout);\n"
+    "}\n";
+
+/*
+ * Main function of the C code generation.
+ *
+ * Writes the C translation of the program *pn to the standard
+ * output and frees the syntax tree. Returns 1 if the program was
+ * translated, 0 if it can not be lowered to the IR.
+ */
+int emitC(program_node *pn){
+    ir_program *ir = lower(pn);
+
+    freeSyntaxTree(pn, NULL);
+
+    if(ir == NULL){
+	fprintf(stderr, "The program can not be compiled to C.\n");
+	return 0;
+    }
+
+    optimize(ir);
+
+    output = stdout;
+    temps  = 0;
+    depth  = 1;
+
+    fprintf(output, "/* Generated by minipl --emit-c. */\n\n%s\n", runtime);
+    fprintf(output, "int main(void){\n");
+    fprintf(output, "    int fault = 0;\n");
+
+    for(int i = 0; i < ir->nslots; i++){
+	if(ir->types[i] == STRING)
+	    fprintf(output, "    mpl_string v%d = {0, \"\"};", i);
+	else
+	    fprintf(output, "    int v%d = 0;", i);
+	fprintf(output, "    /* %s */\n", ir->names[i]);
+    }
+
+    fprintf(output, "\n    (void)fault;\n");
+    stmts(ir->stmts);
+    fprintf(output, "\n    return 1;\n}\n");
+
+    freeIr(ir);
+    return 1;
+}
+
+/*
+ * STATEMENTS ----------------------------------------------------------
+ *
+ * Every statement is a block of its own, so that its temporaries
+ * are local to it. A failing statement returns 0 from main.
+ */
+
+static void stmts(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	statement(stmt);
+}
+
+static void statement(ir_stmt *stmt){
+    int v;
+
+    indent(); fprintf(output, "{   /* line %d */\n", stmt->line);
+    depth++;
+
+    switch(stmt->kind){
+    case IR_DECLARE:
+    case IR_ASSIGN:
+	if(stmt->expn->fault){
+	    indent(); fprintf(output, "fault = 0;\n");
+	}
+	v = expression(stmt->expn);
+	if(stmt->expn->fault)
+	    check(stmt, stmt->kind == IR_DECLARE ? "Incompatible types in declaration"
+		  : "Incompatible types in assignment", "SEMANTIC_ERROR");
+	indent(); fprintf(output, "v%d = t%d;\n", stmt->slot, v);
+	break;
+    case IR_FOR:
+	for_(stmt);
+	break;
+    case IR_READ:
+	indent();
+	fprintf(output, "if(!mpl_read_%s(&v%d, %d)) return 0;\n",
+		stmt->lt == STRING ? "string" : "int", stmt->slot, stmt->line);
+	break;
+    case IR_PRINT:
+	if(stmt->expn->fault){
+	    indent(); fprintf(output, "fault = 0;\n");
+	}
+	v = expression(stmt->expn);
+	if(stmt->expn->fault)
+	    check(stmt, "Invalid value in printable expression", "RUNTIME_ERROR");
+	indent();
+	if(stmt->lt == STRING)
+	    fprintf(output, "mpl_print_string(t%d);\n", v);
+	else
+	    fprintf(output, "printf(\"%%d\", t%d);\n", v);
+	break;
+    case IR_ASSERT:
+	indent(); fprintf(output, "fault = 0;\n");
+	v = expression(stmt->expn);
+	indent(); fprintf(output, "if(fault || t%d != 1){\n", v);
+	indent(); fprintf(output, "    mpl_error(%d, \"Assertion failed\", SEMANTIC_ERROR);\n", stmt->line);
+	indent(); fprintf(output, "    return 0;\n");
+	indent(); fprintf(output, "}\n");
+	break;
+    case IR_TRAP:
+	indent(); fprintf(output, "fputs(");
+	string(stmt->msg);
+	fprintf(output, ", stderr);\n");
+	indent(); fprintf(output, "return 0;\n");
+	break;
+    }
+
+    depth--;
+    indent(); fprintf(output, "}\n");
+}
+
+/*
+ * The control variable keeps the value of the
+ * counter after the loop, as in the interpreter.
+ */
+static void for_(ir_stmt *stmt){
+    int start, end, i = temps++;
+    int fault = stmt->expn->fault || stmt->expn2->fault;
+
+    indent(); fprintf(output, "int t%d;\n", i);
+    if(fault){
+	indent(); fprintf(output, "fault = 0;\n");
+    }
+    start = expression(stmt->expn);
+    end   = expression(stmt->expn2);
+    if(fault)
+	check(stmt, "For range should be integer", "SEMANTIC_ERROR");
+
+    indent(); fprintf(output, "for(t%d = t%d; t%d <= t%d; t%d++){\n", i, start, i, end, i);
+    depth++;
+    indent(); fprintf(output, "v%d = t%d;\n", stmt->slot, i);
+    stmts(stmt->body);
+    depth--;
+    indent(); fprintf(output, "}\n");
+    indent(); fprintf(output, "v%d = t%d;\n", stmt->slot, i);
+}
+
+/* Reports the follow up error of a failed expression. */
+static void check(ir_stmt *stmt, char *message, char *type){
+    indent(); fprintf(output, "if(fault){\n");
+    indent(); fprintf(output, "    mpl_error(%d, \"%s\", %s);\n", stmt->line, message, type);
+    indent(); fprintf(output, "    return 0;\n");
+    indent(); fprintf(output, "}\n");
+}
+
+/*
+ * EXPRESSIONS ---------------------------------------------------------
+ *
+ * Each expression is computed into a new temporary whose number
+ * is returned. Integer arithmetic is done with unsigned integers
+ * to get the same wrap around behaviour as in the interpreter.
+ */
+
+static int expression(ir_expr *expn){
+    char *type = expn->lt == STRING ? "mpl_string" : "int";
+    int   l, r, fault, v;
+
+    switch(expn->op){
+    case IR_CONST:
+	v = temps++;
+	indent();
+	if(expn->lt == STRING){
+	    fprintf(output, "mpl_string t%d = {%d, ", v, (int)strlen(expn->s));
+	    string(expn->s);
+	    fprintf(output, "};\n");
+	} else{
+	    fprintf(output, "int t%d = ", v);
+	    integer(expn->i);
+	    fprintf(output, ";\n");
+	}
+	return v;
+    case IR_VAR:
+	v = temps++;
+	indent(); fprintf(output, "%s t%d = v%d;\n", type, v, expn->slot);
+	return v;
+    case IR_NOT:
+	if(!expn->fault){
+	    l = expression(expn->l);
+	    v = temps++;
+	    indent(); fprintf(output, "int t%d = t%d ^ 1;\n", v, l);
+	    return v;
+	}
+
+	/* The interpreter reports every unary operator whose operand failed. */
+	fault = temps++;
+	indent(); fprintf(output, "int t%d = fault;\n", fault);
+	indent(); fprintf(output, "fault = 0;\n");
+	l = expression(expn->l);
+	v = temps++;
+	indent(); fprintf(output, "int t%d = 0;\n", v);
+	indent(); fprintf(output, "if(fault)\n");
+	indent(); fprintf(output, "    mpl_error(%d, \"The argument type of unary expression must be bool\", SEMANTIC_ERROR);\n", expn->line);
+	indent(); fprintf(output, "else{\n");
+	indent(); fprintf(output, "    fault = t%d;\n", fault);
+	indent(); fprintf(output, "    t%d = t%d ^ 1;\n", v, l);
+	indent(); fprintf(output, "}\n");
+	return v;
+    }
+
+    /*
+     * Division by zero is reported only if neither of the operands
+     * failed. The fault indicator is cleared for the evaluation of
+     * the operands to find that out.
+     */
+    if(expn->op == IR_DIV && expn->fault && !expn->nonzero){
+	fault = temps++;
+	indent(); fprintf(output, "int t%d = fault;\n", fault);
+	indent(); fprintf(output, "fault = 0;\n");
+	r = expression(expn->r);
+	l = expression(expn->l);
+	v = temps++;
+	indent(); fprintf(output, "int t%d = 0;\n", v);
+	indent(); fprintf(output, "if(!fault){\n");
+	indent(); fprintf(output, "    if(t%d == 0){\n", r);
+	indent(); fprintf(output, "\tmpl_error(%d, \"Division by zero\", RUNTIME_ERROR);\n", expn->line);
+	indent(); fprintf(output, "\tfault = 1;\n");
+	indent(); fprintf(output, "    } else{\n");
+	indent(); fprintf(output, "\tfault = t%d;\n", fault);
+	indent(); fprintf(output, "\tt%d = t%d / t%d;\n", v, l, r);
+	indent(); fprintf(output, "    }\n");
+	indent(); fprintf(output, "}\n");
+	return v;
+    }
+
+    r = expression(expn->r);
+    l = expression(expn->l);
+    v = temps++;
+
+    indent();
+    if(expn->l->lt == STRING){
+	switch(expn->op){
+	case IR_ADD:  fprintf(output, "mpl_string t%d = mpl_concat(t%d, t%d);\n", v, l, r); break;
+	case IR_LESS: fprintf(output, "int t%d = mpl_less(t%d, t%d);\n", v, l, r);          break;
+	case IR_EQ:   fprintf(output, "int t%d = mpl_equal(t%d, t%d);\n", v, l, r);         break;
+	}
+	return v;
+    }
+
+    switch(expn->op){
+    case IR_ADD:  fprintf(output, "int t%d = (int)((unsigned)t%d + (unsigned)t%d);\n", v, l, r); break;
+    case IR_SUB:  fprintf(output, "int t%d = (int)((unsigned)t%d - (unsigned)t%d);\n", v, l, r); break;
+    case IR_MUL:  fprintf(output, "int t%d = (int)((unsigned)t%d * (unsigned)t%d);\n", v, l, r); break;
+    case IR_DIV:  fprintf(output, "int t%d = t%d / t%d;\n",  v, l, r);                           break;
+    case IR_AND:  fprintf(output, "int t%d = t%d & t%d;\n",  v, l, r);                           break;
+    case IR_LESS: fprintf(output, "int t%d = t%d < t%d;\n",  v, l, r);                           break;
+    case IR_EQ:   fprintf(output, "int t%d = t%d == t%d;\n", v, l, r);                           break;
+    case IR_MAX:  fprintf(output, "int t%d = mpl_max(t%d, t%d);\n",   v, l, r);                     break;
+    case IR_TRIPS:fprintf(output, "int t%d = mpl_trips(t%d, t%d);\n", v, l, r);                     break;
+    case IR_SUM:  fprintf(output, "int t%d = mpl_sum(t%d, t%d);\n",   v, l, r);                     break;
+    }
+
+    return v;
+}
+
+/*
+ * OUTPUT --------------------------------------------------------------
+ */
+
+static void indent(void){
+    for(int i = 0; i < depth; i++)
+	fputs("    ", output);
+}
+
+/* Writes s as a C string literal. */
+static void string(char *s){
+    fputc('"', output);
+
+    for(; *s != '\0'; s++){
+	if(*s == '"' || *s == '\\')
+	    fprintf(output, "\\%c", *s);
+	else if(*s == '\n')
+	    fputs("\\n", output);
+	else if((unsigned char)*s < ' ' || (unsigned char)*s >= 127 || *s == '?')
+	    fprintf(output, "\\%03o", (unsigned char)*s);
+	else
+	    fputc(*s, output);
+    }
+
+    fputc('"', output);
+}
+
+/* The most negative integer has no literal in C. */
+static void integer(int i){
+    if(i == INT_MIN)
+	fprintf(output, "(-%d - 1)", INT_MAX);
+    else if(i < 0)
+	fprintf(output, "(%d)", i);
+    else
+	fprintf(output, "%d", i);
+}
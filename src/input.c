@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+#include "output.h"
+
+/* Helper functions used only in this translation unit. */
+static void   start  (void                                         );
+static int    more   (void                                         );
+static size_t word   (void                                         );
+static size_t number (const char *p, const char *end, int *v       );
+static int    blank  (char c                                       );
+
+/*
+ * The unread input is data[pos] .. data[end -1]. If the input is
+ * mapped, size is 0 and the input has ended when it is consumed.
+ */
+static char   *data;
+static size_t  pos;
+static size_t  end;
+static size_t  size;
+static int     fd = STDIN_FILENO;
+static int     started;
+static int     ended;
+
+/* The record of batch mode the values are read from, or NULL. */
+static char  **record;
+
+int inputOptions(char *file){
+    if((fd = open(file, O_RDONLY)) < 0){
+	fd = STDIN_FILENO;
+	return 0;
+    }
+
+    return 1;
+}
+
+void inputFrom(char **cursor){
+    record = cursor;
+}
+
+int inputInt(int *v){
+    size_t n, k;
+
+    if(record != NULL)
+	return parseInt(record, v);
+
+    if((n = word()) == 0 || (k = number(data + pos, data + pos + n, v)) == 0)
+	return 0;
+
+    pos += k;
+    return 1;
+}
+
+int inputWord(char **s, size_t *n){
+    if(record != NULL)
+	return parseWord(record, s, n);
+
+    if((*n = word()) == 0)
+	return 0;
+
+    *s   = data + pos;
+    pos += *n;
+    return 1;
+}
+
+int inputLine(char **s, size_t *n){
+    size_t k;
+
+    if(!started)
+	start();
+
+    if(pos == end && !more())
+	return 0;
+
+    for(k = 0; pos + k < end || more(); k++)
+	if(data[pos + k] == '\n')
+	    break;
+
+    *s   = data + pos;
+    *n   = k;
+    pos += k + (pos + k < end);
+    return 1;
+}
+
+int parseInt(char **cursor, int *v){
+    char   *p = *cursor, *q;
+    size_t  k;
+
+    for(; blank(*p); p++)
+	;
+    for(q = p; *q != '\0' && !blank(*q); q++)
+	;
+
+    if((k = number(p, q, v)) == 0)
+	return 0;
+
+    *cursor = p + k;
+    return 1;
+}
+
+int parseWord(char **cursor, char **s, size_t *n){
+    char *p = *cursor, *q;
+
+    for(; blank(*p); p++)
+	;
+    for(q = p; *q != '\0' && !blank(*q); q++)
+	;
+
+    if(q == p)
+	return 0;
+
+    *s      = p;
+    *n      = q - p;
+    *cursor = q;
+    return 1;
+}
+
+/*
+ * A regular file is mapped from its current offset, so that the
+ * input it was redirected from may already have been partly read.
+ * If it can not be mapped, it is read like any other input.
+ */
+static void start(void){
+    struct stat st;
+    off_t       offset;
+    void       *map;
+
+    started = 1;
+
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+       (offset = lseek(fd, 0, SEEK_CUR)) >= 0 && offset < st.st_size &&
+       (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	data  = (char*)map;
+	pos   = offset;
+	end   = st.st_size;
+	ended = 1;
+	return;
+    }
+
+    size = INPUT_BLOCK_SIZE;
+    data = (char*)malloc(size);
+}
+
+/*
+ * Reads at least one more byte to the end of the unread input,
+ * which is first moved to the start of the buffer. The buffer is
+ * doubled if the unread input fills it. Returns 0 if the input has
+ * ended.
+ */
+static int more(void){
+    ssize_t n;
+
+    if(ended)
+	return 0;
+
+    if(pos > 0){
+	memmove(data, data + pos, end - pos);
+	end -= pos;
+	pos  = 0;
+    }
+
+    if(end == size){
+	size *= 2;
+	data  = (char*)realloc(data, size);
+    }
+
+    outputFlush();
+
+    while((n = read(fd, data + end, size - end)) < 0)
+	if(errno != EINTR)
+	    break;
+
+    if(n <= 0){
+	ended = 1;
+	return 0;
+    }
+
+    end += n;
+    return 1;
+}
+
+/*
+ * Skips the white space and makes sure that the whole next word
+ * is in the buffer. Returns its length, which is 0 if the input
+ * has ended.
+ */
+static size_t word(void){
+    size_t k;
+
+    if(!started)
+	start();
+
+    for(;;){
+	for(; pos < end && blank(data[pos]); pos++)
+	    ;
+	if(pos < end)
+	    break;
+	if(!more())
+	    return 0;
+    }
+
+    for(k = 0; pos + k < end || more(); k++)
+	if(blank(data[pos + k]))
+	    break;
+
+    return k;
+}
+
+/*
+ * Parses the integer at the start of p .. end -1. Returns the
+ * number of its characters, or 0 if there is no integer or if it
+ * overflows. The magnitude is checked against the largest one of
+ * the sign before every digit.
+ */
+static size_t number(const char *p, const char *end, int *v){
+    const char *q = p;
+    unsigned    limit = INT_MAX, u = 0, d;
+    int         negative = 0;
+
+    if(q < end && (*q == '-' || *q == '+'))
+	negative = *q++ == '-';
+
+    if(q == end || *q < '0' || *q > '9')
+	return 0;
+
+    limit += negative;
+
+    for(; q < end && *q >= '0' && *q <= '9'; q++){
+	d = *q - '0';
+	if(u > (limit - d) / 10)
+	    return 0;
+	u = u * 10 + d;
+    }
+
+    *v = negative ? (int)(0u - u) : (int)u;
+
+    return q - p;
+}
+
+/* The white space of scanf() in the C locale. */
+static int blank(char c){
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
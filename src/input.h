@@ -0,0 +1,62 @@
+#ifndef INPUT_HEADER
+#define INPUT_HEADER
+
+#include <stddef.h>
+
+/*
+ * This file contains the declarations of the input of the read
+ * statements. The input is split to words at the white space, as
+ * scanf() would split it. An integer is read from the start of a
+ * word, and the rest of the word is left for the next read. A word
+ * is given as a slice of the input, so it may have any length.
+ *
+ * If the input is a regular file, it is mapped to memory as a
+ * whole. Otherwise it is read in blocks of INPUT_BLOCK_SIZE bytes,
+ * and the buffer grows if a word or a line does not fit into it.
+ * The buffered output is written before the program waits for the
+ * next block.
+ *
+ * The input does not go through stdio, so nothing else may read
+ * the standard input while a program is run.
+ */
+
+#define INPUT_BLOCK_SIZE 65536
+
+/*
+ * Sets the file the input is read from instead of the standard
+ * input. Returns 0 if the file can not be opened, 1 otherwise.
+ */
+extern int inputOptions (char *file);
+
+/*
+ * Makes inputInt() and inputWord() read from the null terminated
+ * text *cursor, which is advanced past the values read, until it
+ * is called again with NULL. The batch mode reads its records so.
+ */
+extern void inputFrom   (char **cursor);
+
+/*
+ * Reads an integer in decimal with an optional sign. Returns 0 if
+ * the input has ended, if the next word does not start with an
+ * integer or if the integer does not fit in an int, 1 otherwise.
+ */
+extern int inputInt     (int *v);
+
+/*
+ * Reads the next word to the slice *s of *n characters. The slice
+ * is not null terminated, and it is valid until the next read.
+ * Returns 0 if the input has ended, 1 otherwise.
+ */
+extern int inputWord    (char **s, size_t *n);
+
+/* Reads the next line without its newline, as inputWord() does. */
+extern int inputLine    (char **s, size_t *n);
+
+/*
+ * The same as inputInt() and inputWord() but for the null terminated
+ * text *cursor, which is advanced past the value.
+ */
+extern int parseInt     (char **cursor, int *v);
+extern int parseWord    (char **cursor, char **s, size_t *n);
+
+#endif
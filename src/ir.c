@@ -0,0 +1,577 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "memory.h"
+
+/*
+ * Executes a single statement with the interpreter and returns
+ * the error messages it prints. Defined in semantics.c.
+ */
+extern char *diagnose(statement_node *stmtn, label_list *scope);
+
+/*
+ * The scope of the lowering. There is one node for every
+ * declared variable. The flag control is set while the variable
+ * is the control variable of an enclosing for statement.
+ */
+typedef struct SCOPE{
+    char         *name    ;
+    int           slot    ;
+    label_type    lt      ;
+    int           control ;
+    struct SCOPE *next    ;
+} scope;
+
+/*
+ * The following function declarations represents the non-terminals
+ * in the grammar. Statements return the lowered statement and
+ * expressions return NULL if they contain a semantic error.
+ */
+static ir_stmt *stmts              (stmts_node               *stmtsn );
+static ir_stmt *statement          (statement_node           *stmtn  );
+static ir_stmt *for_               (for_node                 *forn   , statement_node *stmtn);
+static ir_stmt *declaration        (declaration_node         *decn   , statement_node *stmtn);
+static ir_stmt *assignment         (assignment_node          *assn   , statement_node *stmtn);
+static ir_stmt *read               (read_node                *readn  , statement_node *stmtn);
+static ir_stmt *print              (print_node               *printn , statement_node *stmtn);
+static ir_stmt *assert             (assert_node              *assertn, statement_node *stmtn);
+static ir_expr *expression         (expression_node          *expn   );
+static ir_expr *unaryExpression    (unary_expression_node    *uen    );
+static ir_expr *binaryExpression   (binary_expression_node   *ben    );
+static ir_expr *operand            (operand_node             *opn    );
+
+/* Helper functions used only in this translation unit. */
+static ir_stmt    *trap          (statement_node *stmtn, int line );
+static int         divides       (statement_node *stmtn           );
+static int         dividesExpr   (expression_node *expn           );
+static int         dividesOperand(operand_node *opn               );
+static scope      *findScope     (token *id                       );
+static label_type  typeKey       (token *typeKey                  );
+static void        freeScope     (scope *s                        );
+
+/*
+ * State of the lowering. The flag unsupported is set when the
+ * program can not be lowered at all.
+ */
+static ir_program *global_ir;
+static scope      *global_scope;
+static int         loop_depth;
+static int         expression_depth;
+static int         unsupported;
+
+/*
+ * Main function of the lowering.
+ *
+ * Input parameter *pn is pointer to syntax tree. The syntax tree
+ * is not modified and it must be freed by the caller. Returns
+ * the IR of the program or NULL if the program can not be lowered.
+ */
+ir_program *lower(program_node *pn){
+    global_ir        = newIrProgram();
+    global_scope     = NULL;
+    loop_depth       = 0;
+    expression_depth = 0;
+    unsupported      = 0;
+
+    global_ir->stmts = stmts(pn->sln);
+
+    freeScope(global_scope);
+
+    if(unsupported){
+	freeIr(global_ir);
+	return NULL;
+    }
+
+    return global_ir;
+}
+
+/*
+ * Lowers the body of the for statement *forn for the tiered
+ * execution of the interpreter, see tier.c. The variables are the
+ * symbols of the list *list, and the slot of the n:th symbol is n.
+ * The control variables of the loops being executed are constant.
+ * Returns NULL if the body can not be lowered.
+ */
+ir_program *lowerLoop(for_node *forn, label_list *list){
+    scope **tail = &global_scope;
+
+    global_ir        = newIrProgram();
+    global_scope     = NULL;
+    loop_depth       = 1;
+    expression_depth = 0;
+    unsupported      = 0;
+
+    for(; list != NULL; list = list->next){
+	scope *s   = (scope*)malloc(sizeof(scope));
+	s->name    = (char*)list->l;
+	s->slot    = newSlot(global_ir, (char*)list->l, list->v.lt);
+	s->lt      = list->v.lt;
+	s->control = list->constant;
+	s->next    = NULL;
+	*tail      = s;
+	tail       = &s->next;
+    }
+
+    global_ir->stmts = stmts(forn->stmtsn);
+
+    freeScope(global_scope);
+
+    if(unsupported){
+	freeIr(global_ir);
+	return NULL;
+    }
+
+    return global_ir;
+}
+
+/*
+ * Adds a new slot to the program. Used also by the optimizer
+ * passes to allocate hidden temporaries.
+ */
+int newSlot(ir_program *ir, char *name, label_type lt){
+    ir->names = (char**)realloc(ir->names, sizeof(char*) * (ir->nslots +1));
+    ir->types = (label_type*)realloc(ir->types, sizeof(label_type) * (ir->nslots +1));
+
+    ir->names[ir->nslots] = strdup(name);
+    ir->types[ir->nslots] = lt;
+
+    return ir->nslots++;
+}
+
+/*
+ * The number of iterations of a for loop over start..end. The
+ * loop over the whole range of integers has 2^32 iterations,
+ * which is 0 modulo 2^32.
+ */
+int tripCount(int start, int end){
+    return end < start ? 0 : (int)((unsigned)end - (unsigned)start + 1);
+}
+
+/*
+ * The sum of the control variable over the iterations of a for
+ * loop, start * n + n * (n - 1) / 2. The product n * (n - 1) is
+ * below 2^64 and even, so it is halved exactly.
+ */
+int rangeSum(int start, int end){
+    unsigned long long n;
+
+    if(end < start)
+	return 0;
+
+    n = (unsigned long long)((long long)end - start) + 1;
+    return (int)(unsigned)(n * (unsigned long long)(long long)start + n * (n - 1) / 2);
+}
+
+/*
+ * The statement list is lowered iteratively to
+ * keep the stack depth constant.
+ */
+static ir_stmt *stmts(stmts_node *stmtsn){
+    ir_stmt *head = NULL, **tail = &head;
+
+    for(; stmtsn != NULL && !unsupported; stmtsn = stmtsn->stmtsn){
+	*tail = statement(stmtsn->stmtn);
+	tail  = &(*tail)->next;
+    }
+
+    return head;
+}
+
+static ir_stmt *statement(statement_node *stmtn){
+
+    if(stmtn->decn)    return declaration (stmtn->decn,    stmtn);
+    if(stmtn->assn)    return assignment  (stmtn->assn,    stmtn);
+    if(stmtn->forn)    return for_        (stmtn->forn,    stmtn);
+    if(stmtn->readn)   return read        (stmtn->readn,   stmtn);
+    if(stmtn->printn)  return print       (stmtn->printn,  stmtn);
+
+    return assert(stmtn->assertn, stmtn);
+}
+
+/*
+ * Nested for statements with the same control variable are not
+ * lowered, because the inner loop clears the constant indicator
+ * of the control variable in the interpreter.
+ */
+static ir_stmt *for_(for_node *forn, statement_node *stmtn){
+    scope *s = findScope(forn->id);
+
+    if(s == NULL || s->lt != INT)
+	return trap(stmtn, forn->id->line_number);
+
+    if(s->control){
+	unsupported = 1;
+	return trap(stmtn, forn->id->line_number);
+    }
+
+    ir_expr *start = expression(forn->expn1);
+    ir_expr *end   = expression(forn->expn2);
+
+    if(start == NULL || end == NULL || start->lt != INT || end->lt != INT){
+	freeIrExpr(start);
+	freeIrExpr(end);
+	return trap(stmtn, forn->id->line_number);
+    }
+
+    ir_stmt *r = newIrStmt(IR_FOR);
+    r->line    = forn->id->line_number;
+    r->slot    = s->slot;
+    r->lt      = INT;
+    r->expn    = start;
+    r->expn2   = end;
+
+    s->control = 1;
+    loop_depth++;
+    r->body    = stmts(forn->stmtsn);
+    loop_depth--;
+    s->control = 0;
+
+    return r;
+}
+
+/*
+ * Declarations inside for loops are not lowered. The second
+ * iteration of such loop would fail with redeclaration and a
+ * loop with no iterations would leave the variable undeclared.
+ * The arrays have no IR, so the programs that use them are left
+ * to the tree walking interpreter.
+ */
+static ir_stmt *declaration(declaration_node *decn, statement_node *stmtn){
+    label_type expected = typeKey(decn->typeKey);
+    ir_expr   *v;
+
+    if(loop_depth > 0 || decn->dimn != NULL){
+	unsupported = 1;
+	return trap(stmtn, decn->id->line_number);
+    }
+
+    if(decn->asn != NULL){
+	v = expression(decn->asn->expn);
+	if(v == NULL || v->lt != expected || findScope(decn->id) != NULL){
+	    freeIrExpr(v);
+	    return trap(stmtn, decn->id->line_number);
+	}
+    } else{
+	if(findScope(decn->id) != NULL)
+	    return trap(stmtn, decn->id->line_number);
+
+	v = newIrExpr(IR_CONST);
+	v->lt = expected;
+	if(expected == STRING)
+	    v->s = strdup("");
+    }
+
+    scope *s   = (scope*)malloc(sizeof(scope));
+    s->name    = decn->id->value;
+    s->slot    = newSlot(global_ir, decn->id->value, expected);
+    s->lt      = expected;
+    s->control = 0;
+    s->next    = global_scope;
+    global_scope = s;
+
+    ir_stmt *r = newIrStmt(IR_DECLARE);
+    r->line    = decn->id->line_number;
+    r->slot    = s->slot;
+    r->lt      = expected;
+    r->expn    = v;
+
+    return r;
+}
+
+static ir_stmt *assignment(assignment_node *assn, statement_node *stmtn){
+    scope   *s = findScope(assn->id);
+    ir_expr *v;
+
+    if(assn->indexn != NULL || (s != NULL && s->lt == ARRAY)){
+	unsupported = 1;
+	return trap(stmtn, assn->id->line_number);
+    }
+
+    if(s == NULL || s->control)
+	return trap(stmtn, assn->id->line_number);
+
+    v = expression(assn->expn);
+    if(v == NULL || v->lt != s->lt){
+	freeIrExpr(v);
+	return trap(stmtn, assn->id->line_number);
+    }
+
+    ir_stmt *r = newIrStmt(IR_ASSIGN);
+    r->line    = assn->id->line_number;
+    r->slot    = s->slot;
+    r->lt      = s->lt;
+    r->expn    = v;
+
+    return r;
+}
+
+/*
+ * Reading to a loop control variable consumes the input
+ * before the interpreter reports the error. Such programs
+ * are not lowered.
+ */
+static ir_stmt *read(read_node *readn, statement_node *stmtn){
+    scope *s = findScope(readn->id);
+
+    if(s == NULL || s->lt == BOOL && readn->indexn == NULL)
+	return trap(stmtn, readn->id->line_number);
+
+    if(s->control || s->lt == ARRAY || readn->indexn != NULL){
+	unsupported = 1;
+	return trap(stmtn, readn->id->line_number);
+    }
+
+    ir_stmt *r = newIrStmt(IR_READ);
+    r->line    = readn->id->line_number;
+    r->slot    = s->slot;
+    r->lt      = s->lt;
+
+    return r;
+}
+
+static ir_stmt *print(print_node *printn, statement_node *stmtn){
+    ir_expr *v = expression(printn->expn);
+
+    if(v == NULL || (v->lt != INT && v->lt != STRING)){
+	freeIrExpr(v);
+	return trap(stmtn, printn->print->line_number);
+    }
+
+    ir_stmt *r = newIrStmt(IR_PRINT);
+    r->line    = printn->print->line_number;
+    r->lt      = v->lt;
+    r->expn    = v;
+
+    return r;
+}
+
+static ir_stmt *assert(assert_node *assertn, statement_node *stmtn){
+    ir_expr *v = expression(assertn->expn);
+
+    if(v == NULL || v->lt != BOOL){
+	freeIrExpr(v);
+	return trap(stmtn, assertn->assert->line_number);
+    }
+
+    ir_stmt *r = newIrStmt(IR_ASSERT);
+    r->line    = assertn->assert->line_number;
+    r->lt      = BOOL;
+    r->expn    = v;
+
+    return r;
+}
+
+static ir_expr *expression(expression_node *expn){
+
+    if(expn->unaryen != NULL)
+	return unaryExpression(expn->unaryen);
+
+    return binaryExpression(expn->binaryen);
+}
+
+static ir_expr *unaryExpression(unary_expression_node *uen){
+    ir_expr *v = operand(uen->opern);
+
+    if(v == NULL || uen->unop == NULL)
+	return v;
+
+    if(v->lt != BOOL){
+	freeIrExpr(v);
+	return NULL;
+    }
+
+    ir_expr *r = newIrExpr(IR_NOT);
+    r->lt      = BOOL;
+    r->line    = uen->unop->line_number;
+    r->fault   = v->fault;
+    r->l       = v;
+
+    return r;
+}
+
+/*
+ * The operand types must be equal and suitable for the operator.
+ * Division can fail unless the divisor is a non zero constant.
+ */
+static ir_expr *binaryExpression(binary_expression_node *ben){
+    ir_expr *l = operand(ben->opern), *r, *v;
+
+    if(l == NULL || ben->osn == NULL)
+	return l;
+
+    r = operand(ben->osn->opn);
+    if(r == NULL || r->lt != l->lt){
+	freeIrExpr(l);
+	freeIrExpr(r);
+	return NULL;
+    }
+
+    switch(ben->osn->op->value[0]){
+    case '+': v = newIrExpr(IR_ADD);  v->lt = l->lt == BOOL   ? UNDEF : l->lt; break;
+    case '-': v = newIrExpr(IR_SUB);  v->lt = l->lt == INT    ? INT   : UNDEF; break;
+    case '*': v = newIrExpr(IR_MUL);  v->lt = l->lt == INT    ? INT   : UNDEF; break;
+    case '/': v = newIrExpr(IR_DIV);  v->lt = l->lt == INT    ? INT   : UNDEF; break;
+    case '&': v = newIrExpr(IR_AND);  v->lt = l->lt == BOOL   ? BOOL  : UNDEF; break;
+    case '<': v = newIrExpr(IR_LESS); v->lt = BOOL;                            break;
+    default : v = newIrExpr(IR_EQ);   v->lt = BOOL;                            break;
+    }
+
+    v->line  = ben->osn->op->line_number;
+    v->l     = l;
+    v->r     = r;
+    v->fault = l->fault || r->fault ||
+	(v->op == IR_DIV && (r->op != IR_CONST || r->i == 0 || r->i == -1));
+
+    if(v->lt == UNDEF){
+	freeIrExpr(v);
+	return NULL;
+    }
+
+    return v;
+}
+
+static ir_expr *operand(operand_node *opn){
+    ir_expr *v;
+
+    if(opn->intLit != NULL){
+	v = newIrExpr(IR_CONST);
+	v->lt = INT;
+	sscanf(opn->intLit->value, "%d", &v->i);
+    } else if(opn->strLit != NULL){
+	v = newIrExpr(IR_CONST);
+	v->lt = STRING;
+	v->s  = strdup(opn->strLit->value);
+    } else if(opn->indexn != NULL || opn->lengthn != NULL){
+	unsupported = 1;
+	v = NULL;
+    } else if(opn->id != NULL){
+	scope *s = findScope(opn->id);
+	if(s == NULL)
+	    return NULL;
+	if(s->lt == ARRAY){
+	    unsupported = 1;
+	    return NULL;
+	}
+	v = newIrExpr(IR_VAR);
+	v->lt   = s->lt;
+	v->slot = s->slot;
+    } else{
+	if(++expression_depth > IR_MAX_DEPTH){
+	    unsupported = 1;
+	    v = NULL;
+	} else
+	    v = expression(opn->expren->expn);
+	expression_depth--;
+    }
+
+    return v;
+}
+
+/*
+ * Creates a statement that always fails. The error messages are
+ * produced by executing the statement with the interpreter against
+ * a symbol list that has the variables of the current scope.
+ *
+ * The messages of a failing statement with a division depend on
+ * the values of the operands, so such programs are not lowered.
+ * If the interpreter does not find an error, the static checks of
+ * the lowering disagree with the interpreter and the program is
+ * not lowered either.
+ */
+static ir_stmt *trap(statement_node *stmtn, int line){
+    label_list *list = NULL;
+    value       v;
+
+    if(unsupported || divides(stmtn)){
+	unsupported = 1;
+	return newIrStmt(IR_TRAP);
+    }
+
+    for(scope *s = global_scope; s != NULL; s = s->next){
+	memset(&v, 0, sizeof(value));
+	v.lt = s->lt;
+	if(s->lt == STRING)
+	    v.s = constantString("");
+	list = newLabelListNode(&list, (label*)s->name, v);
+	list->constant = s->control;
+    }
+
+    ir_stmt *r = newIrStmt(IR_TRAP);
+    r->line    = line;
+    r->msg     = diagnose(stmtn, list);
+
+    if(r->msg == NULL)
+	unsupported = 1;
+
+    return r;
+}
+
+/*
+ * Returns 1 if an expression of the statement has a division,
+ * wherever the lowering stopped, 0 otherwise. The body of a
+ * for statement is not run when the statement fails.
+ */
+static int divides(statement_node *stmtn){
+    if(stmtn->decn)
+	return stmtn->decn->asn != NULL && dividesExpr(stmtn->decn->asn->expn);
+    if(stmtn->assn)
+	return dividesExpr(stmtn->assn->expn);
+    if(stmtn->forn)
+	return dividesExpr(stmtn->forn->expn1) || dividesExpr(stmtn->forn->expn2);
+    if(stmtn->printn)
+	return dividesExpr(stmtn->printn->expn);
+    if(stmtn->assertn)
+	return dividesExpr(stmtn->assertn->expn);
+
+    return 0;
+}
+
+static int dividesExpr(expression_node *expn){
+    binary_expression_node *ben = expn->binaryen;
+
+    if(expn->unaryen != NULL)
+	return dividesOperand(expn->unaryen->opern);
+
+    return dividesOperand(ben->opern) ||
+	(ben->osn != NULL && (ben->osn->op->value[0] == '/' || dividesOperand(ben->osn->opn)));
+}
+
+static int dividesOperand(operand_node *opn){
+    return opn->expren != NULL && dividesExpr(opn->expren->expn);
+}
+
+/*
+ * Returns the scope node of the variable in token *id
+ * or NULL if the variable is not declared.
+ */
+static scope *findScope(token *id){
+    for(scope *s = global_scope; s != NULL; s = s->next)
+	if(strncmp(s->name, id->value, TOKEN_MAX_LENGTH +1) == 0)
+	    return s;
+
+    return NULL;
+}
+
+static label_type typeKey(token *typeKey){
+    if(strncmp(typeKey->value, "int",    TOKEN_MAX_LENGTH) == 0)
+	return INT;
+    if(strncmp(typeKey->value, "string", TOKEN_MAX_LENGTH) == 0)
+	return STRING;
+
+    return BOOL;
+}
+
+static void freeScope(scope *s){
+    scope *tmp;
+
+    while(s != NULL){
+	tmp = s->next;
+	free(s);
+	s = tmp;
+    }
+}
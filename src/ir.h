@@ -0,0 +1,129 @@
+#ifndef IR_HEADER
+#define IR_HEADER
+
+#include "tree.h"
+#include "label.h"
+
+/*
+ * This file contains the definitions of the intermediate
+ * representation (IR) used by the execution engines other
+ * than the tree walking interpreter in semantics.c.
+ *
+ * The IR is produced from the syntax tree by lower(). Unlike
+ * the syntax tree, every variable reference is resolved to a
+ * slot number and every expression has a static type. The
+ * lowering also does the semantic checks statically. Statements
+ * that would fail a semantic check whenever they are executed
+ * are lowered to IR_TRAP statements that carry the exact error
+ * messages the interpreter would print.
+ */
+
+/*
+ * Expressions deeper than this are not lowered. Such
+ * programs are left to the tree walking interpreter.
+ */
+#define IR_MAX_DEPTH 1000
+
+typedef enum IR_OP {
+    IR_CONST,   // Integer, boolean or string literal.
+    IR_VAR,     // Value of a variable slot.
+    IR_NOT,     // Unary !
+    IR_ADD,     // Integer addition or string concatenation.
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_AND,
+    IR_LESS,
+    IR_EQ,
+    IR_MAX,     // Larger of the integers. Made by the optimizer only.
+    IR_TRIPS,   // Number of integers in the range l..r, see tripCount().
+    IR_SUM      // Sum of the integers in the range l..r, see rangeSum().
+} ir_op;
+
+typedef enum IR_KIND {
+    IR_DECLARE, // Initialization of a declared variable.
+    IR_ASSIGN,
+    IR_FOR,
+    IR_READ,
+    IR_PRINT,
+    IR_ASSERT,
+    IR_TRAP     // Statement which always fails with message msg.
+} ir_kind;
+
+typedef struct IR_EXPR ir_expr;
+typedef struct IR_STMT ir_stmt;
+
+/*
+ * Binary operators have both operands l and r. The right
+ * operand is always evaluated before the left one, as in
+ * the interpreter. The flag fault is set if the evaluation
+ * of the expression can fail at runtime: a division by zero,
+ * or by -1, which traps if the dividend is INT_MIN. The flag
+ * nonzero of IR_DIV is set by the optimizer if the divisor can
+ * not fail and is proven never to be zero or -1, so the engines
+ * divide without checking it.
+ */
+struct IR_EXPR{
+    ir_op         op       ;
+    label_type    lt       ;
+    int           line     ;   // Line of the operator, for error messages.
+    int           fault    ;
+    int           nonzero  ;
+    int           i        ;   // Value of an integer or boolean constant.
+    char         *s        ;   // Value of a string constant.
+    int           slot     ;   // Variable slot of IR_VAR.
+    ir_expr      *l        ;
+    ir_expr      *r        ;
+};
+
+/*
+ * For IR_FOR the control variable is slot, the range is
+ * from expn to expn2 and the statements are in body.
+ */
+struct IR_STMT{
+    ir_kind       kind     ;
+    int           line     ;   // Line used in error messages.
+    int           slot     ;   // Target variable.
+    label_type    lt       ;   // Type of the target variable.
+    ir_expr      *expn     ;
+    ir_expr      *expn2    ;
+    ir_stmt      *body     ;
+    char         *msg      ;   // Error messages of IR_TRAP.
+    ir_stmt      *next     ;
+};
+
+/*
+ * The whole program. Slots are numbered from 0 to nslots -1
+ * and each of them has a name and a type.
+ */
+typedef struct IR_PROGRAM{
+    ir_stmt      *stmts    ;
+    int           nslots   ;
+    char        **names    ;
+    label_type   *types    ;
+} ir_program;
+
+/*
+ * Interface of the lowering. Returns NULL if the program uses
+ * constructs whose behaviour depends on the execution order
+ * of declarations, e.g. declarations inside for loops.
+ */
+extern ir_program *lower    (program_node *pn);
+
+/*
+ * Lowers the body of a for loop against the symbols of the
+ * interpreter. Returns NULL if the body can not be lowered.
+ */
+extern ir_program *lowerLoop (for_node *forn, label_list *list);
+
+/* Adds a new slot to the program and returns its number. */
+extern int         newSlot  (ir_program *ir, char *name, label_type lt);
+
+/*
+ * The values of IR_TRIPS and IR_SUM. Like all integer arithmetic,
+ * they wrap around modulo 2^32.
+ */
+extern int         tripCount (int start, int end);
+extern int         rangeSum  (int start, int end);
+
+#endif
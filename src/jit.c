@@ -0,0 +1,597 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "label.h"
+#include "ir.h"
+#include "closure.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+/*
+ * Numbers of the x86-64 general purpose registers.
+ */
+enum registers {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15};
+
+/*
+ * The registers the variables are allocated to, in the order of
+ * preference. RAX, RCX and RDX are used for evaluating expressions
+ * and RDI holds the address of the variable slots. No functions are
+ * called from the native code, so the caller saved registers can be
+ * used as well.
+ */
+static const int variable_registers[] = {RBX, R12, R13, R14, R15, RBP,
+					 RSI, R8, R9, R10, R11};
+#define VARIABLE_REGISTERS 11
+
+/* The callee saved registers that are pushed in the prologue. */
+static const int saved_registers[] = {RBX, RBP, R12, R13, R14, R15};
+#define SAVED_REGISTERS 6
+
+/*
+ * Jump targets are labels. The position of a label is known
+ * when it is placed, and the jumps to it are patched at the end.
+ */
+typedef struct FIXUP{
+    size_t  position;
+    int     label;
+} fixup;
+
+typedef struct ASSEMBLER{
+    unsigned char *code      ;
+    size_t         size      ;
+    size_t         capacity  ;
+    size_t        *labels    ;
+    int            nlabels   ;
+    fixup         *fixups    ;
+    int            nfixups   ;
+    int           *faults    ;   // Label of each fault exit, by statement index.
+    int            nfaults   ;
+    int           *regs      ;   // Register of each slot, or -1.
+    int           *uses      ;   // Weighted number of uses of each slot.
+    int            nslots    ;
+    int            index     ;   // Index of the next statement.
+    int            current   ;   // Index of the statement being compiled.
+    int            depth     ;   // Nesting depth of loops.
+    int            max_depth ;
+} assembler;
+
+static native_loop *loops;
+
+/* Helper functions used only in this translation unit. */
+static int   eligibleStmt    (ir_stmt *stmt, int depth, int *max_depth);
+static int   eligibleStmts   (ir_stmt *stmt, int depth, int *max_depth);
+static int   eligibleExpr    (ir_expr *expn);
+static void  countStmt       (assembler *a, ir_stmt *stmt, int weight);
+static void  countExpr       (assembler *a, ir_expr *expn, int weight);
+static void  allocate        (assembler *a);
+static void  statements      (assembler *a, ir_stmt *stmt);
+static void  statement       (assembler *a, ir_stmt *stmt);
+static void  loop            (assembler *a, ir_stmt *stmt);
+static void  expression      (assembler *a, ir_expr *expn);
+static void  range           (assembler *a, int op);
+
+/*
+ * Instruction encoding.
+ */
+
+static void byte(assembler *a, int b){
+    if(a->size == a->capacity){
+	a->capacity = a->capacity ? a->capacity * 2 : 256;
+	a->code     = (unsigned char*)realloc(a->code, a->capacity);
+    }
+    a->code[a->size++] = (unsigned char)b;
+}
+
+static void dword(assembler *a, int d){
+    for(int i = 0; i < 4; i++)
+	byte(a, (d >> (8 * i)) & 0xff);
+}
+
+static void rex(assembler *a, int w, int reg, int rm){
+    if(w || reg >= R8 || rm >= R8)
+	byte(a, 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+static void modrm(assembler *a, int mod, int reg, int rm){
+    byte(a, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Instruction of form op r/m32, r32 between two registers. */
+static void registers(assembler *a, int opcode, int dst, int src){
+    rex(a, 0, src, dst);
+    byte(a, opcode);
+    modrm(a, 3, src, dst);
+}
+
+/* Instruction of form op r32, [base + disp32]. */
+static void memory(assembler *a, int opcode, int reg, int base, int disp){
+    rex(a, 0, reg, base);
+    byte(a, opcode);
+    modrm(a, 2, reg, base);
+    if((base & 7) == RSP)
+	byte(a, 0x24);
+    dword(a, disp);
+}
+
+static void movImmediate(assembler *a, int reg, int imm){
+    rex(a, 0, 0, reg);
+    byte(a, 0xb8 + (reg & 7));
+    dword(a, imm);
+}
+
+static void push(assembler *a, int reg){
+    rex(a, 0, 0, reg);
+    byte(a, 0x50 + (reg & 7));
+}
+
+static void pop(assembler *a, int reg){
+    rex(a, 0, 0, reg);
+    byte(a, 0x58 + (reg & 7));
+}
+
+static int newLabel(assembler *a){
+    a->labels = (size_t*)realloc(a->labels, sizeof(size_t) * (a->nlabels +1));
+    a->labels[a->nlabels] = 0;
+    return a->nlabels++;
+}
+
+static void placeLabel(assembler *a, int label){
+    a->labels[label] = a->size;
+}
+
+/* Jump with a 32 bit displacement. Opcode 0 is jmp, others are jcc. */
+static void jump(assembler *a, int opcode, int label){
+    if(opcode == 0)
+	byte(a, 0xe9);
+    else{
+	byte(a, 0x0f);
+	byte(a, opcode);
+    }
+
+    a->fixups = (fixup*)realloc(a->fixups, sizeof(fixup) * (a->nfixups +1));
+    a->fixups[a->nfixups].position = a->size;
+    a->fixups[a->nfixups].label    = label;
+    a->nfixups++;
+
+    dword(a, 0);
+}
+
+#define JMP 0x00
+#define JE  0x84
+#define JNE 0x85
+#define JG  0x8f
+
+/* Label of the exit taken when the current statement fails. */
+static int faultLabel(assembler *a){
+    return a->faults[a->current];
+}
+
+/*
+ * Loads the variable in slot to the register reg.
+ */
+static void load(assembler *a, int reg, int slot){
+    if(a->regs[slot] >= 0)
+	registers(a, 0x89, reg, a->regs[slot]);
+    else
+	memory(a, 0x8b, reg, RDI, slot * (int)sizeof(cell));
+}
+
+static void store(assembler *a, int slot, int reg){
+    if(a->regs[slot] >= 0)
+	registers(a, 0x89, a->regs[slot], reg);
+    else
+	memory(a, 0x89, reg, RDI, slot * (int)sizeof(cell));
+}
+
+/*
+ * Main function of the JIT compiler.
+ */
+native_loop *jitCompile(ir_stmt *forstmt){
+    assembler a;
+    int       max_depth = 0, leave, i;
+
+    if(forstmt->kind != IR_FOR || !eligibleStmt(forstmt, 1, &max_depth))
+	return NULL;
+
+    memset(&a, 0, sizeof(assembler));
+    a.max_depth = max_depth;
+
+    /* Find out the slots used in the loop and allocate registers. */
+    countStmt(&a, forstmt, 1);
+    allocate(&a);
+
+    for(i = 0; i < a.nfaults; i++)
+	a.faults[i] = newLabel(&a);
+    leave = newLabel(&a);
+
+    /* Prologue. */
+    for(i = 0; i < SAVED_REGISTERS; i++)
+	push(&a, saved_registers[i]);
+    byte(&a, 0x48); byte(&a, 0x81); byte(&a, 0xec);         // sub rsp, imm32
+    dword(&a, 8 * a.max_depth);
+
+    for(i = 0; i < a.nslots; i++)
+	if(a.regs[i] >= 0)
+	    memory(&a, 0x8b, a.regs[i], RDI, i * (int)sizeof(cell));
+
+    statement(&a, forstmt);
+
+    /* Epilogue. The variables are written back in every case. */
+    movImmediate(&a, RAX, -1);
+    placeLabel(&a, leave);
+
+    for(i = 0; i < a.nslots; i++)
+	if(a.regs[i] >= 0)
+	    memory(&a, 0x89, a.regs[i], RDI, i * (int)sizeof(cell));
+
+    byte(&a, 0x48); byte(&a, 0x81); byte(&a, 0xc4);         // add rsp, imm32
+    dword(&a, 8 * a.max_depth);
+    for(i = SAVED_REGISTERS -1; i >= 0; i--)
+	pop(&a, saved_registers[i]);
+    byte(&a, 0xc3);                                          // ret
+
+    /* Fault exits return the index of the failing statement. */
+    for(i = 0; i < a.nfaults; i++){
+	placeLabel(&a, a.faults[i]);
+	movImmediate(&a, RAX, i);
+	jump(&a, JMP, leave);
+    }
+
+    for(i = 0; i < a.nfixups; i++){
+	int target = (int)a.labels[a.fixups[i].label] - (int)(a.fixups[i].position + 4);
+	memcpy(a.code + a.fixups[i].position, &target, 4);
+    }
+
+    native_loop *nl = (native_loop*)malloc(sizeof(native_loop));
+    void        *code;
+
+    nl->size = a.size;
+    code = mmap(NULL, nl->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(code == MAP_FAILED){
+	free(nl);
+	nl = NULL;
+    } else{
+	memcpy(code, a.code, a.size);
+	mprotect(code, nl->size, PROT_READ | PROT_EXEC);
+
+	nl->code   = (int (*)(cell*))code;
+	nl->slots  = (int*)malloc(sizeof(int) * (a.nslots +1));
+	nl->nslots = 0;
+	for(i = 0; i < a.nslots; i++)
+	    if(a.uses[i] > 0)
+		nl->slots[nl->nslots++] = i;
+
+	nl->next = loops;
+	loops    = nl;
+    }
+
+    free(a.code);
+    free(a.labels);
+    free(a.fixups);
+    free(a.faults);
+    free(a.regs);
+    free(a.uses);
+
+    return nl;
+}
+
+void jitRelease(void){
+    native_loop *tmp;
+
+    while(loops != NULL){
+	tmp = loops->next;
+	munmap((void*)loops->code, loops->size);
+	free(loops->slots);
+	free(loops);
+	loops = tmp;
+    }
+}
+
+/*
+ * ELIGIBILITY ---------------------------------------------------------
+ *
+ * Only integer and boolean assignments, asserts and for loops
+ * are compiled. Strings, read and print are left to the closures.
+ */
+
+static int eligibleStmt(ir_stmt *stmt, int depth, int *max_depth){
+
+    switch(stmt->kind){
+    case IR_ASSIGN:
+	return stmt->lt != STRING && eligibleExpr(stmt->expn);
+    case IR_ASSERT:
+	return eligibleExpr(stmt->expn);
+    case IR_FOR:
+	if(depth > *max_depth)
+	    *max_depth = depth;
+	return eligibleExpr(stmt->expn) && eligibleExpr(stmt->expn2)
+	    && eligibleStmts(stmt->body, depth +1, max_depth);
+    }
+
+    return 0;
+}
+
+static int eligibleStmts(ir_stmt *stmt, int depth, int *max_depth){
+    for(; stmt != NULL; stmt = stmt->next)
+	if(!eligibleStmt(stmt, depth, max_depth))
+	    return 0;
+
+    return 1;
+}
+
+static int eligibleExpr(ir_expr *expn){
+    if(expn == NULL)
+	return 1;
+
+    if(expn->lt == STRING)
+	return 0;
+
+    if(expn->op == IR_LESS || expn->op == IR_EQ)
+	if(expn->l->lt == STRING)
+	    return 0;
+
+    return eligibleExpr(expn->l) && eligibleExpr(expn->r);
+}
+
+/*
+ * REGISTER ALLOCATION -------------------------------------------------
+ *
+ * The uses of the variables are weighted by the loop depth, and
+ * the most used variables are kept in registers.
+ */
+
+static void use(assembler *a, int slot, int weight){
+    if(slot >= a->nslots){
+	a->uses = (int*)realloc(a->uses, sizeof(int) * (slot +1));
+	a->regs = (int*)realloc(a->regs, sizeof(int) * (slot +1));
+	for(int i = a->nslots; i <= slot; i++){
+	    a->uses[i] = 0;
+	    a->regs[i] = -1;
+	}
+	a->nslots = slot +1;
+    }
+    a->uses[slot] += weight;
+}
+
+/* Every statement gets a fault exit, in the order they are compiled. */
+static void countStmt(assembler *a, ir_stmt *stmt, int weight){
+    int inner = weight < 1000000 ? weight * 10 : weight;
+
+    a->faults = (int*)realloc(a->faults, sizeof(int) * (a->nfaults +1));
+    a->nfaults++;
+
+    countExpr(a, stmt->expn,  weight);
+    countExpr(a, stmt->expn2, weight);
+
+    if(stmt->kind == IR_ASSIGN)
+	use(a, stmt->slot, weight);
+    else if(stmt->kind == IR_FOR){
+	use(a, stmt->slot, inner);
+	for(ir_stmt *s = stmt->body; s != NULL; s = s->next)
+	    countStmt(a, s, inner);
+    }
+}
+
+static void countExpr(assembler *a, ir_expr *expn, int weight){
+    if(expn == NULL)
+	return;
+
+    if(expn->op == IR_VAR)
+	use(a, expn->slot, weight);
+
+    countExpr(a, expn->l, weight);
+    countExpr(a, expn->r, weight);
+}
+
+static void allocate(assembler *a){
+    for(int r = 0; r < VARIABLE_REGISTERS; r++){
+	int best = -1;
+
+	for(int i = 0; i < a->nslots; i++)
+	    if(a->regs[i] < 0 && a->uses[i] > 0 && (best < 0 || a->uses[i] > a->uses[best]))
+		best = i;
+
+	if(best < 0)
+	    break;
+	a->regs[best] = variable_registers[r];
+    }
+}
+
+/*
+ * CODE GENERATION -----------------------------------------------------
+ */
+
+static void statements(assembler *a, ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	statement(a, stmt);
+}
+
+static void statement(assembler *a, ir_stmt *stmt){
+    a->current = a->index++;
+
+    switch(stmt->kind){
+    case IR_ASSIGN:
+	expression(a, stmt->expn);
+	store(a, stmt->slot, RAX);
+	break;
+    case IR_ASSERT:
+	expression(a, stmt->expn);
+	byte(a, 0x83); byte(a, 0xf8); byte(a, 0x01);         // cmp eax, 1
+	jump(a, JNE, faultLabel(a));
+	break;
+    case IR_FOR:
+	loop(a, stmt);
+	break;
+    }
+}
+
+/*
+ * The end of the range is kept in the stack frame and the
+ * control variable is used as the counter. The body can not
+ * modify the control variable.
+ */
+static void loop(assembler *a, ir_stmt *stmt){
+    int end  = 8 * a->depth++;
+    int top  = newLabel(a);
+    int done = newLabel(a);
+
+    expression(a, stmt->expn2);
+    memory(a, 0x89, RAX, RSP, end);
+    expression(a, stmt->expn);
+    store(a, stmt->slot, RAX);
+
+    placeLabel(a, top);
+    load(a, RAX, stmt->slot);
+    memory(a, 0x3b, RAX, RSP, end);                          // cmp eax, [rsp + end]
+    jump(a, JG, done);
+
+    statements(a, stmt->body);
+
+    if(a->regs[stmt->slot] >= 0){
+	rex(a, 0, 0, a->regs[stmt->slot]);                   // add reg, 1
+	byte(a, 0x83);
+	modrm(a, 3, 0, a->regs[stmt->slot]);
+	byte(a, 0x01);
+    } else{
+	byte(a, 0x83);                                       // add [rdi + disp], 1
+	modrm(a, 2, 0, RDI);
+	dword(a, stmt->slot * (int)sizeof(cell));
+	byte(a, 0x01);
+    }
+    jump(a, JMP, top);
+
+    placeLabel(a, done);
+    a->depth--;
+}
+
+static int simple(ir_expr *expn){
+    return expn->op == IR_CONST || expn->op == IR_VAR;
+}
+
+/* Loads a constant or a variable to the register reg. */
+static void operand(assembler *a, int reg, ir_expr *expn){
+    if(expn->op == IR_CONST)
+	movImmediate(a, reg, expn->i);
+    else
+	load(a, reg, expn->slot);
+}
+
+/*
+ * The value of the expression is left in eax. The left operand
+ * of a binary operator is in eax and the right one in ecx.
+ */
+static void expression(assembler *a, ir_expr *expn){
+
+    switch(expn->op){
+    case IR_CONST:
+    case IR_VAR:
+	operand(a, RAX, expn);
+	return;
+    case IR_NOT:
+	expression(a, expn->l);
+	byte(a, 0x83); byte(a, 0xf0); byte(a, 0x01);         // xor eax, 1
+	return;
+    }
+
+    if(simple(expn->r)){
+	expression(a, expn->l);
+	operand(a, RCX, expn->r);
+    } else if(simple(expn->l)){
+	expression(a, expn->r);
+	registers(a, 0x89, RCX, RAX);
+	operand(a, RAX, expn->l);
+    } else{
+	expression(a, expn->r);
+	push(a, RAX);
+	expression(a, expn->l);
+	pop(a, RCX);
+    }
+
+    switch(expn->op){
+    case IR_ADD:
+	registers(a, 0x01, RAX, RCX);
+	break;
+    case IR_SUB:
+	registers(a, 0x29, RAX, RCX);
+	break;
+    case IR_MUL:
+	byte(a, 0x0f); byte(a, 0xaf); byte(a, 0xc1);         // imul eax, ecx
+	break;
+    case IR_AND:
+	registers(a, 0x21, RAX, RCX);
+	break;
+    case IR_DIV:
+	if(!expn->nonzero && (expn->r->op != IR_CONST || expn->r->i == 0)){
+	    byte(a, 0x85); byte(a, 0xc9);                    // test ecx, ecx
+	    jump(a, JE, faultLabel(a));
+	}
+	byte(a, 0x99);                                       // cdq
+	byte(a, 0xf7); byte(a, 0xf9);                        // idiv ecx
+	break;
+    case IR_LESS:
+    case IR_EQ:
+	registers(a, 0x39, RAX, RCX);                        // cmp eax, ecx
+	byte(a, 0x0f); byte(a, expn->op == IR_LESS ? 0x9c : 0x94); byte(a, 0xc0);
+	byte(a, 0x0f); byte(a, 0xb6); byte(a, 0xc0);         // movzx eax, al
+	break;
+    case IR_MAX:
+	registers(a, 0x39, RAX, RCX);                        // cmp eax, ecx
+	byte(a, 0x0f); byte(a, 0x4c); byte(a, 0xc1);         // cmovl eax, ecx
+	break;
+    case IR_TRIPS:
+    case IR_SUM:
+	range(a, expn->op);
+	break;
+    }
+}
+
+/*
+ * The trip count and the sum of the range eax..ecx. The sum is
+ * computed with 64 bit arithmetic as described at rangeSum().
+ */
+static void range(assembler *a, int op){
+    int empty = newLabel(a), done = newLabel(a);
+
+    registers(a, 0x39, RAX, RCX);                            // cmp eax, ecx
+    jump(a, JG, empty);
+
+    if(op == IR_TRIPS){
+	registers(a, 0x29, RCX, RAX);                        // sub ecx, eax
+	byte(a, 0x8d); byte(a, 0x41); byte(a, 0x01);         // lea eax, [rcx + 1]
+    } else{
+	byte(a, 0x48); byte(a, 0x63); byte(a, 0xd0);         // movsxd rdx, eax
+	byte(a, 0x48); byte(a, 0x63); byte(a, 0xc9);         // movsxd rcx, ecx
+	byte(a, 0x48); byte(a, 0x29); byte(a, 0xd1);         // sub rcx, rdx
+	byte(a, 0x48); byte(a, 0x8d); byte(a, 0x41); byte(a, 0x01); // lea rax, [rcx + 1]
+	byte(a, 0x48); byte(a, 0x0f); byte(a, 0xaf); byte(a, 0xc1); // imul rax, rcx
+	byte(a, 0x48); byte(a, 0xd1); byte(a, 0xe8);         // shr rax, 1
+	byte(a, 0x48); byte(a, 0x83); byte(a, 0xc1); byte(a, 0x01); // add rcx, 1
+	byte(a, 0x48); byte(a, 0x0f); byte(a, 0xaf); byte(a, 0xca); // imul rcx, rdx
+	byte(a, 0x48); byte(a, 0x01); byte(a, 0xc8);         // add rax, rcx
+    }
+    jump(a, JMP, done);
+
+    placeLabel(a, empty);
+    registers(a, 0x31, RAX, RAX);                            // xor eax, eax
+    placeLabel(a, done);
+}
+
+#else
+
+/*
+ * The JIT is only supported on x86-64 Linux. On other
+ * platforms all loops are executed by the closures.
+ */
+native_loop *jitCompile(ir_stmt *forstmt){
+    return NULL;
+}
+
+void jitRelease(void){
+}
+
+#endif
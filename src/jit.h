@@ -0,0 +1,45 @@
+#ifndef JIT_HEADER
+#define JIT_HEADER
+
+#include <stddef.h>
+
+#include "ir.h"
+#include "closure.h"
+
+/*
+ * This file contains the declarations of the x86-64 JIT
+ * compiler for for loops. Loops whose bodies contain only
+ * integer and boolean assignments, asserts and other such
+ * loops are compiled to native code, with the variables of
+ * the loop kept in registers.
+ */
+
+/*
+ * A compiled loop. The function code takes the variable slots
+ * of the program and returns -1 if the loop was executed
+ * successfully. If a runtime error was found, the variables are
+ * written back to the slots and the index of the failing
+ * statement is returned. The statements are numbered in pre-order
+ * starting from the loop itself, so that the closures of the loop
+ * can execute the failing statement again to report the error.
+ *
+ * The slots the loop reads or writes are listed in slots.
+ */
+typedef struct NATIVE_LOOP{
+    int                (*code)(cell *env);
+    size_t               size   ;
+    int                 *slots  ;
+    int                  nslots ;
+    struct NATIVE_LOOP  *next   ;
+} native_loop;
+
+/*
+ * Compiles the for statement *forstmt. Returns NULL if the loop
+ * can not be compiled or the JIT is not supported on this platform.
+ */
+extern native_loop *jitCompile (ir_stmt *forstmt);
+
+/* Frees all the compiled loops. */
+extern void         jitRelease (void);
+
+#endif
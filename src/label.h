@@ -9,21 +9,75 @@
  */
 
 typedef char label[TOKEN_MAX_LENGTH +1];
-typedef enum LABEL_TYPE {UNDEF = 0, INT, STRING, BOOL} label_type;
+typedef enum LABEL_TYPE {UNDEF = 0, INT, STRING, BOOL, ARRAY} label_type;
 
+/*
+ * Strings are reference counted. The characters are stored inline
+ * after the header, in the same allocation, and are null terminated.
+ * A string is immutable while it has more than one reference; the
+ * only owner may append to it in place, and capacity tells how many
+ * characters fit in the allocation.
+ *
+ * The literals and the strings that are read are interned: they
+ * are kept in a hash table with their hash, and are never changed.
+ * The interned literals are shared by all the literals with the
+ * same characters and their reference count is STRING_CONSTANT.
+ *
+ * The temporary strings of a statement are allocated from a scratch
+ * arena and their reference count is STRING_SCRATCH. They are valid
+ * until the end of the statement, and a scratch string that is
+ * stored in a variable is first promoted to the heap.
+ */
+#define STRING_CONSTANT -1
+#define STRING_SCRATCH  -2
+
+typedef struct STR{
+    int           refs;
+    int           length;
+    int           capacity;
+    unsigned      hash;       // Hash of an interned string.
+    int           interned;
+    struct STR   *next;       // Next string in the same bucket.
+    char          chars[];
+} str;
+
+/*
+ * Arrays have integer elements. The elements are contiguous and
+ * start at a cache line boundary. An array is owned by its
+ * variable: it is allocated by the declaration and freed with the
+ * symbol, and the values of the expressions only borrow it. The
+ * length is fixed, so assigning an array copies the elements.
+ */
+#define ARRAY_ALIGNMENT 64
+
+typedef struct ARRAY{
+    int           length;
+    int          *elements;
+} array;
+
+/*
+ * A value is a type tag and the payload of that type. The
+ * interpreter reports whether an expression produced a value
+ * at all in the return value of the evaluation, not here.
+ */
 typedef struct VALUE{
-    int            i;
-    int            b;
-    char          *s;
-    int        empty;
-    int        error;
-    int     constant;
     label_type    lt;
+    union{
+	int       i;    // INT
+	int       b;    // BOOL
+	str      *s;    // STRING
+	array    *a;    // ARRAY
+    };
 } value;
 
+/*
+ * The constant indicator is set while the symbol
+ * is the control variable of a for statement.
+ */
 typedef struct LABEL_LIST{
     label *l;
     value  v;
+    int    constant;
     struct LABEL_LIST *next;
 
 }label_list;
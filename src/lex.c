@@ -19,7 +19,7 @@ static token_list *handleCol               (token_list *tl, char *buffer, FILE *
 static token_list *handleIntLiterals       (token_list *tl, char *buffer, FILE *input);
 static token_list *handleStringLiterals    (token_list *tl, char *buffer, FILE *input);
 static token_list *handlePeriod            (token_list *tl, char *buffer, FILE *input);
-static int         isLastTokenControlError (token_list *list                         );
+static int         isLastTokenControlError (token_list *last                         );
 
 /* Functions used to separate keywords from identifiers. */
 static int        isTypeKey      (char *word);
@@ -34,6 +34,9 @@ static int        isAssertKey    (char *word);
 
 static int        equals         (char *a, char *b);
 
+static int        readInput      (char *c);
+static int        getInput       (void);
+
 static void       addEOF         (token_list *tl);
 
 
@@ -43,6 +46,16 @@ static void       addEOF         (token_list *tl);
  */
 static int        line_number;
 
+/*
+ * The input is read to memory before it is scanned, because the
+ * scanner steps back in the input after most of the tokens and
+ * seeking a stream is slow. The position may be moved past the
+ * end of the input, as with fseek().
+ */
+static char      *text;
+static long       text_length;
+static long       text_position;
+
 
 /*
  * This is the main function of lexical analyzer. it is called
@@ -54,7 +67,7 @@ static int        line_number;
  *
  * Return value is type of token_list *. It contains all text
  * from the file (excluding comments) divided into tokens of
- * 21 type defined in tokens.h. If there is text sequence that
+ * 24 types defined in tokens.h. If there is text sequence that
  * does not match with any valid token type, the token is
  * returned with type TOKEN_ERROR.
  */
@@ -63,6 +76,14 @@ token_list *lex(FILE *input){
     char c, buffer[TOKEN_MAX_LENGTH +1];           // Input handling and buffering.
     line_number = 1;                               // Initialize line counter.
 
+    size_t n, size = 65536;
+    text          = (char*)malloc(size);
+    text_length   = 0;
+    text_position = 0;
+    while((n = fread(text + text_length, sizeof(char), size - text_length, input)) > 0)
+	if((text_length += n) == size)
+	    text = (char*)realloc(text, size *= 2);
+
     /* As the tokens are appended to the end of the token list, only the pointer
      * to the last element (tl) is used. The head is saved in the start of the
      * scanner for not losing the start of the token list. After the scanning is
@@ -75,14 +96,21 @@ token_list *lex(FILE *input){
      * There is cases for every element group which is handled 
      * similarly. 
      */
-    while(fread(&c, sizeof(char), 1, input) == sizeof(char)){
+    memset(buffer, '\0', TOKEN_MAX_LENGTH +1);
+
+    while(readInput(&c)){
 
-	memset(buffer, '\0', TOKEN_MAX_LENGTH +1); // Empty the buffer
+	/*
+	 * Empty the buffer. Only the string literals and the error tokens
+	 * may leave characters after the terminating null character, and
+	 * they empty the whole buffer after themselves.
+	 */
+	memset(buffer, '\0', strlen(buffer));
 	
 	switch (c){
 	    
        /*
-        * This and the next 4 groups are the only groups of items that can
+        * This and the next 6 groups are the only groups of items that can
         * be returned directly after founding. There is no need to read next
         * characters and thus no need to ungetc it.
         */
@@ -101,6 +129,16 @@ token_list *lex(FILE *input){
 	    tl = addToken(tl, TOKEN_RPAR, buffer, line_number, input);
 	    break;
 
+	case '[':                                                             // Opening bracket
+	    buffer[0] = c;
+	    tl = addToken(tl, TOKEN_LBRACKET, buffer, line_number, input);
+	    break;
+
+	case ']':                                                             // Closing bracket
+	    buffer[0] = c;
+	    tl = addToken(tl, TOKEN_RBRACKET, buffer, line_number, input);
+	    break;
+
 	case ';':                                                             // Semicolon
 	    buffer[0] = c;
 	    tl = addToken(tl, TOKEN_SCOL, buffer, line_number, input);
@@ -155,16 +193,20 @@ token_list *lex(FILE *input){
 		tl = handleIntLiterals(tl, buffer, input);
 
 	    /* String literal */
-	    else if(c == '"')
+	    else if(c == '"'){
 		do{
 		    memset(buffer, '\0', TOKEN_MAX_LENGTH +1);
-		    tl = handleStringLiterals(tl, buffer, input);
-		}while(isLastTokenControlError(head));
+		    tmp = tl;
+		    tl  = handleStringLiterals(tl, buffer, input);
+		}while(isLastTokenControlError(tmp));
+		memset(buffer, '\0', TOKEN_MAX_LENGTH +1);
+	    }
 		      
 	    /* Everything else is error */
 	    else{
 		ungetc(input);
 		tl = handleErrors(tl, buffer, input);
+		memset(buffer, '\0', TOKEN_MAX_LENGTH +1);
 	    }
 
 	    break;
@@ -176,10 +218,37 @@ token_list *lex(FILE *input){
      * Now we can mark it as EOF
      */
     addEOF(head);
+
+    free(text);
+    text = NULL;
     
     return head;
 }
 
+/*
+ * Moves the position in the input by n characters.
+ * See the macros ungetc() and skipch() in lex.h.
+ */
+void moveInput(int n){
+    text_position += n;
+}
+
+/* Reads the next character to *c. Returns 0 at the end of the input. */
+static int readInput(char *c){
+    if(text_position < 0 || text_position >= text_length)
+	return 0;
+
+    *c = text[text_position++];
+    return 1;
+}
+
+/* Returns the next character like fgetc() does. */
+static int getInput(void){
+    char c;
+
+    return readInput(&c) ? (unsigned char)c : EOF;
+}
+
 /*
  * Here we have three possibilities. The token may be a
  * division operator '/' or it can be a start of comment of
@@ -189,14 +258,14 @@ static token_list *handleSlash(token_list *tl, char *buffer, FILE *input){
     char c;
 
     /* Check for eof */
-    if(fread(&c, sizeof(char), 1, input) != sizeof(char)){
+    if(!readInput(&c)){
 	skipch(input);
 	return addToken(tl, TOKEN_BIN_OP, buffer, line_number, input);
     }
     
     /* One line comment detected! */
     else if(c == '/'){
-	while((c = fgetc(input)) != '\n' && c != EOF);
+	while((c = getInput()) != '\n' && c != EOF);
 	if(c == '\n')
 	    line_number++;
     }
@@ -204,14 +273,14 @@ static token_list *handleSlash(token_list *tl, char *buffer, FILE *input){
     /* Start of multiline comment */
     else if(c == '*'){
 
-	while((c = fgetc(input))){
+	while((c = getInput())){
 	    if(c == EOF)
 		return addToken(tl, TOKEN_ERROR, buffer, line_number, input);
 
 	    else if( c != '*')
 		continue;
 	    
-	    else if(fread(&c, sizeof(char), 1, input) != sizeof(char))
+	    else if(!readInput(&c))
 		return addToken(tl, TOKEN_ERROR, buffer, line_number, input);
 
 	    else if(c == '/') break;
@@ -242,7 +311,7 @@ static token_list *handleCol(token_list *tl, char *buffer, FILE *input){
      * In case there is no more input, the colon character should
      * represent a separator in decladation.
      */
-    if(fread(&c, sizeof(char), 1, input) != sizeof(char)){
+    if(!readInput(&c)){
 	return addToken(tl, TOKEN_COL, buffer, line_number, input);
     }
 
@@ -266,7 +335,7 @@ static token_list *handleCol(token_list *tl, char *buffer, FILE *input){
 static token_list *handlePeriod(token_list *tl, char *buffer, FILE *input){
     char c;
     
-    if(fread(&c, sizeof(char), 1, input) != sizeof(char)){
+    if(!readInput(&c)){
 	return addToken(tl, TOKEN_ERROR, buffer, line_number, input);
     }
 
@@ -301,7 +370,7 @@ static token_list *handleOthers(token_list *tl, char *buffer, FILE *input){
      */
     for(i = 0; i <= TOKEN_MAX_LENGTH; i++){
 
-	if(fread(&c, sizeof(char), 1, input) != sizeof(char)){
+	if(!readInput(&c)){
 	    skipch(input);
 	    break;
 	}
@@ -352,7 +421,7 @@ static token_list *handleIntLiterals(token_list *tl, char *buffer, FILE *input){
     
     for(i = 0; i <= TOKEN_MAX_LENGTH; i++){
 
-	if(fread(&c, sizeof(char), 1, input) != sizeof(char)){
+	if(!readInput(&c)){
 	    skipch(input);
 	    return addToken(tl, TOKEN_INT_LITERAL, buffer, line_number, input);
 	}
@@ -377,7 +446,7 @@ static token_list *handleStringLiterals(token_list *tl, char *buffer, FILE *inpu
     for(int i = 0; i < TOKEN_MAX_LENGTH; i++){
 
 	/* Encountering EOF means there is an unterminated string literal */
-	if( fread(&c, sizeof(char), 1, input) != sizeof(char)){
+	if( !readInput(&c)){
 	    skipch(input);
 	    sprintf(buffer, "Unterminated string literal.");
 	    return addToken(tl, TOKEN_ERROR, buffer, line_number, input);
@@ -508,7 +577,7 @@ static token_list *handleErrors(token_list *tl, char *buffer, FILE *input){
 
     for(i = 0; i <= TOKEN_MAX_LENGTH; i++){
 
-  	if(fread(&c, sizeof(char), 1, input) != sizeof(char))
+  	if(!readInput(&c))
 	    break;
 
 	if(c == ' ' || c == '\n' || c == '\t'){
@@ -647,21 +716,14 @@ token_list *correctTokenList(token_list *list){
  * whether the next backslash should be used as an escape 
  * character.
  *
- * Note that this function is supposed to be used only
- * before the final (EOF) token is added to the list.
- * Otherwise this function returns the error state
- * of the second last token.
+ * The parameter *last is the node of the last token, so
+ * that the list does not need to be walked from its head.
  */
-static int isLastTokenControlError(token_list *list){
-    int isControlError = 0;
-
-    for(; list->next != NULL; list = list->next)
-	if(list->value->type == TOKEN_ERROR &&
-	   strncmp(list->value->value, "String", 6) == 0 ||
-	   strncmp(list->value->value, "Undefined", 9) == 0)
-	    isControlError = 1;
-	else
-	    isControlError = 0;
+static int isLastTokenControlError(token_list *last){
+    if(last->value->type == TOKEN_ERROR &&
+       strncmp(last->value->value, "String", 6) == 0 ||
+       strncmp(last->value->value, "Undefined", 9) == 0)
+	return 1;
 
-    return isControlError;
+    return 0;
 }
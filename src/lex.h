@@ -5,9 +5,14 @@
 
 #include "tokens.h"
 
-/* These function calls are so frequently used that I made them a macros. */
-#define ungetc(x) 	 fseek(x, -sizeof(char), SEEK_CUR)
-#define skipch(x)        fseek(x,  sizeof(char), SEEK_CUR)
+/*
+ * These function calls are so frequently used that I made them a macros.
+ * The scanner reads its input from memory, see moveInput() in lex.c.
+ */
+#define ungetc(x) 	 moveInput(-1)
+#define skipch(x)        moveInput( 1)
+
+extern void moveInput (int n);
 
 /*
  * The main function of lexical analyzer,
@@ -1,18 +1,140 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "lex.h"
 #include "parser.h"
 #include "memory.h"
+#include "optimize.h"
+#include "cache.h"
+#include "tier.h"
+#include "pool.h"
+#include "vector.h"
+#include "batch.h"
+#include "input.h"
 
-/* 
+/*
  * Interface function for the semantic analyzer
  * and executing the input program.
  */
 extern int run(program_node *pn);
 
+/*
+ * Interface function of the closure compiled execution engine.
+ * Falls back to run() if the program can not be compiled.
+ */
+extern int runClosures(program_node *pn);
+
+/*
+ * Interface functions of the closure engine with the JIT compiler.
+ * The checked version runs every native loop also with the closures
+ * and reports the differences.
+ */
+extern int runJit       (program_node *pn);
+extern int runJitChecked(program_node *pn);
+
+/*
+ * Interface function of the ahead-of-time compiler. Writes the
+ * program translated to C to the standard output.
+ */
+extern int emitC(program_node *pn);
+
+/*
+ * Interface function of the native code generator. Writes the
+ * program translated to x86-64 assembly to the standard output.
+ */
+extern int emitAsm(program_node *pn);
+
+/*
+ * Usage: minipl [--engine=tree|closure|jit] [--jit-check] [--emit-c|--emit-asm]
+ *               [-O0|-O1|-O2] [--dump-ir] [--opt-stats] [--range-report]
+ *               [--unroll=n] [--cache=dir] [--tier-threshold=n] [--tier-stats]
+ *               [--threads=n] [--simd=off|sse|avx2] [--batch] [--batch-width=n]
+ *               [--input file] file
+ *
+ * The default engine is the tree walking interpreter. It compiles
+ * the loops that have run --tier-threshold iterations to closures,
+ * and --tier-stats reports when it does so. The closures run the
+ * reduction loops on --threads threads, by default one for every
+ * processor, and run the iterations of simple integer loops
+ * several at a time with the vector instructions of --simd, by
+ * default the best ones the processor has. With --batch the program
+ * is run once for every line of the input, --batch-width lines at a
+ * time in lockstep. The optimizer works on the IR, so the optimization
+ * options apply to the other engines and the compilers only. With
+ * --cache the optimized IR is kept in the directory dir for the
+ * next runs of the same program. The read statements read the
+ * file of --input instead of the standard input.
+ */
 int main(int argc, char *argv[]){
-    FILE *input = fopen(argv[1], "r");
+    int (*engine)(program_node *pn) = run;
+    char *file = NULL, *cache = NULL;
+    int   level = OPTIMIZE_DEFAULT_LEVEL, dump = 0, stats = 0, report = 0;
+    int   unroll = OPTIMIZE_UNROLL_FACTOR;
+    int   threshold = TIER_THRESHOLD, tier_stats = 0;
+
+    for(int i = 1; i < argc; i++){
+	if(strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 ||
+	   strcmp(argv[i], "-O2") == 0)
+	    level = argv[i][2] - '0';
+	else if(strcmp(argv[i], "--dump-ir") == 0)
+	    dump = 1;
+	else if(strcmp(argv[i], "--opt-stats") == 0)
+	    stats = 1;
+	else if(strcmp(argv[i], "--range-report") == 0)
+	    report = 1;
+	else if(strncmp(argv[i], "--unroll=", 9) == 0)
+	    unroll = atoi(argv[i] + 9);
+	else if(strncmp(argv[i], "--tier-threshold=", 17) == 0)
+	    threshold = atoi(argv[i] + 17);
+	else if(strcmp(argv[i], "--tier-stats") == 0)
+	    tier_stats = 1;
+	else if(strncmp(argv[i], "--threads=", 10) == 0)
+	    poolOptions(atoi(argv[i] + 10));
+	else if(strcmp(argv[i], "--simd=off") == 0)
+	    vectorOptions(VECTOR_OFF);
+	else if(strcmp(argv[i], "--simd=sse") == 0)
+	    vectorOptions(VECTOR_SSE);
+	else if(strcmp(argv[i], "--simd=avx2") == 0)
+	    vectorOptions(VECTOR_AVX2);
+	else if(strncmp(argv[i], "--cache=", 8) == 0)
+	    cache = argv[i] + 8;
+	else if(strcmp(argv[i], "--batch") == 0)
+	    engine = runBatch;
+	else if(strncmp(argv[i], "--batch-width=", 14) == 0)
+	    batchOptions(atoi(argv[i] + 14));
+	else if(strcmp(argv[i], "--input") == 0 && i +1 < argc){
+	    if(!inputOptions(argv[++i])){
+		fprintf(stderr, "Cannot open input file %s\n", argv[i]);
+		return -1;
+	    }
+	} else if(strcmp(argv[i], "--engine=tree") == 0)
+	    engine = run;
+	else if(strcmp(argv[i], "--engine=closure") == 0)
+	    engine = runClosures;
+	else if(strcmp(argv[i], "--engine=jit") == 0)
+	    engine = runJit;
+	else if(strcmp(argv[i], "--jit-check") == 0)
+	    engine = runJitChecked;
+	else if(strcmp(argv[i], "--emit-c") == 0)
+	    engine = emitC;
+	else if(strcmp(argv[i], "--emit-asm") == 0)
+	    engine = emitAsm;
+	else if(argv[i][0] == '-' && argv[i][1] == '-'){
+	    fprintf(stderr, "Unknown option %s\n", argv[i]);
+	    return -1;
+	} else
+	    file = argv[i];
+    }
+
+    if(file == NULL) return -1;
+
+    optimizeOptions(level, dump, stats, report);
+    optimizeUnroll(unroll);
+    cacheOptions(cache, file, level, unroll);
+    tierOptions(threshold, tier_stats);
+
+    FILE *input = fopen(file, "r");
 
     if(input == NULL) return -1;
     token_list *tl = lex(input);
@@ -23,13 +145,13 @@ int main(int argc, char *argv[]){
     program_node *pn = parse(tl);
     freeTokenList(tl);
 
-    /* 
+    /*
      * In case of the lexical and / or syntax error
      * the interpretr is not launched and the semantic
      * analysis is not done.
      */
     if(pn != NULL)
-	return run(pn);
+	return engine(pn);
 
     return 0;
 }
@@ -24,10 +24,12 @@ static void *error;
  * This function expects that the type and the value are correct.
  */
 token *newToken(token_type type, char *value, int line_number){
-    token *t = (token *)malloc(sizeof(token));
+    size_t length = strnlen(value, TOKEN_MAX_LENGTH);
+    token *t = (token *)malloc(sizeof(token) + length +1);
 
     t->type = type;
-    strncpy(t->value, value, TOKEN_MAX_LENGTH +1);
+    memcpy(t->value, value, length);
+    t->value[length] = '\0';
     t->line_number = line_number;
 
     return t;
@@ -94,6 +96,8 @@ token_list *addToken(token_list *tl, token_type type, char *buffer, int line, FI
        type == TOKEN_UN_OP                  ||
        type == TOKEN_STRING_LITERAL         ||
        type == TOKEN_RANGE                  ||
+       type == TOKEN_LBRACKET               ||
+       type == TOKEN_RBRACKET               ||
        type == TOKEN_COL);
        
     else
@@ -164,6 +168,10 @@ for_node *newForNode(void){
     r->stmtsn      = NULL;
     r->endKey      = NULL;
     r->forKeyEnd   = NULL;
+    r->iterations  = 0;
+    r->tier        = NULL;
+    r->checks      = NULL;
+    r->nchecks     = -1;
 
     return r;
 }
@@ -176,6 +184,7 @@ declaration_node *newDeclarationNode(void){
     r->id      = NULL;
     r->col     = NULL;
     r->typeKey = NULL;
+    r->dimn    = NULL;
     r->asn     = NULL;
 
     return r;
@@ -195,9 +204,10 @@ assignment_node *newAssignmentNode(void){
     assignment_node *r =
 	(assignment_node*)malloc(sizeof(assignment_node));
 
-    r->id    = NULL;
-    r->assOp = NULL;
-    r->expn  = NULL;
+    r->id     = NULL;
+    r->indexn = NULL;
+    r->assOp  = NULL;
+    r->expn   = NULL;
 
     return r;
 }
@@ -239,7 +249,10 @@ operand_node *newOperandNode(void){
     r->intLit = NULL;
     r->strLit = NULL;
     r->id     = NULL;
+    r->indexn = NULL;
+    r->lengthn = NULL;
     r->expren = NULL;
+    r->constant = NULL;
 
     return r;
 }
@@ -283,6 +296,7 @@ read_node *newReadNode(void){
 
     r->read = NULL;
     r->id = NULL;
+    r->indexn = NULL;
 
     return r;
 }
@@ -297,11 +311,39 @@ print_node *newPrintNode(void){
     return r;
 }
 
+index_node *newIndexNode(void){
+    index_node *r =
+	(index_node*)malloc(sizeof(index_node));
+
+    r->lBracket  = NULL;
+    r->expn      = NULL;
+    r->rBracket  = NULL;
+    r->array     = NULL;
+    r->unchecked = 0;
+
+    return r;
+}
+
+length_node *newLengthNode(void){
+    length_node *r =
+	(length_node*)malloc(sizeof(length_node));
+
+    r->len  = NULL;
+    r->lPar = NULL;
+    r->id   = NULL;
+    r->rPar = NULL;
+
+    return r;
+}
+
 /*
  * Functions to free memory.
  * The following functions just deallocates the nodes of
  * the parse tree. This occurs recursively from root to
- * leaves. All nonterminals have own function.
+ * leaves. All nonterminals have own function. The statement
+ * lists and the nested expressions are freed iteratively, so
+ * that long programs and deep parentheses do not exhaust the
+ * C stack.
  */
 void freeSyntaxTree(program_node *pn, void *err){
     if(err != NULL)
@@ -318,12 +360,16 @@ void freeProgram(program_node *pn){
     free(pn);
 }
 void freeStmts(stmts_node *stmtln){
-    if(stmtln == NULL || stmtln == error) return;
+    stmts_node *tmp;
 
-    freeStatement(stmtln->stmtn);
-    freeStmts(stmtln->stmtsn);
-    
-    free(stmtln);
+    while(stmtln != NULL && stmtln != error){
+	tmp = stmtln->stmtsn;
+
+	freeStatement(stmtln->stmtn);
+	free(stmtln);
+
+	stmtln = tmp;
+    }
 }
 void freeStatement(statement_node *stmtn){
     if(stmtn == NULL || stmtn == error) return;
@@ -345,12 +391,14 @@ void freeFor(for_node *forn){
     freeExpression(forn->expn2);
     freeStmts(forn->stmtsn);
 
+    free(forn->checks);
     free(forn);
 }
     
 void freeDeclaration(declaration_node *decn){
     if(decn == NULL || decn == error) return;
 
+    freeIndex(decn->dimn);
     freeDeclarationSuffix(decn->asn);
 
     free(decn);
@@ -367,18 +415,67 @@ void freeDeclarationSuffix(declaration_suffix_node *asn){
 void freeAssignment(assignment_node *assn){
     if(assn == NULL || assn == error) return;
 
+    freeIndex(assn->indexn);
     freeExpression(assn->expn);
 
     free(assn);
 }
 
+/*
+ * The expressions in the parentheses and the indexes of the
+ * operands are detached and put to a work stack before the
+ * expression is freed, so that freeOperand() does not recurse
+ * into them.
+ */
+static expression_node **detach(operand_node *opn, expression_node **stack, int *depth, int *size){
+    expression_node **expn;
+
+    if(opn == NULL || opn == error)
+	return stack;
+
+    if(opn->expren != NULL && opn->expren != error)
+	expn = &opn->expren->expn;
+    else if(opn->indexn != NULL && opn->indexn != error)
+	expn = &opn->indexn->expn;
+    else
+	return stack;
+
+    if(*depth == *size){
+	*size = *size == 0 ? 16 : 2 * *size;
+	stack = (expression_node**)realloc(stack, *size * sizeof(expression_node*));
+    }
+    stack[(*depth)++] = *expn;
+    *expn = NULL;
+
+    return stack;
+}
+
 void freeExpression(expression_node *expn){
-    if(expn == NULL || expn == error) return;
+    expression_node **stack = NULL;
+    int               depth = 0, size = 0;
+
+    for(;;){
+	if(expn != NULL && expn != error){
+	    if(expn->unaryen != NULL && expn->unaryen != error)
+		stack = detach(expn->unaryen->opern, stack, &depth, &size);
+	    if(expn->binaryen != NULL && expn->binaryen != error){
+		stack = detach(expn->binaryen->opern, stack, &depth, &size);
+		if(expn->binaryen->osn != NULL && expn->binaryen->osn != error)
+		    stack = detach(expn->binaryen->osn->opn, stack, &depth, &size);
+	    }
+
+	    freeUnaryExpression(expn->unaryen);
+	    freeBinaryExpression(expn->binaryen);
+
+	    free(expn);
+	}
+
+	if(depth == 0)
+	    break;
+	expn = stack[--depth];
+    }
 
-    freeUnaryExpression(expn->unaryen);
-    freeBinaryExpression(expn->binaryen);
-    
-    free(expn);
+    free(stack);
 }
 
 void freeUnaryExpression(unary_expression_node *uen){
@@ -401,6 +498,8 @@ void freeBinaryExpression(binary_expression_node *ben){
 void freeOperand(operand_node *opn){
     if(opn == NULL || opn == error) return;
 
+    freeIndex(opn->indexn);
+    freeLength(opn->lengthn);
     freeEnclosedExpression(opn->expren);
 
     free(opn);
@@ -433,6 +532,8 @@ void freeAssert(assert_node *asn){
 void freeRead(read_node *rn){
     if(rn == NULL || rn == error) return;
 
+    freeIndex(rn->indexn);
+
     free(rn);
 }
 
@@ -444,6 +545,20 @@ void freePrint(print_node *pr){
     free(pr);
 }
 
+void freeIndex(index_node *in){
+    if(in == NULL || in == error) return;
+
+    freeExpression(in->expn);
+
+    free(in);
+}
+
+void freeLength(length_node *ln){
+    if(ln == NULL || ln == error) return;
+
+    free(ln);
+}
+
 
 /*
  * SEMANTIC ANALYSIS -------------------------------------------------
@@ -455,9 +570,10 @@ void freePrint(print_node *pr){
 label_list *newLabelListNode(label_list **list, label *l, value v){
     label_list *new = (label_list*)malloc(sizeof(label_list));
 
-    new->v    = v;
-    new->l    = l;
-    new->next = *list;
+    new->v        = v;
+    new->l        = l;
+    new->constant = 0;
+    new->next     = *list;
 
     return new;
 }
@@ -467,8 +583,568 @@ void freeLabelList(label_list *ll){
 
     while(ll != NULL){
 	tmp = ll->next;
+	if(ll->v.lt == STRING)
+	    releaseString(ll->v.s);
+	if(ll->v.lt == ARRAY)
+	    freeArray(ll->v.a);
 	free(ll);
 	ll = tmp;
     }
 }
 
+/*
+ * ARRAYS ------------------------------------------------------------
+ * The elements are allocated apart from the header, so that they
+ * can start at a cache line boundary. The size of an aligned
+ * allocation must be a multiple of the alignment.
+ */
+
+/* Returns NULL if the elements can not be allocated. */
+array *newArray(int length){
+    array  *a    = (array*)malloc(sizeof(array));
+    size_t  size = ((size_t)length * sizeof(int) + ARRAY_ALIGNMENT -1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+
+    a->length   = length;
+    a->elements = (int*)aligned_alloc(ARRAY_ALIGNMENT, size > 0 ? size : ARRAY_ALIGNMENT);
+
+    if(a->elements == NULL){
+	free(a);
+	return NULL;
+    }
+
+    memset(a->elements, 0, size);
+
+    return a;
+}
+
+void freeArray(array *a){
+    if(a == NULL) return;
+
+    free(a->elements);
+    free(a);
+}
+
+/*
+ * STRINGS -----------------------------------------------------------
+ * The strings of the interpreter. The literals and the strings that
+ * are read are interned in a hash table, so that there is only one
+ * interned string with the same characters. The literals stay in
+ * the table until freeStringPool() is called after the program, the
+ * other interned strings until their last reference is released.
+ */
+
+#define POOL_SIZE 256
+
+static str    **pool;
+static unsigned pool_size;
+static unsigned pool_count;
+
+static int      extendScratch (str *s, int n);
+
+static unsigned hashChars(const char *chars, int length){
+    unsigned h = 5381;
+
+    for(int i = 0; i < length; i++)
+	h = h * 33 + (unsigned char)chars[i];
+
+    return h;
+}
+
+/* The table is doubled when it has as many strings as buckets. */
+static void growPool(void){
+    unsigned  size = pool_size == 0 ? POOL_SIZE : 2 * pool_size;
+    str     **tmp  = (str**)calloc(size, sizeof(str*));
+    str      *s, *next;
+
+    for(unsigned i = 0; i < pool_size; i++)
+	for(s = pool[i]; s != NULL; s = next){
+	    next    = s->next;
+	    s->next = tmp[s->hash % size];
+	    tmp[s->hash % size] = s;
+	}
+
+    free(pool);
+    pool      = tmp;
+    pool_size = size;
+}
+
+/*
+ * Returns a reference to the interned string with the given
+ * characters. A new string gets the reference count refs. A
+ * literal holds no reference, so a string that was read before
+ * with the same characters becomes constant when a literal is
+ * interned.
+ */
+static str *intern(const char *chars, int length, int refs){
+    unsigned h = hashChars(chars, length);
+    str     *s;
+
+    if(pool_count >= pool_size)
+	growPool();
+
+    for(s = pool[h % pool_size]; s != NULL; s = s->next)
+	if(s->hash == h && s->length == length && memcmp(s->chars, chars, length) == 0){
+	    if(refs == STRING_CONSTANT)
+		s->refs = STRING_CONSTANT;
+	    else
+		retainString(s);
+	    return s;
+	}
+
+    s           = newString(chars, length);
+    s->refs     = refs;
+    s->hash     = h;
+    s->interned = 1;
+    s->next     = pool[h % pool_size];
+    pool[h % pool_size] = s;
+    pool_count++;
+
+    return s;
+}
+
+/* Allocates a string for length characters, which are left unset. */
+static str *allocString(int length){
+    str *r = (str*)malloc(sizeof(str) + length +1);
+
+    r->refs     = 1;
+    r->length   = length;
+    r->capacity = length;
+    r->hash     = 0;
+    r->interned = 0;
+    r->next     = NULL;
+
+    return r;
+}
+
+str *newString(const char *chars, int length){
+    str *r = allocString(length);
+
+    memcpy(r->chars, chars, length);
+    r->chars[length] = '\0';
+
+    return r;
+}
+
+str *constantString(const char *chars){
+    return intern(chars, strlen(chars), STRING_CONSTANT);
+}
+
+str *internString(const char *chars, int length){
+    return intern(chars, length, 1);
+}
+
+/*
+ * Appends *r to *l and returns the result, which takes over the
+ * reference of the caller to *l. If that was the only reference,
+ * *l is extended in place and its capacity is doubled when it runs
+ * out, so that building a string with repeated appends takes
+ * amortized linear time. A scratch string is extended in place if
+ * it was the last one allocated. Otherwise *l is released and the
+ * result is a new scratch string. Interned strings are never changed.
+ */
+str *appendString(str *l, str *r){
+    int  length = l->length + r->length;
+    str *s;
+
+    if(l->refs == 1 && !l->interned){
+	if(length > l->capacity){
+	    l->capacity = length > 2 * l->capacity ? length : 2 * l->capacity;
+	    l = (str*)realloc(l, sizeof(str) + l->capacity +1);
+	}
+	memcpy(l->chars + l->length, r->chars, r->length +1);
+	l->length = length;
+	return l;
+    }
+
+    if(l->refs == STRING_SCRATCH && extendScratch(l, r->length)){
+	memcpy(l->chars + l->length, r->chars, r->length +1);
+	l->length = length;
+	return l;
+    }
+
+    s = scratchString(length);
+    memcpy(s->chars,             l->chars, l->length);
+    memcpy(s->chars + l->length, r->chars, r->length +1);
+    releaseString(l);
+
+    return s;
+}
+
+/*
+ * Returns a heap string with the characters of the scratch string
+ * *s, to be stored in place of the string *old (or NULL). The
+ * result takes over the reference of the caller to *old: if that
+ * was the only reference and *old has room, its buffer is reused.
+ */
+str *promoteString(str *s, str *old){
+    if(old != NULL && old->refs == 1 && !old->interned && old->capacity >= s->length){
+	memcpy(old->chars, s->chars, s->length +1);
+	old->length = s->length;
+	return old;
+    }
+
+    if(old != NULL)
+	releaseString(old);
+
+    return newString(s->chars, s->length);
+}
+
+/*
+ * Two different interned strings never have the same characters,
+ * so they are compared by their addresses only.
+ */
+int equalStrings(str *l, str *r){
+    if(l == r)
+	return 1;
+    if(l->interned && r->interned)
+	return 0;
+
+    return l->length == r->length && memcmp(l->chars, r->chars, l->length) == 0;
+}
+
+/*
+ * Orders the strings like strcmp() does. The first characters
+ * usually differ and are compared before the rest.
+ */
+int lessStrings(str *l, str *r){
+    int n = l->length < r->length ? l->length : r->length;
+    int c;
+
+    if(l == r)
+	return 0;
+    if(l->chars[0] != r->chars[0])
+	return (unsigned char)l->chars[0] < (unsigned char)r->chars[0];
+    if((c = memcmp(l->chars, r->chars, n)) != 0)
+	return c < 0;
+
+    return l->length < r->length;
+}
+
+void retainString(str *s){
+    if(s->refs > 0)
+	s->refs++;
+}
+
+/* A released interned string is removed from the table. */
+void releaseString(str *s){
+    str **tmp;
+
+    if(s->refs < 0 || --s->refs > 0)
+	return;
+
+    if(s->interned){
+	for(tmp = &pool[s->hash % pool_size]; *tmp != s; tmp = &(*tmp)->next)
+	    ;
+	*tmp = s->next;
+	pool_count--;
+    }
+
+    free(s);
+}
+
+void freeStringPool(void){
+    str *tmp;
+
+    for(unsigned i = 0; i < pool_size; i++)
+	while(pool[i] != NULL){
+	    tmp = pool[i]->next;
+	    free(pool[i]);
+	    pool[i] = tmp;
+	}
+
+    free(pool);
+    pool       = NULL;
+    pool_size  = 0;
+    pool_count = 0;
+}
+
+
+
+/*
+ * The scratch arena. The temporary strings of a statement are
+ * allocated from a list of chunks and are all freed at once with
+ * resetScratch(). The chunks are kept for the next statement, so a
+ * loop allocates from the heap only until the chunks are large
+ * enough for its body. The reference count of a scratch string is
+ * STRING_SCRATCH and retaining or releasing it does nothing.
+ */
+
+#define CHUNK_SIZE 65536
+
+typedef struct CHUNK{
+    size_t         size;
+    size_t         used;
+    struct CHUNK  *next;
+    char           data[];
+} chunk;
+
+static chunk *chunks;    // The first chunk.
+static chunk *current;   // The chunk strings are allocated from.
+
+/* The size of a scratch string of length characters, aligned. */
+static size_t scratchSize(int length){
+    return (sizeof(str) + length +1 + 7) & ~(size_t)7;
+}
+
+str *scratchString(int length){
+    size_t  size = scratchSize(length);
+    chunk **tmp  = current == NULL ? &chunks : &current->next;
+    str    *r;
+
+    if(current == NULL || current->used + size > current->size){
+	/* The next chunk is reused if it is large enough. */
+	if(*tmp == NULL || (*tmp)->size < size){
+	    chunk *c = (chunk*)malloc(sizeof(chunk) + (size > CHUNK_SIZE ? size : CHUNK_SIZE));
+	    c->size  = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+	    c->next  = *tmp;
+	    *tmp     = c;
+	}
+	current       = *tmp;
+	current->used = 0;
+    }
+
+    r = (str*)(current->data + current->used);
+    current->used += size;
+
+    r->refs     = STRING_SCRATCH;
+    r->length   = length;
+    r->capacity = length;
+    r->hash     = 0;
+    r->interned = 0;
+    r->next     = NULL;
+    r->chars[length] = '\0';
+
+    return r;
+}
+
+/*
+ * Grows the scratch string *s by n characters in place, if it is
+ * the last string of the current chunk and the chunk has room.
+ * Returns 1 on success, 0 otherwise.
+ */
+static int extendScratch(str *s, int n){
+    size_t start = (char*)s - current->data;
+
+    if((char*)s < current->data || start + scratchSize(s->length) != current->used ||
+       start + scratchSize(s->length + n) > current->size)
+	return 0;
+
+    current->used = start + scratchSize(s->length + n);
+    s->capacity   = s->length + n;
+    return 1;
+}
+
+void resetScratch(void){
+    current = chunks;
+    if(current != NULL)
+	current->used = 0;
+}
+
+void freeScratch(void){
+    chunk *tmp;
+
+    while(chunks != NULL){
+	tmp = chunks->next;
+	free(chunks);
+	chunks = tmp;
+    }
+
+    current = NULL;
+}
+
+
+
+/*
+ * INTERMEDIATE REPRESENTATION ---------------------------------------
+ * The following functions are invoked from the lowering and the
+ * execution engines that use the IR.
+ */
+
+ir_program *newIrProgram(void){
+    ir_program *r = (ir_program*)malloc(sizeof(ir_program));
+
+    r->stmts  = NULL;
+    r->nslots = 0;
+    r->names  = NULL;
+    r->types  = NULL;
+
+    return r;
+}
+
+ir_stmt *newIrStmt(ir_kind kind){
+    ir_stmt *r = (ir_stmt*)malloc(sizeof(ir_stmt));
+
+    r->kind  = kind;
+    r->line  = 0;
+    r->slot  = 0;
+    r->lt    = UNDEF;
+    r->expn  = NULL;
+    r->expn2 = NULL;
+    r->body  = NULL;
+    r->msg   = NULL;
+    r->next  = NULL;
+
+    return r;
+}
+
+ir_expr *newIrExpr(ir_op op){
+    ir_expr *r = (ir_expr*)malloc(sizeof(ir_expr));
+
+    r->op      = op;
+    r->lt      = UNDEF;
+    r->line    = 0;
+    r->fault   = 0;
+    r->nonzero = 0;
+    r->i       = 0;
+    r->s       = NULL;
+    r->slot    = 0;
+    r->l       = NULL;
+    r->r       = NULL;
+
+    return r;
+}
+
+/* Returns a deep copy of the expression. Used by the optimizer. */
+ir_expr *copyIrExpr(ir_expr *expn){
+    ir_expr *r = (ir_expr*)malloc(sizeof(ir_expr));
+
+    *r = *expn;
+    if(expn->s != NULL) r->s = strdup(expn->s);
+    if(expn->l != NULL) r->l = copyIrExpr(expn->l);
+    if(expn->r != NULL) r->r = copyIrExpr(expn->r);
+
+    return r;
+}
+
+/* Returns a deep copy of the statement list. Used by the optimizer. */
+ir_stmt *copyIrStmts(ir_stmt *stmt){
+    ir_stmt *head = NULL, **tail = &head, *r;
+
+    for(; stmt != NULL; stmt = stmt->next){
+	r = (ir_stmt*)malloc(sizeof(ir_stmt));
+
+	*r = *stmt;
+	if(stmt->expn  != NULL) r->expn  = copyIrExpr(stmt->expn);
+	if(stmt->expn2 != NULL) r->expn2 = copyIrExpr(stmt->expn2);
+	if(stmt->msg   != NULL) r->msg   = strdup(stmt->msg);
+	r->body = copyIrStmts(stmt->body);
+	r->next = NULL;
+
+	*tail = r;
+	tail  = &r->next;
+    }
+
+    return head;
+}
+
+void freeIr(ir_program *ir){
+    if(ir == NULL) return;
+
+    freeIrStmts(ir->stmts);
+
+    for(int i = 0; i < ir->nslots; i++)
+	free(ir->names[i]);
+    free(ir->names);
+    free(ir->types);
+
+    free(ir);
+}
+
+/*
+ * Statement lists are freed iteratively. Only the
+ * bodies of for statements are freed recursively.
+ */
+void freeIrStmts(ir_stmt *stmt){
+    ir_stmt *tmp;
+
+    while(stmt != NULL){
+	tmp = stmt->next;
+
+	freeIrExpr(stmt->expn);
+	freeIrExpr(stmt->expn2);
+	freeIrStmts(stmt->body);
+	free(stmt->msg);
+	free(stmt);
+
+	stmt = tmp;
+    }
+}
+
+void freeIrExpr(ir_expr *expn){
+    if(expn == NULL) return;
+
+    freeIrExpr(expn->l);
+    freeIrExpr(expn->r);
+    free(expn->s);
+
+    free(expn);
+}
+
+
+/*
+ * CLOSURE COMPILATION -----------------------------------------------
+ * The following functions are invoked from the closure compiler.
+ * String constants of the closures are owned by the IR and are
+ * not freed here.
+ */
+
+stmt_closure *newStmtClosure(void){
+    stmt_closure *r = (stmt_closure*)malloc(sizeof(stmt_closure));
+
+    r->exec = NULL;
+    r->e1   = NULL;
+    r->e2   = NULL;
+    r->body = NULL;
+    r->slot = 0;
+    r->line = 0;
+    r->msg  = NULL;
+    r->native = NULL;
+    r->parallel = NULL;
+    r->vector = NULL;
+    r->next = NULL;
+
+    return r;
+}
+
+expr_closure *newExprClosure(void){
+    expr_closure *r = (expr_closure*)malloc(sizeof(expr_closure));
+
+    r->eval.i = NULL;
+    r->l      = NULL;
+    r->r      = NULL;
+    r->i      = 0;
+    r->s      = NULL;
+    r->slot   = 0;
+    r->line   = 0;
+    r->buf    = NULL;
+    r->size   = 0;
+
+    return r;
+}
+
+void freeStmtClosures(stmt_closure *c){
+    stmt_closure *tmp;
+
+    while(c != NULL){
+	tmp = c->next;
+
+	freeExprClosure(c->e1);
+	freeExprClosure(c->e2);
+	freeStmtClosures(c->body);
+	free(c->parallel);
+	free(c->vector);
+	free(c);
+
+	c = tmp;
+    }
+}
+
+void freeExprClosure(expr_closure *c){
+    if(c == NULL) return;
+
+    freeExprClosure(c->l);
+    freeExprClosure(c->r);
+
+    free(c->buf);
+    free(c);
+}
@@ -4,6 +4,8 @@
 #include "tree.h"
 #include "tokens.h"
 #include "label.h"
+#include "ir.h"
+#include "closure.h"
 /*
  * here is all declarations of memory related functions.
  */
@@ -34,6 +36,8 @@ operand_suffix_node      *newOperandSuffixNode      (void);
 assert_node              *newAssertNode             (void);
 read_node                *newReadNode               (void);
 print_node               *newPrintNode              (void);
+index_node               *newIndexNode              (void);
+length_node              *newLengthNode             (void);
 
 /* Functions to deallocate memory. */
 void freeSyntaxTree         (program_node             *pn, void *err);
@@ -53,10 +57,47 @@ void freeOperandSuffix      (operand_suffix_node      *osn          );
 void freeAssert             (assert_node              *asn          );
 void freeRead               (read_node                *rn           );
 void freePrint              (print_node               *pr           );
+void freeIndex              (index_node               *in           );
+void freeLength             (length_node              *ln           );
 
 
 // SEMANTIC ANALYSIS ---------------------------------------------
 label_list *newLabelListNode(label_list **list, label *l, value v);
 void        freeLabelList   (label_list  *ll                     );
 
+// ARRAYS --------------------------------------------------------
+array      *newArray        (int length                          );
+void        freeArray       (array *a                            );
+
+// STRINGS -------------------------------------------------------
+str        *newString       (const char *chars, int length       );
+str        *constantString  (const char *chars                   );
+str        *internString    (const char *chars, int length       );
+str        *appendString    (str *l, str *r                      );
+int         equalStrings    (str *l, str *r                      );
+int         lessStrings     (str *l, str *r                      );
+str        *promoteString   (str *s, str *old                    );
+void        retainString    (str *s                              );
+void        releaseString   (str *s                              );
+void        freeStringPool  (void                                );
+str        *scratchString   (int length                          );
+void        resetScratch    (void                                );
+void        freeScratch     (void                                );
+
+// INTERMEDIATE REPRESENTATION -----------------------------------
+ir_program *newIrProgram    (void                );
+ir_stmt    *newIrStmt       (ir_kind kind        );
+ir_expr    *newIrExpr       (ir_op   op          );
+ir_expr    *copyIrExpr      (ir_expr    *expn    );
+ir_stmt    *copyIrStmts     (ir_stmt    *stmt    );
+void        freeIr          (ir_program *ir      );
+void        freeIrStmts     (ir_stmt    *stmt    );
+void        freeIrExpr      (ir_expr    *expn    );
+
+// CLOSURE COMPILATION -------------------------------------------
+stmt_closure *newStmtClosure  (void              );
+expr_closure *newExprClosure  (void              );
+void          freeStmtClosures(stmt_closure *c   );
+void          freeExprClosure (expr_closure *c   );
+
 #endif
@@ -0,0 +1,2537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "optimize.h"
+#include "cache.h"
+#include "memory.h"
+
+/*
+ * This file contains the optimizer. The passes work on the IR
+ * and are run in the order of the table passes below.
+ *
+ * No pass changes the subexpressions that can fail at runtime,
+ * because the error messages of a failing expression depend on
+ * its shape. Such expressions are not folded, and statements whose
+ * expression can fail are never removed.
+ */
+
+/*
+ * A pass of the pipeline. The function of the pass returns the
+ * number of changes it made to the program. The statistics are
+ * accumulated over the rounds of the pipeline.
+ */
+typedef struct PASS{
+    char         *name     ;
+    int         (*run)(ir_program *ir);
+    int           level    ;   // Lowest optimization level that runs the pass.
+    int           runs     ;
+    int           changes  ;
+    double        time     ;   // Milliseconds.
+} pass;
+
+/* Interval of the values of an integer or boolean, lo..hi. */
+typedef struct INTERVAL{
+    long long     lo       ;
+    long long     hi       ;
+} interval;
+
+/* A fact proven by the range analysis, for the report. */
+typedef struct RANGE_FACT{
+    int           line     ;
+    char         *text     ;
+} range_fact;
+
+/*
+ * An expression computed by an earlier statement of the list. The
+ * expression is at *where and its statement stmt at *at, or after
+ * the temporaries inserted at *at. The slot of the temporary that
+ * holds its value is -1 until it is shared.
+ */
+typedef struct CSE_ENTRY{
+    ir_expr     **where    ;
+    ir_stmt     **at       ;
+    ir_stmt      *stmt     ;
+    int           slot     ;
+} cse_entry;
+
+static const interval integers = {INT_MIN, INT_MAX};
+
+/* The passes. */
+static int      prefix           (ir_program *ir);
+static int      fold             (ir_program *ir);
+static int      propagate        (ir_program *ir);
+static int      ranges           (ir_program *ir);
+static int      deadStores       (ir_program *ir);
+static int      unusedSlots      (ir_program *ir);
+static int      hoist            (ir_program *ir);
+static int      commonExprs      (ir_program *ir);
+static int      closedForms      (ir_program *ir);
+static int      fuse             (ir_program *ir);
+static int      unroll           (ir_program *ir);
+
+/* Helper functions used only in this translation unit. */
+static int      residual         (ir_stmt *stmt, int n                    );
+static int      evaluateStmt     (ir_stmt *stmt                           );
+static int      evaluate         (ir_expr *expn, int *v, char **s         );
+static void     store            (int slot, int v, char *s                );
+static int      append           (char *s                                 );
+static void     commit           (void                                    );
+static void     rollback         (void                                    );
+static ir_stmt *foldStmts        (ir_stmt *stmt                           );
+static ir_expr *foldExpression   (ir_expr *expn                           );
+static ir_stmt *unrollOnce       (ir_stmt *stmt                           );
+static ir_expr *constant         (int v, int line                         );
+static int      fails            (ir_stmt *stmt                           );
+static void     propagateStmts   (ir_stmt *stmt                           );
+static ir_expr *substitute       (ir_expr *expn                           );
+static void     writtenSlots     (ir_stmt *stmt, char *written            );
+static void     rangeStmts       (ir_stmt **list, interval *state         );
+static interval rangeExpr        (ir_expr *expn, interval *state          );
+static void     refine           (ir_expr *expn, int truth, interval *state);
+static void     narrow           (interval *state, int slot, long long lo, long long hi);
+static interval top              (int slot                                );
+static interval join             (interval a, interval b                  );
+static interval corners          (interval l, interval r, ir_op op        );
+static void     fact             (int line, char *text                    );
+static void     liveSlots        (ir_stmt **list, char *live, int remove  );
+static void     liveLoop         (ir_stmt *stmt, char *live, int remove   );
+static void     readSlots        (ir_expr *expn, char *live               );
+static int      reads            (ir_expr *expn, char *slots              );
+static void     hoistStmts       (ir_stmt **list                          );
+static void     hoistLoop        (ir_stmt **link                          );
+static int      invariant        (ir_expr **expn                          );
+static void     hoistExpr        (ir_expr **expn                          );
+static int      hidden           (int slot                                );
+static int      sameExpr         (ir_expr *a, ir_expr *b                  );
+static void     cseStmts         (ir_stmt **list                          );
+static void     number           (ir_expr **expn, ir_stmt **at, ir_stmt *stmt, cse_entry *table, int *n);
+static int      reuse            (ir_expr **expn, cse_entry *table, int n );
+static int      shared           (ir_expr *expn                           );
+static void     closeStmts       (ir_stmt **list                          );
+static void     closeLoop        (ir_stmt **link                          );
+static int      once             (ir_stmt *stmt                           );
+static int      claim            (ir_stmt *stmt, int *owner, int id       );
+static ir_expr *expand           (ir_expr *expn, ir_expr **defs           );
+static int      accumulator      (ir_stmt *stmt, ir_expr *e, int slot     );
+static int      linear           (ir_expr *expn, int slot                 );
+static int      final            (ir_stmt *stmt                           );
+static ir_expr *bound            (ir_expr *expn                           );
+static void     coefficients     (ir_expr *expn, int slot, ir_expr **a, ir_expr **b);
+static ir_expr *arith            (ir_op op, ir_expr *l, ir_expr *r        );
+static ir_expr *variable         (int slot                                );
+static int      readsSlot        (ir_expr *expn, int slot                 );
+static void     fuseStmts        (ir_stmt *stmt                           );
+static int      fusible          (ir_stmt *a, ir_stmt *b                  );
+static int      effects          (ir_stmt *stmt                           );
+static void     usedSlots        (ir_stmt *stmt, char *read               );
+static void     unrollStmts      (ir_stmt **list                          );
+static int      unrollable       (ir_stmt *stmt                           );
+static void     unrollLoop       (ir_stmt **link                          );
+static int      stable           (ir_expr *expn, ir_stmt *stmt            );
+static ir_expr *temporary        (ir_stmt ***link, ir_stmt *stmt, ir_expr *expn);
+static void     assign           (ir_stmt ***link, ir_stmt *stmt, int slot, ir_expr *expn);
+static ir_stmt *step             (int slot                                );
+static char    *hiddenName       (void                                    );
+static void     markSlots        (ir_stmt *stmt, int *map                 );
+static void     markExpr         (ir_expr *expn, int *map                 );
+static void     renumberStmts    (ir_stmt *stmt, int *map                 );
+static void     renumberExpr     (ir_expr *expn, int *map                 );
+static void     dumpStmts        (FILE *out, ir_program *ir, ir_stmt *stmt, int depth);
+static void     dumpExpr         (FILE *out, ir_program *ir, ir_expr *expn);
+static double   now              (void                                    );
+
+static pass passes[] = {
+    {"prefix",    prefix,      2},
+    {"propagate", propagate,   1},
+    {"fold",      fold,        1},
+    {"ranges",    ranges,      1},
+    {"fuse",      fuse,        2},
+    {"licm",      hoist,       2},
+    {"cse",       commonExprs, 2},
+    {"closed",    closedForms, 2},
+    {"unroll",    unroll,      2},
+    {"dse",       deadStores,  1},
+    {"unused",    unusedSlots, 1},
+};
+
+#define NPASSES (int)(sizeof(passes) / sizeof(pass))
+
+/* Options of the optimizer. */
+static int         level = OPTIMIZE_DEFAULT_LEVEL;
+static int         dump;
+static int         stats;
+static int         report;
+static int         factor = OPTIMIZE_UNROLL_FACTOR;
+
+/*
+ * State of the running pass. The array known has the constant
+ * value of each slot during the constant propagation, or NULL.
+ * The slots assigned in the loop being hoisted are marked in
+ * written, and the statements hoisted from it are inserted at
+ * *hoisted. Hidden temporaries are numbered with temps. The
+ * evaluations removed by the common subexpression elimination
+ * are counted in eliminated over all the rounds.
+ */
+static ir_program *program;
+static int         changes;
+static ir_expr   **known;
+static char       *written;
+static ir_stmt   **preheader;
+static ir_stmt   **hoisted;
+static ir_stmt    *loop;
+static int         temps;
+static int         eliminated;
+
+/*
+ * State of the partial evaluation. The slots that have a value are
+ * marked in defined. The steps are counted over all the rounds.
+ */
+typedef struct UNDO_ENTRY{
+    int           slot     ;
+    int           defined  ;
+    int           i        ;
+    char         *s        ;
+} undo_entry;
+
+static int        *values;
+static char      **strings;
+static char       *defined;
+static int        *logged;     // Epoch of the statement that saved the slot to undo.
+static int         epoch;
+static undo_entry *undo;
+static int         undo_size;
+static int         undo_capacity;
+static char       *output;
+static int         output_size;
+static int         output_capacity;
+static int         output_previous;
+static long        steps;
+
+/* The facts proven by the range analysis, in the order of the lines. */
+static range_fact *facts;
+static int         nfacts;
+static int         facts_capacity;
+
+void optimizeOptions(int l, int d, int s, int r){
+    level  = l;
+    dump   = d;
+    stats  = s;
+    report = r;
+}
+
+void optimizeUnroll(int f){
+    factor = f;
+}
+
+/*
+ * Main function of the optimizer.
+ *
+ * Runs the passes of the current level on the program *ir.
+ * At -O2 the pipeline is repeated until a round makes no
+ * changes, at most OPTIMIZE_MAX_ROUNDS times.
+ */
+void optimize(ir_program *ir){
+    int         rounds = 0, total, n, i;
+    double      start;
+    ir_program *cached, tmp;
+
+    /* The passes and the facts are shown only when they are run. */
+    if(!dump && !report && (cached = cacheLoad()) != NULL){
+	tmp     = *ir;
+	*ir     = *cached;
+	*cached = tmp;
+	freeIr(cached);
+
+	if(stats)
+	    fprintf(stderr, "Optimizer at -O%d: loaded from the cache\n", level);
+	return;
+    }
+
+    program = ir;
+    temps      = 0;
+    eliminated = 0;
+    steps   = 0;
+    nfacts  = 0;
+
+    for(i = 0; i < NPASSES; i++){
+	passes[i].runs    = 0;
+	passes[i].changes = 0;
+	passes[i].time    = 0;
+    }
+
+    if(level == 0 && dump){
+	fprintf(stderr, "; IR\n");
+	dumpIr(stderr, ir);
+    }
+
+    while(level > 0 && rounds < OPTIMIZE_MAX_ROUNDS){
+	rounds++;
+	total = 0;
+
+	for(i = 0; i < NPASSES; i++){
+	    if(passes[i].level > level)
+		continue;
+
+	    if(dump){
+		fprintf(stderr, "; IR before %s, round %d\n", passes[i].name, rounds);
+		dumpIr(stderr, ir);
+	    }
+
+	    start = now();
+	    n     = passes[i].run(ir);
+	    passes[i].time    += now() - start;
+	    passes[i].runs    += 1;
+	    passes[i].changes += n;
+	    total             += n;
+
+	    if(dump){
+		fprintf(stderr, "; IR after %s, round %d\n", passes[i].name, rounds);
+		dumpIr(stderr, ir);
+	    }
+	}
+
+	if(total == 0 || level < 2)
+	    break;
+    }
+
+    if(!dump)
+	cacheStore(ir);
+
+    if(stats){
+	fprintf(stderr, "Optimizer at -O%d, %d rounds:\n", level, rounds);
+	fprintf(stderr, "    %-12s %6s %8s %10s\n", "pass", "runs", "changes", "time ms");
+	for(i = 0; i < NPASSES; i++)
+	    if(passes[i].level <= level)
+		fprintf(stderr, "    %-12s %6d %8d %10.3f\n", passes[i].name,
+			passes[i].runs, passes[i].changes, passes[i].time);
+	if(level >= 2)
+	    fprintf(stderr, "    %d evaluations of common subexpressions eliminated\n",
+		    eliminated);
+    }
+
+    if(report){
+	fprintf(stderr, "Range facts at -O%d:\n", level);
+	for(i = 0; i < nfacts; i++)
+	    fprintf(stderr, "    line %d: %s\n", facts[i].line, facts[i].text);
+    }
+}
+
+/*
+ * CONSTANT FOLDING ----------------------------------------------------
+ */
+
+static int fold(ir_program *ir){
+    changes   = 0;
+    ir->stmts = foldStmts(ir->stmts);
+
+    return changes;
+}
+
+/*
+ * Folds the expressions of the statement list and returns the new
+ * list. Asserts that always hold are removed and loops whose range
+ * is empty are replaced with the assignment of the control variable.
+ * Loops that run exactly once are unrolled. The statements after a statement that always fails are never
+ * executed and are removed.
+ */
+static ir_stmt *foldStmts(ir_stmt *stmt){
+    ir_stmt *head = stmt, **link = &head;
+
+    while((stmt = *link) != NULL){
+	if(stmt->expn  != NULL) stmt->expn  = foldExpression(stmt->expn);
+	if(stmt->expn2 != NULL) stmt->expn2 = foldExpression(stmt->expn2);
+	if(stmt->kind == IR_FOR)
+	    stmt->body = foldStmts(stmt->body);
+
+	if(stmt->kind == IR_ASSERT && stmt->expn->op == IR_CONST && stmt->expn->i == 1){
+	    *link      = stmt->next;
+	    stmt->next = NULL;
+	    freeIrStmts(stmt);
+	    changes++;
+	    continue;
+	}
+
+	if(stmt->kind == IR_FOR && stmt->expn->op == IR_CONST &&
+	   stmt->expn2->op == IR_CONST && stmt->expn->i > stmt->expn2->i){
+	    stmt->kind = IR_ASSIGN;
+	    freeIrExpr(stmt->expn2);
+	    freeIrStmts(stmt->body);
+	    stmt->expn2 = NULL;
+	    stmt->body  = NULL;
+	    changes++;
+	}
+
+	if(stmt->kind == IR_FOR && stmt->expn->op == IR_CONST &&
+	   stmt->expn2->op == IR_CONST && stmt->expn->i == stmt->expn2->i &&
+	   stmt->expn->i != INT_MAX){
+	    *link = stmt = unrollOnce(stmt);
+	    continue;
+	}
+
+	if(fails(stmt) && stmt->next != NULL){
+	    freeIrStmts(stmt->next);
+	    stmt->next = NULL;
+	    changes++;
+	}
+
+	link = &stmt->next;
+    }
+
+    return head;
+}
+
+/*
+ * Folds the operators whose operands are constants. The fault
+ * flags are computed again, because the divisor of a division
+ * may have become a constant.
+ */
+static ir_expr *foldExpression(ir_expr *expn){
+    ir_expr *l, *r;
+    char    *s = NULL;
+    int      v = 0;
+
+    if(expn->l != NULL) expn->l = foldExpression(expn->l);
+    if(expn->r != NULL) expn->r = foldExpression(expn->r);
+
+    l = expn->l;
+    r = expn->r;
+
+    if(expn->op == IR_NOT)
+	expn->fault = l->fault;
+    else if(r != NULL)
+	expn->fault = l->fault || r->fault ||
+	    (expn->op == IR_DIV && !expn->nonzero &&
+	     (r->op != IR_CONST || r->i == 0 || r->i == -1));
+
+    if(l == NULL || l->op != IR_CONST || (r != NULL && r->op != IR_CONST))
+	return expn;
+
+    if(l->lt == STRING){
+	switch(expn->op){
+	case IR_ADD:
+	    s = (char*)malloc(strlen(l->s) + strlen(r->s) +1);
+	    strcat(strcpy(s, l->s), r->s);
+	    break;
+	case IR_LESS: v = strcmp(l->s, r->s) < 0;  break;
+	case IR_EQ:   v = strcmp(l->s, r->s) == 0; break;
+	}
+    } else{
+	switch(expn->op){
+	case IR_NOT:  v = l->i ^ 1;                                   break;
+	case IR_ADD:  v = (int)((unsigned)l->i + (unsigned)r->i);     break;
+	case IR_SUB:  v = (int)((unsigned)l->i - (unsigned)r->i);     break;
+	case IR_MUL:  v = (int)((unsigned)l->i * (unsigned)r->i);     break;
+	case IR_AND:  v = l->i & r->i;                                break;
+	case IR_LESS: v = l->i < r->i;                                break;
+	case IR_EQ:   v = l->i == r->i;                               break;
+	case IR_MAX:  v = l->i > r->i ? l->i : r->i;                  break;
+	case IR_TRIPS:v = tripCount(l->i, r->i);                      break;
+	case IR_SUM:  v = rangeSum(l->i, r->i);                       break;
+	case IR_DIV:
+	    /* Division by zero fails and INT_MIN / -1 traps at runtime. */
+	    if(r->i == 0 || (l->i == INT_MIN && r->i == -1))
+		return expn;
+	    v = l->i / r->i;
+	    break;
+	}
+    }
+
+    freeIrExpr(l);
+    freeIrExpr(r);
+
+    expn->op    = IR_CONST;
+    expn->i     = v;
+    expn->s     = s;
+    expn->l     = NULL;
+    expn->r     = NULL;
+    expn->fault = 0;
+    changes++;
+
+    return expn;
+}
+
+/*
+ * Replaces the loop over the single value v with the statements
+ * i := v; <body>; i := v + 1 and returns the first of them.
+ */
+static ir_stmt *unrollOnce(ir_stmt *stmt){
+    ir_stmt *last = newIrStmt(IR_ASSIGN), **tail;
+
+    last->line = stmt->line;
+    last->lt   = stmt->lt;
+    last->slot = stmt->slot;
+    last->expn = constant(stmt->expn->i +1, stmt->line);
+    last->next = stmt->next;
+
+    for(tail = &stmt->body; *tail != NULL; tail = &(*tail)->next)
+	;
+    *tail = last;
+
+    stmt->kind = IR_ASSIGN;
+    stmt->next = stmt->body;
+    stmt->body = NULL;
+    freeIrExpr(stmt->expn2);
+    stmt->expn2 = NULL;
+    changes++;
+
+    return stmt;
+}
+
+static ir_expr *constant(int v, int line){
+    ir_expr *c = newIrExpr(IR_CONST);
+
+    c->lt   = INT;
+    c->line = line;
+    c->i    = v;
+
+    return c;
+}
+
+/* Returns 1 if the statement fails whenever it is executed. */
+static int fails(ir_stmt *stmt){
+    return stmt->kind == IR_TRAP ||
+	(stmt->kind == IR_ASSERT && stmt->expn->op == IR_CONST && stmt->expn->i != 1);
+}
+
+/*
+ * PARTIAL EVALUATION --------------------------------------------------
+ *
+ * The statements at the start of the program that do not depend on
+ * the input are executed at compile time. They are replaced with a
+ * print of the text they write and the declarations of the values
+ * they leave to the variables:
+ *
+ *     print "<output>";
+ *     var x : int := <value>;
+ *     ...
+ *
+ * A program that reads nothing becomes a single print. Statements are
+ * executed whole or not at all. The evaluation stops before the first
+ * read, before the first statement that would fail, and before the
+ * first statement that would exceed the budgets OPTIMIZE_PREFIX_STEPS
+ * and OPTIMIZE_PREFIX_OUTPUT. Such a statement is executed at runtime,
+ * so the output and the error messages come in the same order.
+ *
+ * The old values of the slots assigned by the statement being executed
+ * are kept in undo, to restore them if the statement stops.
+ */
+
+static int prefix(ir_program *ir){
+    ir_stmt *stmt, *head = NULL, **tail = &head, *tmp;
+    int      n = 0;
+
+    changes = 0;
+    values  = (int*)calloc(ir->nslots +1, sizeof(int));
+    strings = (char**)calloc(ir->nslots +1, sizeof(char*));
+    defined = (char*)calloc(ir->nslots +1, sizeof(char));
+    logged  = (int*)calloc(ir->nslots +1, sizeof(int));
+    output_size = output_previous = 0;
+
+    for(stmt = ir->stmts; stmt != NULL; stmt = stmt->next, n++){
+	epoch++;
+	if(!evaluateStmt(stmt)){
+	    rollback();
+	    break;
+	}
+	commit();
+    }
+
+    if(n > 0 && !residual(ir->stmts, n)){
+	if(output_size > 0){
+	    tmp       = newIrStmt(IR_PRINT);
+	    tmp->line = ir->stmts->line;
+	    tmp->lt   = STRING;
+	    tmp->expn = newIrExpr(IR_CONST);
+	    tmp->expn->lt   = STRING;
+	    tmp->expn->line = tmp->line;
+	    tmp->expn->s    = (char*)memcpy(malloc(output_size +1), output, output_size);
+	    tmp->expn->s[output_size] = '\0';
+	    *tail = tmp;
+	    tail  = &tmp->next;
+	}
+
+	for(int i = 0; i < ir->nslots; i++){
+	    if(!defined[i])
+		continue;
+
+	    tmp       = newIrStmt(IR_DECLARE);
+	    tmp->line = ir->stmts->line;
+	    tmp->lt   = ir->types[i];
+	    tmp->slot = i;
+	    tmp->expn = newIrExpr(IR_CONST);
+	    tmp->expn->lt   = ir->types[i];
+	    tmp->expn->line = tmp->line;
+	    if(ir->types[i] == STRING)
+		tmp->expn->s = strdup(strings[i]);
+	    else
+		tmp->expn->i = values[i];
+	    *tail = tmp;
+	    tail  = &tmp->next;
+	}
+
+	/* The evaluated statements end at the statement that stopped. */
+	for(tmp = ir->stmts; tmp->next != stmt; tmp = tmp->next)
+	    ;
+	tmp->next = NULL;
+	freeIrStmts(ir->stmts);
+
+	*tail     = stmt;
+	ir->stmts = head;
+	changes   = n;
+    }
+
+    for(int i = 0; i < ir->nslots; i++)
+	free(strings[i]);
+    free(values);
+    free(strings);
+    free(defined);
+    free(logged);
+    values  = NULL;
+    strings = NULL;
+    defined = NULL;
+    logged  = NULL;
+
+    return changes;
+}
+
+/*
+ * Returns 1 if the first n statements are already the result of the
+ * partial evaluation: a print of a string constant and declarations
+ * of constants in the order of the slots.
+ */
+static int residual(ir_stmt *stmt, int n){
+    int slot = -1;
+
+    if(stmt->kind == IR_PRINT && stmt->expn->op == IR_CONST && stmt->lt == STRING){
+	stmt = stmt->next;
+	n--;
+    }
+
+    for(; n > 0; stmt = stmt->next, n--){
+	if(stmt->kind != IR_DECLARE || stmt->expn->op != IR_CONST || stmt->slot <= slot)
+	    return 0;
+	slot = stmt->slot;
+    }
+
+    return 1;
+}
+
+/* Executes the statement. Returns 0 if the execution stopped. */
+static int evaluateStmt(ir_stmt *stmt){
+    int   v, start, end;
+    char *s = NULL, number[16];
+
+    if(++steps > OPTIMIZE_PREFIX_STEPS)
+	return 0;
+
+    switch(stmt->kind){
+    case IR_DECLARE:
+    case IR_ASSIGN:
+	if(!evaluate(stmt->expn, &v, &s))
+	    return 0;
+	store(stmt->slot, v, s);
+	return 1;
+    case IR_FOR:
+	if(!evaluate(stmt->expn, &start, NULL) || !evaluate(stmt->expn2, &end, NULL))
+	    return 0;
+
+	/* The loop to the largest integer never ends. */
+	if(end == INT_MAX)
+	    return 0;
+
+	for(v = start; v <= end; v++){
+	    store(stmt->slot, v, NULL);
+	    for(ir_stmt *tmp = stmt->body; tmp != NULL; tmp = tmp->next)
+		if(!evaluateStmt(tmp))
+		    return 0;
+	}
+	store(stmt->slot, v, NULL);
+	return 1;
+    case IR_PRINT:
+	if(!evaluate(stmt->expn, &v, &s))
+	    return 0;
+	if(s == NULL)
+	    sprintf(s = number, "%d", v);
+	v = append(s);
+	if(s != number)
+	    free(s);
+	return v;
+    case IR_ASSERT:
+	return evaluate(stmt->expn, &v, NULL) && v == 1;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * Computes the value of the expression to *v, or to *s if it is a
+ * string. The string is allocated. Returns 0 if the evaluation fails
+ * or reads a variable that has no value yet.
+ */
+static int evaluate(ir_expr *expn, int *v, char **s){
+    int   l, r;
+    char *ls, *rs;
+
+    switch(expn->op){
+    case IR_CONST:
+	if(expn->lt == STRING)
+	    *s = strdup(expn->s);
+	else
+	    *v = expn->i;
+	return 1;
+    case IR_VAR:
+	if(!defined[expn->slot])
+	    return 0;
+	if(expn->lt == STRING)
+	    *s = strdup(strings[expn->slot]);
+	else
+	    *v = values[expn->slot];
+	return 1;
+    case IR_NOT:
+	if(!evaluate(expn->l, &l, NULL))
+	    return 0;
+	*v = l ^ 1;
+	return 1;
+    }
+
+    if(expn->l->lt == STRING){
+	if(!evaluate(expn->r, NULL, &rs))
+	    return 0;
+	if(!evaluate(expn->l, NULL, &ls)){
+	    free(rs);
+	    return 0;
+	}
+
+	switch(expn->op){
+	case IR_ADD:
+	    *s = (char*)realloc(ls, strlen(ls) + strlen(rs) +1);
+	    strcat(*s, rs);
+	    ls = NULL;
+	    break;
+	case IR_LESS: *v = strcmp(ls, rs) < 0;  break;
+	case IR_EQ:   *v = strcmp(ls, rs) == 0; break;
+	}
+
+	free(ls);
+	free(rs);
+	return 1;
+    }
+
+    if(!evaluate(expn->r, &r, NULL) || !evaluate(expn->l, &l, NULL))
+	return 0;
+
+    switch(expn->op){
+    case IR_ADD:   *v = (int)((unsigned)l + (unsigned)r);  break;
+    case IR_SUB:   *v = (int)((unsigned)l - (unsigned)r);  break;
+    case IR_MUL:   *v = (int)((unsigned)l * (unsigned)r);  break;
+    case IR_AND:   *v = l & r;                             break;
+    case IR_LESS:  *v = l < r;                             break;
+    case IR_EQ:    *v = l == r;                            break;
+    case IR_MAX:   *v = l > r ? l : r;                     break;
+    case IR_TRIPS: *v = tripCount(l, r);                   break;
+    case IR_SUM:   *v = rangeSum(l, r);                    break;
+    case IR_DIV:
+	if(r == 0 || (l == INT_MIN && r == -1))
+	    return 0;
+	*v = l / r;
+	break;
+    }
+
+    return 1;
+}
+
+/*
+ * Assigns the value to the slot. The old value is saved to undo
+ * when the slot is first assigned by the current statement.
+ */
+static void store(int slot, int v, char *s){
+    if(logged[slot] != epoch){
+	logged[slot] = epoch;
+	if(undo_size == undo_capacity)
+	    undo = (undo_entry*)realloc(undo, sizeof(undo_entry) *
+					(undo_capacity = 2 * undo_capacity + 16));
+	undo[undo_size].slot    = slot;
+	undo[undo_size].defined = defined[slot];
+	undo[undo_size].i       = values[slot];
+	undo[undo_size].s       = strings[slot];
+	undo_size++;
+    } else
+	free(strings[slot]);
+
+    defined[slot] = 1;
+    values[slot]  = v;
+    strings[slot] = s;
+}
+
+/* Appends the string to the output. Returns 0 if it does not fit. */
+static int append(char *s){
+    int n = strlen(s);
+
+    if(output_size + n > OPTIMIZE_PREFIX_OUTPUT)
+	return 0;
+
+    if(output_size + n > output_capacity)
+	output = (char*)realloc(output, output_capacity = 2 * (output_size + n));
+    memcpy(output + output_size, s, n);
+    output_size += n;
+
+    return 1;
+}
+
+/* Keeps the values assigned by the current statement. */
+static void commit(void){
+    for(int k = 0; k < undo_size; k++)
+	free(undo[k].s);
+
+    undo_size       = 0;
+    output_previous = output_size;
+}
+
+/* Restores the values and the output before the current statement. */
+static void rollback(void){
+    for(int k = undo_size -1; k >= 0; k--){
+	free(strings[undo[k].slot]);
+	defined[undo[k].slot] = undo[k].defined;
+	values[undo[k].slot]  = undo[k].i;
+	strings[undo[k].slot] = undo[k].s;
+    }
+
+    undo_size   = 0;
+    output_size = output_previous;
+}
+
+/*
+ * CONSTANT PROPAGATION ------------------------------------------------
+ */
+
+static int propagate(ir_program *ir){
+    changes = 0;
+    known   = (ir_expr**)calloc(ir->nslots +1, sizeof(ir_expr*));
+
+    propagateStmts(ir->stmts);
+
+    free(known);
+    known = NULL;
+
+    return changes;
+}
+
+/*
+ * Replaces the variables whose value is known with constants and
+ * folds the expressions. A variable is known after a constant is
+ * assigned to it until it is assigned again. The variables written
+ * in a loop are not known in the loop nor after it.
+ */
+static void propagateStmts(ir_stmt *stmt){
+    size_t    size = sizeof(ir_expr*) * (program->nslots +1);
+    ir_expr **saved;
+    char     *written;
+
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->expn  != NULL) stmt->expn  = foldExpression(substitute(stmt->expn));
+	if(stmt->expn2 != NULL) stmt->expn2 = foldExpression(substitute(stmt->expn2));
+
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	    known[stmt->slot] = stmt->expn->op == IR_CONST ? stmt->expn : NULL;
+	    break;
+	case IR_READ:
+	    known[stmt->slot] = NULL;
+	    break;
+	case IR_FOR:
+	    written = (char*)calloc(program->nslots +1, sizeof(char));
+	    written[stmt->slot] = 1;
+	    writtenSlots(stmt->body, written);
+	    for(int i = 0; i < program->nslots; i++)
+		if(written[i])
+		    known[i] = NULL;
+
+	    saved = (ir_expr**)memcpy(malloc(size), known, size);
+	    propagateStmts(stmt->body);
+	    memcpy(known, saved, size);
+
+	    free(saved);
+	    free(written);
+	    break;
+	}
+    }
+}
+
+static ir_expr *substitute(ir_expr *expn){
+    ir_expr *c;
+
+    if(expn->op == IR_VAR && known[expn->slot] != NULL){
+	c       = copyIrExpr(known[expn->slot]);
+	c->line = expn->line;
+	freeIrExpr(expn);
+	changes++;
+	return c;
+    }
+
+    if(expn->l != NULL) expn->l = substitute(expn->l);
+    if(expn->r != NULL) expn->r = substitute(expn->r);
+
+    return expn;
+}
+
+/* Marks the slots the statements assign or read to. */
+static void writtenSlots(ir_stmt *stmt, char *written){
+    for(; stmt != NULL; stmt = stmt->next){
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	case IR_READ:
+	    written[stmt->slot] = 1;
+	    break;
+	case IR_FOR:
+	    written[stmt->slot] = 1;
+	    writtenSlots(stmt->body, written);
+	    break;
+	}
+    }
+}
+
+/*
+ * RANGE ANALYSIS ------------------------------------------------------
+ *
+ * The interval of the values of every integer and boolean variable
+ * is computed forwards through the program. The intervals are kept
+ * as 64 bit numbers, so that an operation whose result may wrap
+ * around is seen and gives the interval of all the integers.
+ *
+ * Asserts whose condition is proven always true are removed, and the
+ * divisions whose divisor is proven never to be zero are marked with
+ * nonzero, so the engines drop the check. An assert that holds is a
+ * fact too, so the variables of its condition are narrowed after it.
+ *
+ * A loop body is analysed once. The variables the loop assigns get
+ * the interval of all their values on entry to the body, except the
+ * control variable which gets the range of the loop.
+ */
+
+static int ranges(ir_program *ir){
+    interval *state = (interval*)malloc(sizeof(interval) * (ir->nslots +1));
+
+    changes = 0;
+    for(int i = 0; i < ir->nslots; i++)
+	state[i] = top(i);
+
+    rangeStmts(&ir->stmts, state);
+
+    free(state);
+    return changes;
+}
+
+static void rangeStmts(ir_stmt **list, interval *state){
+    size_t    size = sizeof(interval) * (program->nslots +1);
+    ir_stmt  *stmt;
+    interval  s, e, *body;
+    char     *written;
+
+    while((stmt = *list) != NULL){
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	    s = rangeExpr(stmt->expn, state);
+	    if(stmt->lt != STRING)
+		state[stmt->slot] = s;
+	    break;
+	case IR_READ:
+	    state[stmt->slot] = top(stmt->slot);
+	    break;
+	case IR_PRINT:
+	    rangeExpr(stmt->expn, state);
+	    break;
+	case IR_ASSERT:
+	    s = rangeExpr(stmt->expn, state);
+	    if(stmt->expn->lt == BOOL && !stmt->expn->fault && s.lo == 1){
+		fact(stmt->line, "assert always holds, removed");
+		*list      = stmt->next;
+		stmt->next = NULL;
+		freeIrStmts(stmt);
+		changes++;
+		continue;
+	    }
+	    if(stmt->expn->lt == BOOL && !stmt->expn->fault && s.hi == 0)
+		fact(stmt->line, "assert always fails");
+	    refine(stmt->expn, 1, state);
+	    break;
+	case IR_FOR:
+	    s = rangeExpr(stmt->expn,  state);
+	    e = rangeExpr(stmt->expn2, state);
+
+	    written = (char*)calloc(program->nslots +1, sizeof(char));
+	    writtenSlots(stmt->body, written);
+
+	    /* The body is never run if the range is always empty. */
+	    if(s.lo <= e.hi){
+		body = (interval*)memcpy(malloc(size), state, size);
+		for(int i = 0; i < program->nslots; i++)
+		    if(written[i])
+			body[i] = top(i);
+		body[stmt->slot].lo = s.lo;
+		body[stmt->slot].hi = e.hi;
+
+		rangeStmts(&stmt->body, body);
+
+		for(int i = 0; i < program->nslots; i++)
+		    if(written[i])
+			state[i] = join(state[i], body[i]);
+		free(body);
+	    }
+	    free(written);
+
+	    /* After the loop the control variable is max(start, end + 1). */
+	    if(e.hi == INT_MAX)
+		state[stmt->slot] = top(stmt->slot);
+	    else{
+		state[stmt->slot].lo = s.lo > e.lo +1 ? s.lo : e.lo +1;
+		state[stmt->slot].hi = s.hi > e.hi +1 ? s.hi : e.hi +1;
+	    }
+	    break;
+	}
+
+	list = &stmt->next;
+    }
+}
+
+/*
+ * Returns the interval of the values of the expression. The fault
+ * flags are computed again, because a division that can not fail
+ * anymore makes the expressions around it safe too.
+ */
+static interval rangeExpr(ir_expr *expn, interval *state){
+    interval l = {0, 0}, r = {0, 0}, v;
+
+    if(expn->l != NULL) l = rangeExpr(expn->l, state);
+    if(expn->r != NULL) r = rangeExpr(expn->r, state);
+
+    if(expn->op == IR_DIV && !expn->nonzero && expn->r->op != IR_CONST &&
+       !expn->r->fault && (r.lo > 0 || r.hi < -1)){
+	fact(expn->line, "divisor is never zero, check removed");
+	expn->nonzero = 1;
+	changes++;
+    }
+
+    if(expn->op == IR_DIV && r.lo == 0 && r.hi == 0 &&
+       !expn->l->fault && !expn->r->fault)
+	fact(expn->line, "division is always by zero");
+
+    if(expn->op == IR_NOT)
+	expn->fault = expn->l->fault;
+    else if(expn->r != NULL)
+	expn->fault = expn->l->fault || expn->r->fault ||
+	    (expn->op == IR_DIV && !expn->nonzero &&
+	     (expn->r->op != IR_CONST || expn->r->i == 0 || expn->r->i == -1));
+
+    if(expn->lt == STRING)
+	return (interval){0, 0};
+    if(expn->l != NULL && expn->l->lt == STRING)
+	return (interval){0, 1};
+
+    switch(expn->op){
+    case IR_CONST: v.lo = v.hi = expn->i;                    break;
+    case IR_VAR:   v = state[expn->slot];                    break;
+    case IR_NOT:   v.lo = 1 - l.hi; v.hi = 1 - l.lo;        break;
+    case IR_ADD:   v.lo = l.lo + r.lo; v.hi = l.hi + r.hi;   break;
+    case IR_SUB:   v.lo = l.lo - r.hi; v.hi = l.hi - r.lo;   break;
+    case IR_MUL:   v = corners(l, r, IR_MUL);                break;
+    case IR_AND:   v.lo = l.lo & r.lo; v.hi = l.hi & r.hi;   break;
+    case IR_MAX:
+	v.lo = l.lo > r.lo ? l.lo : r.lo;
+	v.hi = l.hi > r.hi ? l.hi : r.hi;
+	break;
+    case IR_LESS:
+	v.lo = l.hi < r.lo;
+	v.hi = l.lo < r.hi;
+	break;
+    case IR_EQ:
+	v.lo = l.lo == l.hi && r.lo == r.hi && l.lo == r.lo;
+	v.hi = l.lo <= r.hi && r.lo <= l.hi;
+	break;
+    case IR_DIV:
+	/* The quotient is taken over both signs of the divisor. */
+	if(l.lo <= INT_MIN && r.lo <= -1 && r.hi >= -1)
+	    return integers;
+	if(r.lo > 0 || r.hi < 0)
+	    v = corners(l, r, IR_DIV);
+	else if(r.lo < 0 && r.hi > 0)
+	    v = join(corners(l, (interval){r.lo, -1}, IR_DIV),
+		     corners(l, (interval){1, r.hi}, IR_DIV));
+	else if(r.hi > 0)
+	    v = corners(l, (interval){1, r.hi}, IR_DIV);
+	else if(r.lo < 0)
+	    v = corners(l, (interval){r.lo, -1}, IR_DIV);
+	else
+	    v = l;
+	break;
+    default:
+	return integers;
+    }
+
+    if(v.lo < INT_MIN || v.hi > INT_MAX)
+	return integers;
+
+    return v;
+}
+
+/* Narrows the intervals of the variables if expn has the value truth. */
+static void refine(ir_expr *expn, int truth, interval *state){
+    ir_expr  *l = expn->l, *r = expn->r;
+    interval  a, b;
+
+    switch(expn->op){
+    case IR_VAR:
+	narrow(state, expn->slot, truth, truth);
+	break;
+    case IR_NOT:
+	refine(l, !truth, state);
+	break;
+    case IR_AND:
+	if(truth){
+	    refine(l, 1, state);
+	    refine(r, 1, state);
+	}
+	break;
+    case IR_LESS:
+	if(l->lt == STRING)
+	    break;
+	a = rangeExpr(l, state);
+	b = rangeExpr(r, state);
+	/* l < r if truth is set and l >= r otherwise. */
+	if(l->op == IR_VAR)
+	    narrow(state, l->slot, truth ? INT_MIN : b.lo, truth ? b.hi -1 : INT_MAX);
+	if(r->op == IR_VAR)
+	    narrow(state, r->slot, truth ? a.lo +1 : INT_MIN, truth ? INT_MAX : a.hi);
+	break;
+    case IR_EQ:
+	if(l->lt == STRING || !truth)
+	    break;
+	a = rangeExpr(l, state);
+	b = rangeExpr(r, state);
+	if(l->op == IR_VAR)
+	    narrow(state, l->slot, b.lo, b.hi);
+	if(r->op == IR_VAR)
+	    narrow(state, r->slot, a.lo, a.hi);
+	break;
+    }
+}
+
+/* Narrows the interval of the slot to lo..hi, unless it would be empty. */
+static void narrow(interval *state, int slot, long long lo, long long hi){
+    if(lo < state[slot].lo) lo = state[slot].lo;
+    if(hi > state[slot].hi) hi = state[slot].hi;
+
+    if(lo <= hi){
+	state[slot].lo = lo;
+	state[slot].hi = hi;
+    }
+}
+
+/* The interval of all the values of the slot. */
+static interval top(int slot){
+    return program->types[slot] == BOOL ? (interval){0, 1} : integers;
+}
+
+static interval join(interval a, interval b){
+    if(b.lo < a.lo) a.lo = b.lo;
+    if(b.hi > a.hi) a.hi = b.hi;
+
+    return a;
+}
+
+/*
+ * The extremes of a product, and of a quotient whose divisor does
+ * not change sign, are found at the corners of the intervals.
+ */
+static interval corners(interval l, interval r, ir_op op){
+    long long c[4];
+    interval  v;
+
+    if(op == IR_MUL){
+	c[0] = l.lo * r.lo; c[1] = l.lo * r.hi;
+	c[2] = l.hi * r.lo; c[3] = l.hi * r.hi;
+    } else{
+	c[0] = l.lo / r.lo; c[1] = l.lo / r.hi;
+	c[2] = l.hi / r.lo; c[3] = l.hi / r.hi;
+    }
+
+    v.lo = v.hi = c[0];
+    for(int i = 1; i < 4; i++){
+	if(c[i] < v.lo) v.lo = c[i];
+	if(c[i] > v.hi) v.hi = c[i];
+    }
+
+    return v;
+}
+
+/*
+ * Records a fact for the report. The facts are kept in the order
+ * of the lines and each of them only once, although the pass runs
+ * in every round of the pipeline.
+ */
+static void fact(int line, char *text){
+    int i, k;
+
+    if(!report)
+	return;
+
+    for(i = 0; i < nfacts && facts[i].line <= line; i++)
+	if(facts[i].line == line && strcmp(facts[i].text, text) == 0)
+	    return;
+
+    if(nfacts == facts_capacity){
+	facts_capacity = facts_capacity ? 2 * facts_capacity : 16;
+	facts = (range_fact*)realloc(facts, sizeof(range_fact) * facts_capacity);
+    }
+
+    for(k = nfacts++; k > i; k--)
+	facts[k] = facts[k -1];
+    facts[i].line = line;
+    facts[i].text = text;
+}
+
+/*
+ * LOOP INVARIANT CODE MOTION ------------------------------------------
+ *
+ * The subexpressions of a loop body that read no variable assigned
+ * in the loop are computed once before the loop into hidden
+ * temporaries. Only the expressions that can not fail are hoisted,
+ * so a loop that runs zero times or fails before reaching the
+ * expression reports the same errors as before.
+ *
+ * The inner loops are handled first. The assignments of the hidden
+ * temporaries they leave at the top level of the outer body are
+ * hoisted again if they are invariant in the outer loop too.
+ */
+
+static int hoist(ir_program *ir){
+    changes = 0;
+    written = (char*)malloc(ir->nslots +1);
+
+    hoistStmts(&ir->stmts);
+
+    free(written);
+    written = NULL;
+
+    return changes;
+}
+
+static void hoistStmts(ir_stmt **list){
+    ir_stmt **link, *stmt;
+
+    for(link = list; (stmt = *link) != NULL; link = &stmt->next)
+	if(stmt->kind == IR_FOR){
+	    hoistLoop(link);
+	    while(*link != stmt)
+		link = &(*link)->next;
+	}
+}
+
+/*
+ * Hoists the invariant code of the loop **link. The hoisted
+ * statements are inserted before the loop at *link.
+ */
+static void hoistLoop(ir_stmt **link){
+    ir_stmt *stmt = *link, **body, *tmp;
+
+    hoistStmts(&stmt->body);
+
+    written = (char*)realloc(written, program->nslots +1);
+    memset(written, 0, program->nslots +1);
+    written[stmt->slot] = 1;
+    writtenSlots(stmt->body, written);
+
+    loop      = stmt;
+    preheader = link;
+    hoisted   = link;
+
+    /* The hidden temporaries are assigned once, before they are read. */
+    for(body = &stmt->body; (tmp = *body) != NULL; ){
+	if(tmp->kind == IR_ASSIGN && hidden(tmp->slot) &&
+	   !tmp->expn->fault && !reads(tmp->expn, written)){
+	    *body     = tmp->next;
+	    tmp->next = stmt;
+	    *hoisted  = tmp;
+	    hoisted   = &tmp->next;
+	    written[tmp->slot] = 0;
+	    changes++;
+	} else
+	    body = &tmp->next;
+    }
+
+    for(tmp = stmt->body; tmp != NULL; tmp = tmp->next){
+	if(tmp->expn  != NULL && invariant(&tmp->expn))  hoistExpr(&tmp->expn);
+	if(tmp->expn2 != NULL && invariant(&tmp->expn2)) hoistExpr(&tmp->expn2);
+    }
+}
+
+/*
+ * Returns 1 if the expression is invariant in the loop and can
+ * not fail. Otherwise the largest such subexpressions are hoisted.
+ * The maximum is made only for the ranges of the loops that run at
+ * most once, see closeLoop(), and is kept there to be recognized.
+ */
+static int invariant(ir_expr **expn){
+    ir_expr *e = *expn;
+    int      l, r;
+
+    if(e->op == IR_CONST)
+	return 1;
+    if(e->op == IR_VAR)
+	return !written[e->slot];
+
+    l = invariant(&e->l);
+    r = e->r == NULL || invariant(&e->r);
+
+    if(l && r && !e->fault && e->op != IR_MAX)
+	return 1;
+
+    if(l)                  hoistExpr(&e->l);
+    if(r && e->r != NULL)  hoistExpr(&e->r);
+
+    return 0;
+}
+
+/*
+ * Replaces the invariant expression with a hidden temporary that
+ * is assigned before the loop. An expression that was hoisted from
+ * the same loop already shares its temporary. Constants and
+ * variables are left in place, and of an expression that can fail
+ * only the operands are hoisted.
+ */
+static void hoistExpr(ir_expr **expn){
+    ir_expr *e = *expn, *v;
+    ir_stmt *tmp;
+    char     name[32];
+
+    if(e->op == IR_CONST || e->op == IR_VAR)
+	return;
+
+    if(e->fault){
+	if(e->l != NULL) hoistExpr(&e->l);
+	if(e->r != NULL) hoistExpr(&e->r);
+	return;
+    }
+
+    for(tmp = *preheader; tmp != loop; tmp = tmp->next)
+	if(sameExpr(tmp->expn, e))
+	    break;
+
+    if(tmp == loop){
+	sprintf(name, "$t%d", temps++);
+	tmp       = newIrStmt(IR_ASSIGN);
+	tmp->line = loop->line;
+	tmp->lt   = e->lt;
+	tmp->slot = newSlot(program, name, e->lt);
+	tmp->expn = e;
+	tmp->next = loop;
+	*hoisted  = tmp;
+	hoisted   = &tmp->next;
+    } else
+	freeIrExpr(e);
+
+    v       = newIrExpr(IR_VAR);
+    v->lt   = tmp->lt;
+    v->line = loop->line;
+    v->slot = tmp->slot;
+    *expn   = v;
+    changes++;
+}
+
+/*
+ * The hidden temporaries of the optimizer have names that start
+ * with $, which no variable of a program can have.
+ */
+static int hidden(int slot){
+    return program->names[slot][0] == '$';
+}
+
+static int sameExpr(ir_expr *a, ir_expr *b){
+    if(a->op != b->op || a->lt != b->lt)
+	return 0;
+
+    switch(a->op){
+    case IR_CONST:
+	return a->lt == STRING ? strcmp(a->s, b->s) == 0 : a->i == b->i;
+    case IR_VAR:
+	return a->slot == b->slot;
+    case IR_NOT:
+	return sameExpr(a->l, b->l);
+    default:
+	return sameExpr(a->l, b->l) && sameExpr(a->r, b->r);
+    }
+}
+
+/*
+ * COMMON SUBEXPRESSIONS -----------------------------------------------
+ *
+ * An expression that was already computed by an earlier statement of
+ * the same statement list, with none of the variables it reads
+ * assigned since then, is not computed again. The first computation
+ * is moved to a hidden temporary that is assigned right before its
+ * statement, and both places read the temporary:
+ *
+ *     a := (b * c) + 1;           $t0 := (b * c);
+ *     print (b * c);      ==>     a := ($t0 + 1);
+ *                                 print $t0;
+ *
+ * Each statement list, the program and every loop body, is numbered
+ * on its own, so no value is carried into or out of a loop. Only the
+ * expressions that can not fail are shared, and the largest shared
+ * expression is taken. A value may also be shared within a statement. At most OPTIMIZE_CSE_ENTRIES expressions are
+ * remembered at a time, the oldest are forgotten first.
+ */
+
+static int commonExprs(ir_program *ir){
+    changes = 0;
+
+    cseStmts(&ir->stmts);
+
+    eliminated += changes;
+    return changes;
+}
+
+static void cseStmts(ir_stmt **list){
+    cse_entry *table = (cse_entry*)malloc(sizeof(cse_entry) * OPTIMIZE_CSE_ENTRIES);
+    int        n = 0, k, j;
+    ir_stmt  **link, *stmt;
+    char      *slots;
+
+    for(link = list; (stmt = *link) != NULL; link = &stmt->next){
+	if(stmt->expn  != NULL) number(&stmt->expn,  link, stmt, table, &n);
+	if(stmt->expn2 != NULL) number(&stmt->expn2, link, stmt, table, &n);
+
+	/*
+	 * The values that read the assigned variables are forgotten,
+	 * and so are the temporaries assigned again.
+	 */
+	slots = (char*)calloc(program->nslots +1, sizeof(char));
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	case IR_READ:
+	    slots[stmt->slot] = 1;
+	    break;
+	case IR_FOR:
+	    slots[stmt->slot] = 1;
+	    writtenSlots(stmt->body, slots);
+	    break;
+	}
+
+	for(k = j = 0; k < n; k++)
+	    if(!reads(*table[k].where, slots) &&
+	       (table[k].slot < 0 || !slots[table[k].slot] || table[k].at == link))
+		table[j++] = table[k];
+	n = j;
+	free(slots);
+
+	if(stmt->kind == IR_FOR)
+	    cseStmts(&stmt->body);
+    }
+
+    free(table);
+}
+
+/*
+ * Numbers the expression *expn of the statement stmt at *at. The largest
+ * subexpressions found in the table are replaced with the temporaries
+ * holding their values, and the others are added to the table. The
+ * expression is looked up again after its operands, because they may
+ * have been replaced with the same temporaries as in the table.
+ */
+static void number(ir_expr **expn, ir_stmt **at, ir_stmt *stmt, cse_entry *table, int *n){
+    ir_expr *e = *expn;
+
+    if(e->op == IR_CONST || e->op == IR_VAR)
+	return;
+
+    if(shared(e) && reuse(expn, table, *n))
+	return;
+
+    if(e->r != NULL) number(&e->r, at, stmt, table, n);
+    number(&e->l, at, stmt, table, n);
+
+    if(!shared(e) || reuse(expn, table, *n))
+	return;
+
+    if(*n == OPTIMIZE_CSE_ENTRIES){
+	memmove(table, table +1, sizeof(cse_entry) * (*n -1));
+	(*n)--;
+    }
+
+    /* The value of a whole assignment of a temporary is there already. */
+    table[*n].where = expn;
+    table[*n].at    = at;
+    table[*n].stmt  = stmt;
+    table[*n].slot  = -1;
+    if(expn == &stmt->expn && stmt->kind == IR_ASSIGN && hidden(stmt->slot))
+	table[*n].slot = stmt->slot;
+    (*n)++;
+}
+
+/*
+ * Replaces the expression with the temporary of the same expression
+ * in the table. The first computation is moved to a new temporary
+ * when it is shared for the first time. Returns 0 if the expression
+ * is not in the table.
+ */
+static int reuse(ir_expr **expn, cse_entry *table, int n){
+    ir_expr  *e = *expn, *v;
+    ir_stmt  *tmp, **link, **last;
+    char      name[32];
+    int       k;
+
+    for(k = 0; k < n; k++)
+	if(sameExpr(*table[k].where, e))
+	    break;
+
+    if(k == n)
+	return 0;
+
+    if(table[k].slot < 0){
+	/*
+	 * The temporaries of the statement are before it. The new one
+	 * goes after those it reads.
+	 */
+	last = table[k].at;
+	for(link = table[k].at; *link != table[k].stmt; link = &(*link)->next)
+	    if(readsSlot(*table[k].where, (*link)->slot))
+		last = &(*link)->next;
+
+	sprintf(name, "$t%d", temps++);
+	tmp       = newIrStmt(IR_ASSIGN);
+	tmp->line = table[k].stmt->line;
+	tmp->lt   = e->lt;
+	tmp->slot = newSlot(program, name, e->lt);
+	tmp->expn = *table[k].where;
+	tmp->next = *last;
+	*last     = tmp;
+
+	v       = newIrExpr(IR_VAR);
+	v->lt   = tmp->lt;
+	v->line = tmp->expn->line;
+	v->slot = tmp->slot;
+
+	*table[k].where = v;
+	table[k].where  = &tmp->expn;
+	table[k].slot   = tmp->slot;
+    }
+
+    v       = newIrExpr(IR_VAR);
+    v->lt   = e->lt;
+    v->line = e->line;
+    v->slot = table[k].slot;
+    freeIrExpr(e);
+    *expn   = v;
+    changes++;
+
+    return 1;
+}
+
+/*
+ * Returns 1 if the value of the expression may be shared. The maximum
+ * of the ranges of the loops that run at most once is kept in place,
+ * see closeLoop().
+ */
+static int shared(ir_expr *expn){
+    return !expn->fault && expn->op != IR_MAX;
+}
+
+/*
+ * CLOSED FORMS --------------------------------------------------------
+ *
+ * A loop whose body has no side effects other than assignments is
+ * replaced with its result. The statements of such a body must be
+ * of two kinds:
+ *
+ *     Accumulations x := x + e and x := x - e of an integer, where e
+ *     is affine in the control variable i, a * i + b, and reads no
+ *     other variable assigned in the loop. After the loop x has been
+ *     increased by a * sum(s, e) + b * trips(s, e) modulo 2^32.
+ *     A variable may be accumulated by several statements.
+ *
+ *     Final values: assignments that read no variable assigned in
+ *     the loop other than i and the hidden temporaries assigned
+ *     before them in the body, and inner loops that read none of them,
+ *     not even i. Such a statement leaves the same values after every
+ *     round, so only the last round matters. No other statement may
+ *     assign the variables of a final value.
+ *
+ * The accumulations are computed before the loop, and the loop is
+ * changed to run only its last round over the final values:
+ *
+ *     for i in max(s, e)..e do <final values> end for
+ *
+ * which also leaves i with the value it would have after the whole
+ * loop. A loop that runs endlessly, because its end is the largest
+ * integer, still does. No statement of the body can fail, so nothing
+ * is reported differently.
+ */
+
+static int closedForms(ir_program *ir){
+    changes = 0;
+    written = (char*)malloc(ir->nslots +1);
+
+    closeStmts(&ir->stmts);
+
+    free(written);
+    written = NULL;
+
+    return changes;
+}
+
+static void closeStmts(ir_stmt **list){
+    ir_stmt **link, *stmt;
+
+    for(link = list; (stmt = *link) != NULL; link = &stmt->next)
+	if(stmt->kind == IR_FOR){
+	    closeStmts(&stmt->body);
+	    closeLoop(link);
+	    while(*link != stmt)
+		link = &(*link)->next;
+	}
+}
+
+/*
+ * Replaces the loop **link with its closed form if it has one. The
+ * accumulations and the hidden temporaries of the range are inserted
+ * before the loop at *link.
+ */
+static void closeLoop(ir_stmt **link){
+    ir_stmt  *stmt = *link, *tmp, **body, *finals = NULL, **last = &finals;
+    ir_expr  *start, *end, *a, *b, *e, **defs, **forms;
+    int      *owner, n = 0, k, ok = 1;
+
+    if(stmt->expn->fault || stmt->expn2->fault || once(stmt))
+	return;
+
+    memset(written, 0, program->nslots +1);
+    writtenSlots(stmt->body, written);
+    if(written[stmt->slot])
+	return;
+
+    for(tmp = stmt->body; tmp != NULL; tmp = tmp->next)
+	n++;
+
+    /*
+     * The expressions of the assignments are checked with the hidden
+     * temporaries assigned earlier in the body replaced by their values.
+     */
+    owner = (int*)calloc(program->nslots +1, sizeof(int));
+    defs  = (ir_expr**)calloc(program->nslots +1, sizeof(ir_expr*));
+    forms = (ir_expr**)calloc(n +1, sizeof(ir_expr*));
+
+    for(tmp = stmt->body, k = 0; tmp != NULL && ok; tmp = tmp->next, k++){
+	if(tmp->kind == IR_ASSIGN)
+	    forms[k] = expand(copyIrExpr(tmp->expn), defs);
+
+	if(accumulator(tmp, forms[k], stmt->slot))
+	    ok = claim(tmp, owner, -1);
+	else if(tmp->kind == IR_ASSIGN){
+	    ok = !forms[k]->fault && !reads(forms[k], written) && claim(tmp, owner, k +1);
+	    if(ok && hidden(tmp->slot))
+		defs[tmp->slot] = forms[k];
+	} else{
+	    written[stmt->slot] = 1;
+	    ok = final(tmp) && claim(tmp, owner, k +1);
+	    written[stmt->slot] = 0;
+	}
+    }
+
+    if(ok){
+	loop      = stmt;
+	preheader = link;
+	hoisted   = link;
+
+	start = bound(stmt->expn);
+	end   = bound(stmt->expn2);
+
+	for(body = &stmt->body, k = 0; (tmp = *body) != NULL; k++){
+	    *body     = tmp->next;
+	    tmp->next = NULL;
+
+	    if(!accumulator(tmp, forms[k], stmt->slot)){
+		*last = tmp;
+		last  = &tmp->next;
+		continue;
+	    }
+
+	    e = forms[k]->l->op == IR_VAR && forms[k]->l->slot == tmp->slot ?
+		forms[k]->r : forms[k]->l;
+	    coefficients(e, stmt->slot, &a, &b);
+
+	    e = arith(IR_MUL, a, arith(IR_SUM, copyIrExpr(start), copyIrExpr(end)));
+	    e = arith(IR_ADD, e, arith(IR_MUL, b, arith(IR_TRIPS, copyIrExpr(start), copyIrExpr(end))));
+
+	    freeIrExpr(tmp->expn);
+	    tmp->expn = arith(forms[k]->op, variable(tmp->slot), e);
+
+	    tmp->next = stmt;
+	    *hoisted  = tmp;
+	    hoisted   = &tmp->next;
+	}
+
+	e = arith(IR_MAX, start, copyIrExpr(end));
+	freeIrExpr(stmt->expn);
+	freeIrExpr(stmt->expn2);
+	stmt->expn  = e;
+	stmt->expn2 = end;
+	stmt->body  = finals;
+	changes++;
+    }
+
+    for(k = 0; k < n; k++)
+	if(forms[k] != NULL)
+	    freeIrExpr(forms[k]);
+    free(forms);
+    free(defs);
+    free(owner);
+}
+
+/* Replaces the variables that have an expression in defs with it. */
+static ir_expr *expand(ir_expr *expn, ir_expr **defs){
+    ir_expr *c;
+
+    if(expn->op == IR_VAR && defs[expn->slot] != NULL){
+	c = copyIrExpr(defs[expn->slot]);
+	freeIrExpr(expn);
+	return c;
+    }
+
+    if(expn->l != NULL) expn->l = expand(expn->l, defs);
+    if(expn->r != NULL) expn->r = expand(expn->r, defs);
+
+    return expn;
+}
+
+/* Returns 1 if the loop runs at most once. */
+static int once(ir_stmt *stmt){
+    ir_expr *s = stmt->expn, *e = stmt->expn2;
+
+    if(s->op == IR_CONST && e->op == IR_CONST)
+	return s->i >= e->i;
+
+    return s->op == IR_MAX && sameExpr(s->r, e);
+}
+
+/*
+ * Marks the slots the statement assigns with id in owner. Returns
+ * 0 if a slot was assigned by another statement already. All the
+ * accumulations share the id -1.
+ */
+static int claim(ir_stmt *stmt, int *owner, int id){
+    ir_stmt *tmp;
+
+    if(stmt->kind != IR_ASSIGN && stmt->kind != IR_FOR)
+	return 0;
+
+    if(owner[stmt->slot] != 0 && owner[stmt->slot] != id)
+	return 0;
+    owner[stmt->slot] = id;
+
+    for(tmp = stmt->body; tmp != NULL; tmp = tmp->next)
+	if(!claim(tmp, owner, id))
+	    return 0;
+
+    return 1;
+}
+
+/*
+ * Returns 1 if the statement is an accumulation x := x + e, e + x
+ * or x - e where e is affine in the slot and reads no other slot
+ * assigned in the loop. The expression of the statement is expn.
+ */
+static int accumulator(ir_stmt *stmt, ir_expr *e, int slot){
+    ir_expr *x;
+
+    if(stmt->kind != IR_ASSIGN || stmt->lt != INT || e->fault)
+	return 0;
+    if(e->op != IR_ADD && e->op != IR_SUB)
+	return 0;
+
+    if(e->l->op == IR_VAR && e->l->slot == stmt->slot)
+	x = e->r;
+    else if(e->op == IR_ADD && e->r->op == IR_VAR && e->r->slot == stmt->slot)
+	x = e->l;
+    else
+	return 0;
+
+    return !reads(x, written) && linear(x, slot);
+}
+
+static int linear(ir_expr *expn, int slot){
+    if(!readsSlot(expn, slot) || expn->op == IR_VAR)
+	return 1;
+
+    switch(expn->op){
+    case IR_ADD:
+    case IR_SUB:
+	return linear(expn->l, slot) && linear(expn->r, slot);
+    case IR_MUL:
+	return (!readsSlot(expn->l, slot) && linear(expn->r, slot)) ||
+	    (!readsSlot(expn->r, slot) && linear(expn->l, slot));
+    default:
+	return 0;
+    }
+}
+
+/*
+ * Returns 1 if the statement leaves the same values after every
+ * round. The slots it must not read are marked in written. The
+ * control variable of an inner loop may be read in its body.
+ */
+static int final(ir_stmt *stmt){
+    ir_stmt *tmp;
+    int      r = 1;
+
+    switch(stmt->kind){
+    case IR_ASSIGN:
+	return !stmt->expn->fault && !reads(stmt->expn, written);
+    case IR_FOR:
+	if(stmt->expn->fault || stmt->expn2->fault ||
+	   reads(stmt->expn, written) || reads(stmt->expn2, written))
+	    return 0;
+
+	written[stmt->slot] = 0;
+	for(tmp = stmt->body; tmp != NULL && r; tmp = tmp->next)
+	    r = final(tmp);
+	written[stmt->slot] = 1;
+	return r;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * Returns the bound of the range as a constant or a variable that
+ * the loop does not assign. Other bounds are assigned to hidden
+ * temporaries before the loop.
+ */
+static ir_expr *bound(ir_expr *expn){
+    ir_stmt *tmp;
+    char     name[32];
+
+    if(expn->op == IR_CONST || (expn->op == IR_VAR && !written[expn->slot]))
+	return copyIrExpr(expn);
+
+    sprintf(name, "$t%d", temps++);
+    tmp       = newIrStmt(IR_ASSIGN);
+    tmp->line = loop->line;
+    tmp->lt   = INT;
+    tmp->slot = newSlot(program, name, INT);
+    tmp->expn = copyIrExpr(expn);
+    tmp->next = loop;
+    *hoisted  = tmp;
+    hoisted   = &tmp->next;
+
+    return variable(tmp->slot);
+}
+
+/*
+ * Splits the expression, which is affine in the slot, to the
+ * expressions a and b of a * slot + b.
+ */
+static void coefficients(ir_expr *expn, int slot, ir_expr **a, ir_expr **b){
+    ir_expr *la, *lb, *ra, *rb;
+
+    if(!readsSlot(expn, slot)){
+	*a = constant(0, loop->line);
+	*b = copyIrExpr(expn);
+	return;
+    }
+
+    if(expn->op == IR_VAR){
+	*a = constant(1, loop->line);
+	*b = constant(0, loop->line);
+	return;
+    }
+
+    if(expn->op == IR_MUL && !readsSlot(expn->l, slot)){
+	coefficients(expn->r, slot, &ra, &rb);
+	*a = arith(IR_MUL, copyIrExpr(expn->l), ra);
+	*b = arith(IR_MUL, copyIrExpr(expn->l), rb);
+	return;
+    }
+
+    if(expn->op == IR_MUL){
+	coefficients(expn->l, slot, &la, &lb);
+	*a = arith(IR_MUL, la, copyIrExpr(expn->r));
+	*b = arith(IR_MUL, lb, copyIrExpr(expn->r));
+	return;
+    }
+
+    coefficients(expn->l, slot, &la, &lb);
+    coefficients(expn->r, slot, &ra, &rb);
+    *a = arith(expn->op, la, ra);
+    *b = arith(expn->op, lb, rb);
+}
+
+/*
+ * Makes the integer expression l op r, folded, and simplifies the
+ * additions of zero and the multiplications by zero and one. None of the
+ * operands can fail, so they can be dropped.
+ */
+static ir_expr *arith(ir_op op, ir_expr *l, ir_expr *r){
+    ir_expr *e;
+
+    if(op == IR_MUL && ((l->op == IR_CONST && l->i == 0) || (r->op == IR_CONST && r->i == 0))){
+	freeIrExpr(l);
+	freeIrExpr(r);
+	return constant(0, loop->line);
+    }
+
+    if((op == IR_MUL && l->op == IR_CONST && l->i == 1) ||
+       (op == IR_ADD && l->op == IR_CONST && l->i == 0)){
+	freeIrExpr(l);
+	return r;
+    }
+
+    if((op == IR_MUL && r->op == IR_CONST && r->i == 1) ||
+       ((op == IR_ADD || op == IR_SUB) && r->op == IR_CONST && r->i == 0)){
+	freeIrExpr(r);
+	return l;
+    }
+
+    e       = newIrExpr(op);
+    e->lt   = INT;
+    e->line = loop->line;
+    e->l    = l;
+    e->r    = r;
+
+    return foldExpression(e);
+}
+
+static ir_expr *variable(int slot){
+    ir_expr *v = newIrExpr(IR_VAR);
+
+    v->lt   = program->types[slot];
+    v->line = loop->line;
+    v->slot = slot;
+
+    return v;
+}
+
+static int readsSlot(ir_expr *expn, int slot){
+    if(expn->op == IR_VAR)
+	return expn->slot == slot;
+
+    return (expn->l != NULL && readsSlot(expn->l, slot)) ||
+	(expn->r != NULL && readsSlot(expn->r, slot));
+}
+
+/*
+ * LOOP FUSION ---------------------------------------------------------
+ *
+ * Two adjacent loops of the same control variable over the same range
+ * are made one loop that runs both bodies in turn:
+ *
+ *     for i in s..e do A end for;         for i in s..e do
+ *     for i in s..e do B end for;   ==>       A; B
+ *                                         end for;
+ *
+ * The order of the rounds changes, so neither body may read or write
+ * the variables the other one writes, and at most one of the bodies
+ * may have effects: print, read, statements that can fail and inner
+ * loops. The range must not read the variables of the first loop and
+ * can not fail. If the end of the range may be the largest integer,
+ * the first loop never ends and only its body may have effects.
+ */
+
+static int fuse(ir_program *ir){
+    changes = 0;
+
+    fuseStmts(ir->stmts);
+
+    return changes;
+}
+
+static void fuseStmts(ir_stmt *stmt){
+    ir_stmt *next, **tail;
+
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->kind != IR_FOR)
+	    continue;
+
+	while((next = stmt->next) != NULL && fusible(stmt, next)){
+	    for(tail = &stmt->body; *tail != NULL; tail = &(*tail)->next)
+		;
+	    *tail      = next->body;
+	    next->body = NULL;
+	    stmt->next = next->next;
+	    next->next = NULL;
+	    freeIrStmts(next);
+	    changes++;
+	}
+
+	fuseStmts(stmt->body);
+    }
+}
+
+/* Returns 1 if the loop b can be fused to the loop a before it. */
+static int fusible(ir_stmt *a, ir_stmt *b){
+    int   n = program->nslots +1, ok = 1, ea, eb;
+    char *ra, *wa, *rb, *wb;
+
+    if(b->kind != IR_FOR || a->slot != b->slot || a->expn->fault || a->expn2->fault ||
+       !sameExpr(a->expn, b->expn) || !sameExpr(a->expn2, b->expn2))
+	return 0;
+
+    ea = effects(a->body);
+    eb = effects(b->body);
+    if((ea && eb) || (eb && (a->expn2->op != IR_CONST || a->expn2->i == INT_MAX)))
+	return 0;
+
+    ra = (char*)calloc(n, sizeof(char));
+    wa = (char*)calloc(n, sizeof(char));
+    rb = (char*)calloc(n, sizeof(char));
+    wb = (char*)calloc(n, sizeof(char));
+
+    usedSlots(a->body, ra);
+    usedSlots(b->body, rb);
+    writtenSlots(a->body, wa);
+    writtenSlots(b->body, wb);
+
+    for(int i = 0; i < n && ok; i++)
+	ok = !(wa[i] && (rb[i] || wb[i])) && !(wb[i] && ra[i]);
+
+    wa[a->slot] = 1;
+    ok = ok && !reads(b->expn, wa) && !reads(b->expn2, wa);
+
+    free(ra);
+    free(wa);
+    free(rb);
+    free(wb);
+
+    return ok;
+}
+
+/*
+ * Returns 1 if the statements print, read, can fail or have a loop,
+ * so that the order of their rounds can be seen.
+ */
+static int effects(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next){
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	    if(stmt->expn->fault)
+		return 1;
+	    break;
+	default:
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Marks the slots the statements read. */
+static void usedSlots(ir_stmt *stmt, char *read){
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->expn  != NULL) readSlots(stmt->expn,  read);
+	if(stmt->expn2 != NULL) readSlots(stmt->expn2, read);
+	usedSlots(stmt->body, read);
+    }
+}
+
+/*
+ * LOOP UNROLLING ------------------------------------------------------
+ *
+ * The loops whose body has at most OPTIMIZE_UNROLL_BODY statements and
+ * no inner loop run their body factor times per round. The rounds left
+ * over are run by the original loop, the remainder loop:
+ *
+ *     $s := s; $e := e;
+ *     $q := max((trips($s, $e) / factor), 0);
+ *     $r := ($s + ($q * factor));
+ *     i := $s;
+ *     for $c in 1..$q do
+ *         B; i := (i + 1); ... B; i := (i + 1);
+ *     end for;
+ *     for i in $r..$e do B end for;
+ *
+ * The bounds s and e are not copied to temporaries if they are
+ * constants or variables the loop does not assign.
+ *
+ * The remainder loop leaves i with its final value. A range of more
+ * than 2^31 integers, whose count is negative, is run by the remainder
+ * loop alone, and so is a loop that never ends. The start of the
+ * remainder loop is a hidden temporary, which marks the loop so that
+ * it is never unrolled again.
+ */
+
+static int unroll(ir_program *ir){
+    changes = 0;
+
+    if(factor >= 2)
+	unrollStmts(&ir->stmts);
+
+    return changes;
+}
+
+static void unrollStmts(ir_stmt **list){
+    ir_stmt **link, *stmt;
+
+    for(link = list; (stmt = *link) != NULL; link = &stmt->next){
+	if(stmt->kind != IR_FOR)
+	    continue;
+
+	if(unrollable(stmt)){
+	    unrollLoop(link);
+	    while(*link != stmt)
+		link = &(*link)->next;
+	} else
+	    unrollStmts(&stmt->body);
+    }
+}
+
+static int unrollable(ir_stmt *stmt){
+    ir_expr *s = stmt->expn, *e = stmt->expn2;
+    ir_stmt *tmp;
+    int      n = 0;
+
+    if(hidden(stmt->slot) || s->fault || e->fault || s->op == IR_MAX ||
+       (s->op == IR_VAR && hidden(s->slot)))
+	return 0;
+
+    if(s->op == IR_CONST && e->op == IR_CONST &&
+       (e->i < s->i || tripCount(s->i, e->i) < factor))
+	return 0;
+
+    for(tmp = stmt->body; tmp != NULL; tmp = tmp->next, n++)
+	if(tmp->kind == IR_FOR)
+	    return 0;
+
+    return n > 0 && n <= OPTIMIZE_UNROLL_BODY;
+}
+
+/* Unrolls the loop **link. The new statements are inserted before it. */
+static void unrollLoop(ir_stmt **link){
+    ir_stmt *stmt = *link, *chunks, **tail;
+    ir_expr *s, *e, *q, *r;
+    int      c;
+
+    loop = stmt;
+    s    = stmt->expn;
+    e    = stmt->expn2;
+    if(!stable(s, stmt)) s = temporary(&link, stmt, s);
+    if(!stable(e, stmt)) e = temporary(&link, stmt, e);
+
+    q = arith(IR_MAX, arith(IR_DIV, arith(IR_TRIPS, copyIrExpr(s), copyIrExpr(e)),
+			    constant(factor, stmt->line)),
+	      constant(0, stmt->line));
+    q = temporary(&link, stmt, q);
+    r = temporary(&link, stmt, arith(IR_ADD, copyIrExpr(s),
+				     arith(IR_MUL, copyIrExpr(q), constant(factor, stmt->line))));
+
+    assign(&link, stmt, stmt->slot, copyIrExpr(s));
+
+    chunks        = newIrStmt(IR_FOR);
+    chunks->line  = stmt->line;
+    chunks->lt    = INT;
+    chunks->slot  = newSlot(program, hiddenName(), INT);
+    chunks->expn  = constant(1, stmt->line);
+    chunks->expn2 = q;
+    for(tail = &chunks->body, c = 0; c < factor; c++){
+	*tail = copyIrStmts(stmt->body);
+	while(*tail != NULL)
+	    tail = &(*tail)->next;
+	*tail = step(stmt->slot);
+	tail  = &(*tail)->next;
+    }
+    chunks->next = stmt;
+    *link        = chunks;
+
+    /* A bound that is not stable was moved to its temporary. */
+    if(s == stmt->expn)
+	freeIrExpr(s);
+    stmt->expn  = r;
+    stmt->expn2 = e;
+    changes++;
+}
+
+/*
+ * Returns 1 if the range expression has the same value before the
+ * loop and after it: a constant, or a variable the loop does not
+ * assign.
+ */
+static int stable(ir_expr *expn, ir_stmt *stmt){
+    char *slots;
+    int   r;
+
+    if(expn->op != IR_VAR)
+	return expn->op == IR_CONST;
+
+    slots = (char*)calloc(program->nslots +1, sizeof(char));
+    slots[stmt->slot] = 1;
+    writtenSlots(stmt->body, slots);
+    r = !slots[expn->slot];
+    free(slots);
+
+    return r;
+}
+
+/*
+ * Assigns the expression to a new hidden temporary before the loop
+ * and returns a reference to the temporary. *link is moved past it.
+ */
+static ir_expr *temporary(ir_stmt ***link, ir_stmt *stmt, ir_expr *expn){
+    int slot = newSlot(program, hiddenName(), INT);
+
+    assign(link, stmt, slot, expn);
+
+    return variable(slot);
+}
+
+/* Inserts slot := expn before the loop stmt at **link. */
+static void assign(ir_stmt ***link, ir_stmt *stmt, int slot, ir_expr *expn){
+    ir_stmt *tmp = newIrStmt(IR_ASSIGN);
+
+    tmp->line = stmt->line;
+    tmp->lt   = INT;
+    tmp->slot = slot;
+    tmp->expn = expn;
+    tmp->next = stmt;
+
+    **link = tmp;
+    *link  = &tmp->next;
+}
+
+/* Returns the statement slot := (slot + 1) of the loop being unrolled. */
+static ir_stmt *step(int slot){
+    ir_stmt *tmp = newIrStmt(IR_ASSIGN);
+
+    tmp->line = loop->line;
+    tmp->lt   = INT;
+    tmp->slot = slot;
+    tmp->expn = arith(IR_ADD, variable(slot), constant(1, loop->line));
+
+    return tmp;
+}
+
+/* Returns the name of a new hidden temporary. */
+static char *hiddenName(void){
+    static char name[32];
+
+    sprintf(name, "$t%d", temps++);
+
+    return name;
+}
+
+/*
+ * DEAD STORE ELIMINATION ----------------------------------------------
+ *
+ * An assignment or declaration is removed if the variable is not
+ * read before it is assigned again or the program ends, and the
+ * expression can not fail. The liveness of the variables is
+ * computed backwards from the end of the program. Nothing is live
+ * before a trap, because the program ends there.
+ */
+
+static int deadStores(ir_program *ir){
+    char *live = (char*)calloc(ir->nslots +1, sizeof(char));
+
+    changes = 0;
+    liveSlots(&ir->stmts, live, 1);
+
+    free(live);
+    return changes;
+}
+
+/*
+ * On entry live has the slots that are live after the statement
+ * list *list and on return the slots that are live before it. The
+ * dead stores are removed if remove is set. Otherwise they are only
+ * skipped, so that the liveness is the same in both cases.
+ */
+static void liveSlots(ir_stmt **list, char *live, int remove){
+    ir_stmt ***links = NULL, **link, *stmt;
+    int        n = 0, size = 0, k;
+
+    for(link = list; *link != NULL; link = &(*link)->next){
+	if(n == size)
+	    links = (ir_stmt***)realloc(links, sizeof(ir_stmt**) * (size = 2 * size + 16));
+	links[n++] = link;
+    }
+
+    for(k = n -1; k >= 0; k--){
+	stmt = *links[k];
+
+	switch(stmt->kind){
+	case IR_DECLARE:
+	case IR_ASSIGN:
+	    if(!stmt->expn->fault && (!live[stmt->slot] ||
+	       (stmt->expn->op == IR_VAR && stmt->expn->slot == stmt->slot))){
+		if(remove){
+		    *links[k]  = stmt->next;
+		    stmt->next = NULL;
+		    freeIrStmts(stmt);
+		    changes++;
+		}
+		break;
+	    }
+	    live[stmt->slot] = 0;
+	    readSlots(stmt->expn, live);
+	    break;
+	case IR_READ:
+	    live[stmt->slot] = 0;
+	    break;
+	case IR_PRINT:
+	case IR_ASSERT:
+	    readSlots(stmt->expn, live);
+	    break;
+	case IR_TRAP:
+	    memset(live, 0, program->nslots);
+	    break;
+	case IR_FOR:
+	    liveLoop(stmt, live, remove);
+	    break;
+	}
+    }
+
+    free(links);
+}
+
+/*
+ * The slots live after the body of a loop are the slots live after
+ * the loop and the slots live before the body, for the next round.
+ * The control variable is assigned before each round and after the
+ * loop, so it is never live after the body. The liveness before the
+ * body is iterated to a fixed point.
+ */
+static void liveLoop(ir_stmt *stmt, char *live, int remove){
+    int   n   = program->nslots +1, i, same;
+    char *out = (char*)malloc(n);
+    char *in  = (char*)calloc(n, sizeof(char));
+    char *tmp = (char*)malloc(n);
+
+    do{
+	for(i = 0; i < n; i++)
+	    out[i] = live[i] | in[i];
+	out[stmt->slot] = 0;
+
+	memcpy(tmp, out, n);
+	liveSlots(&stmt->body, tmp, 0);
+	same = memcmp(tmp, in, n) == 0;
+	memcpy(in, tmp, n);
+    } while(!same);
+
+    if(remove){
+	memcpy(tmp, out, n);
+	liveSlots(&stmt->body, tmp, 1);
+    }
+
+    memcpy(live, out, n);
+    readSlots(stmt->expn,  live);
+    readSlots(stmt->expn2, live);
+
+    free(out);
+    free(in);
+    free(tmp);
+}
+
+static void readSlots(ir_expr *expn, char *live){
+    if(expn->op == IR_VAR)
+	live[expn->slot] = 1;
+
+    if(expn->l != NULL) readSlots(expn->l, live);
+    if(expn->r != NULL) readSlots(expn->r, live);
+}
+
+/* Returns 1 if the expression reads any of the marked slots. */
+static int reads(ir_expr *expn, char *slots){
+    if(expn->op == IR_VAR)
+	return slots[expn->slot];
+
+    return (expn->l != NULL && reads(expn->l, slots)) ||
+	(expn->r != NULL && reads(expn->r, slots));
+}
+
+/*
+ * UNUSED SLOTS --------------------------------------------------------
+ *
+ * The slots that no statement refers to anymore, e.g. variables
+ * whose declarations were removed as dead stores, are removed and
+ * the remaining slots are numbered again.
+ */
+
+static int unusedSlots(ir_program *ir){
+    int *map = (int*)calloc(ir->nslots +1, sizeof(int));
+    int  n = 0;
+
+    markSlots(ir->stmts, map);
+
+    for(int i = 0; i < ir->nslots; i++){
+	if(map[i]){
+	    map[i]       = n;
+	    ir->names[n] = ir->names[i];
+	    ir->types[n] = ir->types[i];
+	    n++;
+	} else
+	    free(ir->names[i]);
+    }
+
+    changes = ir->nslots - n;
+    if(changes > 0)
+	renumberStmts(ir->stmts, map);
+    ir->nslots = n;
+
+    free(map);
+    return changes;
+}
+
+static void markSlots(ir_stmt *stmt, int *map){
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->kind != IR_PRINT && stmt->kind != IR_ASSERT && stmt->kind != IR_TRAP)
+	    map[stmt->slot] = 1;
+	if(stmt->expn  != NULL) markExpr(stmt->expn,  map);
+	if(stmt->expn2 != NULL) markExpr(stmt->expn2, map);
+	markSlots(stmt->body, map);
+    }
+}
+
+static void markExpr(ir_expr *expn, int *map){
+    if(expn->op == IR_VAR)
+	map[expn->slot] = 1;
+
+    if(expn->l != NULL) markExpr(expn->l, map);
+    if(expn->r != NULL) markExpr(expn->r, map);
+}
+
+static void renumberStmts(ir_stmt *stmt, int *map){
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->kind != IR_PRINT && stmt->kind != IR_ASSERT && stmt->kind != IR_TRAP)
+	    stmt->slot = map[stmt->slot];
+	if(stmt->expn  != NULL) renumberExpr(stmt->expn,  map);
+	if(stmt->expn2 != NULL) renumberExpr(stmt->expn2, map);
+	renumberStmts(stmt->body, map);
+    }
+}
+
+static void renumberExpr(ir_expr *expn, int *map){
+    if(expn->op == IR_VAR)
+	expn->slot = map[expn->slot];
+
+    if(expn->l != NULL) renumberExpr(expn->l, map);
+    if(expn->r != NULL) renumberExpr(expn->r, map);
+}
+
+/*
+ * DUMP ----------------------------------------------------------------
+ *
+ * The IR is written in the syntax of MiniPL with the line number
+ * of each statement. Every binary expression is in parentheses.
+ */
+
+void dumpIr(FILE *out, ir_program *ir){
+    dumpStmts(out, ir, ir->stmts, 0);
+}
+
+static void dumpStmts(FILE *out, ir_program *ir, ir_stmt *stmt, int depth){
+    static char *types[] = {"undef", "int", "string", "bool"};
+
+    for(; stmt != NULL; stmt = stmt->next){
+	fprintf(out, "%4d  %*s", stmt->line, 4 * depth, "");
+
+	switch(stmt->kind){
+	case IR_DECLARE:
+	    fprintf(out, "var %s : %s := ", ir->names[stmt->slot], types[stmt->lt]);
+	    dumpExpr(out, ir, stmt->expn);
+	    break;
+	case IR_ASSIGN:
+	    fprintf(out, "%s := ", ir->names[stmt->slot]);
+	    dumpExpr(out, ir, stmt->expn);
+	    break;
+	case IR_FOR:
+	    fprintf(out, "for %s in ", ir->names[stmt->slot]);
+	    dumpExpr(out, ir, stmt->expn);
+	    fprintf(out, "..");
+	    dumpExpr(out, ir, stmt->expn2);
+	    fprintf(out, " do\n");
+	    dumpStmts(out, ir, stmt->body, depth +1);
+	    fprintf(out, "%4d  %*send for", stmt->line, 4 * depth, "");
+	    break;
+	case IR_READ:
+	    fprintf(out, "read %s", ir->names[stmt->slot]);
+	    break;
+	case IR_PRINT:
+	    fprintf(out, "print ");
+	    dumpExpr(out, ir, stmt->expn);
+	    break;
+	case IR_ASSERT:
+	    fprintf(out, "assert ");
+	    dumpExpr(out, ir, stmt->expn);
+	    break;
+	case IR_TRAP:
+	    fprintf(out, "trap");
+	    break;
+	}
+
+	fprintf(out, ";\n");
+    }
+}
+
+static void dumpExpr(FILE *out, ir_program *ir, ir_expr *expn){
+    static char *ops[] = {"", "", "!", "+", "-", "*", "/", "&", "<", "=",
+			  "max", "trips", "sum"};
+
+    switch(expn->op){
+    case IR_CONST:
+	if(expn->lt == STRING){
+	    fputc('"', out);
+	    for(char *s = expn->s; *s != '\0'; s++)
+		if(*s == '\n')
+		    fputs("\\n", out);
+		else if(*s == '"' || *s == '\\')
+		    fprintf(out, "\\%c", *s);
+		else
+		    fputc(*s, out);
+	    fputc('"', out);
+	} else if(expn->lt == BOOL)
+	    fprintf(out, "%s", expn->i ? "true" : "false");
+	else
+	    fprintf(out, "%d", expn->i);
+	break;
+    case IR_VAR:
+	fprintf(out, "%s", ir->names[expn->slot]);
+	break;
+    case IR_NOT:
+	fprintf(out, "!");
+	dumpExpr(out, ir, expn->l);
+	break;
+    case IR_MAX:
+    case IR_TRIPS:
+    case IR_SUM:
+	fprintf(out, "%s(", ops[expn->op]);
+	dumpExpr(out, ir, expn->l);
+	fprintf(out, ", ");
+	dumpExpr(out, ir, expn->r);
+	fprintf(out, ")");
+	break;
+    default:
+	fprintf(out, "(");
+	dumpExpr(out, ir, expn->l);
+	fprintf(out, " %s ", ops[expn->op]);
+	dumpExpr(out, ir, expn->r);
+	fprintf(out, ")");
+	break;
+    }
+}
+
+/* Returns the time in milliseconds. */
+static double now(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,69 @@
+#ifndef OPTIMIZE_HEADER
+#define OPTIMIZE_HEADER
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/*
+ * This file contains the declarations of the optimizer. The
+ * optimizer transforms the IR of the program with a pipeline of
+ * passes before it is given to an execution engine. Every pass
+ * preserves the output, the error messages and the return value
+ * of the program.
+ *
+ * At -O0 nothing is done. At -O1 every pass of level 1 is run
+ * once. At -O2 also the passes of level 2 are run, and the
+ * whole pipeline is repeated until it does not change the
+ * program anymore.
+ */
+
+#define OPTIMIZE_DEFAULT_LEVEL 1
+#define OPTIMIZE_MAX_ROUNDS    8
+
+/*
+ * Budgets of the partial evaluation of the program at -O2: the
+ * statements executed at compile time and the output they write.
+ */
+#define OPTIMIZE_PREFIX_STEPS  10000000
+#define OPTIMIZE_PREFIX_OUTPUT (1 << 20)
+
+/*
+ * Number of the computed expressions the common subexpression
+ * elimination remembers in a statement list.
+ */
+#define OPTIMIZE_CSE_ENTRIES   256
+
+/*
+ * Loops with at most OPTIMIZE_UNROLL_BODY statements and no inner
+ * loop are unrolled at -O2 if --unroll sets a factor of 2 or more.
+ * The engines run the loop control as fast as the increment of the
+ * control variable that unrolling adds, so it is off by default.
+ */
+#define OPTIMIZE_UNROLL_FACTOR 1
+#define OPTIMIZE_UNROLL_BODY   2
+
+/*
+ * Sets the optimization level. If dump is set, the IR is written
+ * to the standard error before and after every pass. If stats is
+ * set, the number of changes and the time of each pass are written
+ * to the standard error after the pipeline. If report is set, the
+ * facts proven by the range analysis are written there too: the
+ * asserts and the division checks removed, and the asserts that
+ * always fail and the divisions that are always by zero.
+ */
+extern void optimizeOptions (int level, int dump, int stats, int report);
+
+/*
+ * Sets the number of copies of the body in the unrolled loops.
+ * Loops are not unrolled if factor is less than 2.
+ */
+extern void optimizeUnroll  (int factor);
+
+/* Runs the optimization pipeline on the program *ir. */
+extern void optimize        (ir_program *ir);
+
+/* Writes the IR of the program in a readable form to *out. */
+extern void dumpIr          (FILE *out, ir_program *ir);
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "output.h"
+
+/* Helper functions used only in this translation unit. */
+static void start    (void                     );
+static void writeAll (struct iovec *iov, int n );
+
+static char   buffer[OUTPUT_BUFFER_SIZE];
+static size_t length;
+static int    started;
+static int    interactive;
+
+/*
+ * The digits are written from the end of a small buffer and then
+ * moved to the start of the text. The magnitude is computed in
+ * unsigned arithmetic, so that the smallest integer has one too.
+ */
+int formatInt(char *text, int v){
+    char     digits[OUTPUT_INT_SIZE], *p = digits + OUTPUT_INT_SIZE;
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+
+    do{
+	*--p = '0' + u % 10;
+	u   /= 10;
+    }while(u != 0);
+
+    if(v < 0)
+	*--p = '-';
+
+    memcpy(text, p, digits + OUTPUT_INT_SIZE - p);
+
+    return digits + OUTPUT_INT_SIZE - p;
+}
+
+/* A short integer is formatted directly to the buffer. */
+void outputInt(int v){
+    char text[OUTPUT_INT_SIZE];
+
+    if(started && length + OUTPUT_INT_SIZE <= OUTPUT_BUFFER_SIZE){
+	length += formatInt(buffer + length, v);
+	return;
+    }
+
+    outputString(text, formatInt(text, v));
+}
+
+void outputString(const char *s, size_t n){
+    struct iovec iov[2];
+
+    if(!started)
+	start();
+
+    if(n >= OUTPUT_DIRECT_SIZE){
+	iov[0].iov_base = buffer;
+	iov[0].iov_len  = length;
+	iov[1].iov_base = (void*)s;
+	iov[1].iov_len  = n;
+	writeAll(iov, 2);
+	length = 0;
+	return;
+    }
+
+    if(length + n > OUTPUT_BUFFER_SIZE)
+	outputFlush();
+
+    memcpy(buffer + length, s, n);
+    length += n;
+
+    if(interactive && memchr(s, '\n', n) != NULL)
+	outputFlush();
+}
+
+void outputFlush(void){
+    struct iovec iov;
+
+    if(length == 0)
+	return;
+
+    iov.iov_base = buffer;
+    iov.iov_len  = length;
+    writeAll(&iov, 1);
+    length = 0;
+}
+
+/* The buffer is written at exit, however the program ends. */
+static void start(void){
+    started     = 1;
+    interactive = isatty(STDOUT_FILENO);
+    atexit(outputFlush);
+}
+
+/*
+ * Writes the vectors completely. A write that is interrupted or
+ * only partly done is continued, and the output is dropped if
+ * the standard output fails.
+ */
+static void writeAll(struct iovec *iov, int n){
+    ssize_t done;
+
+    while(n > 0){
+	if((done = writev(STDOUT_FILENO, iov, n)) < 0){
+	    if(errno == EINTR)
+		continue;
+	    return;
+	}
+
+	for(; n > 0 && (size_t)done >= iov->iov_len; iov++, n--)
+	    done -= iov->iov_len;
+
+	if(n > 0){
+	    iov->iov_base  = (char*)iov->iov_base + done;
+	    iov->iov_len  -= done;
+	}
+    }
+}
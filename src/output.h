@@ -0,0 +1,44 @@
+#ifndef OUTPUT_HEADER
+#define OUTPUT_HEADER
+
+#include <stddef.h>
+
+/*
+ * This file contains the declarations of the output of the print
+ * statements. The output is collected to a buffer and written to
+ * the standard output when the buffer is full, before the program
+ * reads its input, before an error message is written to the
+ * standard error and at exit. If the standard output is a
+ * terminal, the buffer is also written at every newline.
+ *
+ * The output does not go through stdio, so nothing else may write
+ * to the standard output while a program is run.
+ */
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+/*
+ * Strings at least this long are not copied to the buffer. They
+ * are written with the contents of the buffer in one system call.
+ */
+#define OUTPUT_DIRECT_SIZE 4096
+
+/*
+ * Formats the integer in decimal to *text, which has room for
+ * OUTPUT_INT_SIZE characters, and returns the number of them.
+ * The text is not null terminated.
+ */
+#define OUTPUT_INT_SIZE 11
+
+extern int  formatInt    (char *text, int v);
+
+/* Writes the integer in decimal. */
+extern void outputInt    (int v);
+
+/* Writes the n characters of *s. */
+extern void outputString (const char *s, size_t n);
+
+/* Writes the buffered output to the standard output. */
+extern void outputFlush  (void);
+
+#endif
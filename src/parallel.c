@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "label.h"
+#include "ir.h"
+#include "closure.h"
+#include "parallel.h"
+#include "vector.h"
+#include "pool.h"
+
+/*
+ * A chunk of the range of a parallel loop and the
+ * frame it is run with.
+ */
+typedef struct CHUNK{
+    stmt_closure  *c     ;
+    frame          f     ;
+    int            start ;
+    int            end   ;
+} chunk;
+
+/* Helper functions used only in this translation unit. */
+static int            eligibleStmts (ir_stmt *stmt                          );
+static int            eligibleExpr  (ir_expr *expn                          );
+static int            maxSlot       (ir_stmt *stmt, int max                 );
+static int            maxExprSlot   (ir_expr *expn, int max                 );
+static void           accesses      (ir_stmt *stmt, char *defined           );
+static void           reads         (ir_expr *expn, char *defined, int skip );
+static parallel_role  reduction     (ir_stmt *stmt                          );
+static int            readsSlot     (ir_expr *expn, int slot                );
+static void           runChunk      (void *arg, int k                       );
+
+/*
+ * The accesses of the slots in the loop being analysed. A slot
+ * is exposed if it may be read before it is written in an
+ * iteration. A plain read or write is any access other than
+ * those of the reduction statements, whose operator is kept in
+ * reduced.
+ */
+static char          *exposed;
+static char          *plain_read;
+static char          *plain_write;
+static parallel_role *reduced;
+static int            nslots;
+static int            conflict;
+
+parallel_loop *parallelLoop(ir_stmt *forstmt){
+    if(forstmt->expn->fault || forstmt->expn2->fault || !eligibleStmts(forstmt->body))
+	return NULL;
+
+    return loopRoles(forstmt);
+}
+
+/*
+ * The analysis walks the body in the order it is executed. The
+ * array defined tells the slots written in the iteration so far.
+ * The statements of an inner loop may be run any number of times,
+ * so its body is walked with a copy of the array, and its writes
+ * do not count as definite after the inner loop.
+ */
+parallel_loop *loopRoles(ir_stmt *forstmt){
+    parallel_loop *p;
+    char          *defined;
+    int            n, k;
+
+    n = nslots = maxSlot(forstmt->body, forstmt->slot) +1;
+
+    exposed     = (char*)calloc(n, 1);
+    plain_read  = (char*)calloc(n, 1);
+    plain_write = (char*)calloc(n, 1);
+    reduced     = (parallel_role*)calloc(n, sizeof(parallel_role));
+    defined     = (char*)calloc(n, 1);
+    conflict    = 0;
+
+    defined[forstmt->slot] = 1;
+    accesses(forstmt->body, defined);
+
+    p = (parallel_loop*)malloc(sizeof(parallel_loop) + sizeof(parallel_role) * n);
+    p->nslots = n;
+
+    for(k = 0; k < n && !conflict; k++){
+	if(k == forstmt->slot)
+	    p->roles[k] = PARALLEL_PRIVATE;
+	else if(!plain_write[k] && reduced[k] == PARALLEL_SHARED)
+	    p->roles[k] = PARALLEL_SHARED;
+	else if(!plain_write[k] && !plain_read[k])
+	    p->roles[k] = reduced[k];
+	else if(!exposed[k] && defined[k])
+	    p->roles[k] = PARALLEL_PRIVATE;
+	else
+	    conflict = 1;
+    }
+
+    free(exposed);
+    free(plain_read);
+    free(plain_write);
+    free(reduced);
+    free(defined);
+
+    if(conflict){
+	free(p);
+	return NULL;
+    }
+
+    return p;
+}
+
+/*
+ * The chunks are combined in their order. The private slots get
+ * their values from the last chunk, which runs the last iteration.
+ */
+int parallelRun(stmt_closure *c, frame *f, int start, int end){
+    parallel_loop *p = c->parallel;
+    long long      trips = (long long)end - start + 1;
+    int            n, k, s;
+    chunk         *chunks;
+
+    if(f->parallel || end == INT_MAX || trips < PARALLEL_MIN_TRIPS || poolThreads() < 2)
+	return 0;
+
+    n = poolThreads() * PARALLEL_CHUNKS;
+    if(n > trips / PARALLEL_CHUNK)
+	n = (int)(trips / PARALLEL_CHUNK);
+
+    chunks = (chunk*)malloc(sizeof(chunk) * n);
+
+    for(k = 0; k < n; k++){
+	chunks[k].c          = c;
+	chunks[k].start      = (int)(start + trips * k / n);
+	chunks[k].end        = (int)(start + trips * (k +1) / n - 1);
+	chunks[k].f.env      = (cell*)malloc(sizeof(cell) * p->nslots);
+	chunks[k].f.buffers  = NULL;
+	chunks[k].f.fault    = 0;
+	chunks[k].f.parallel = 1;
+
+	memcpy(chunks[k].f.env, f->env, sizeof(cell) * p->nslots);
+	for(s = 0; s < p->nslots; s++)
+	    if(p->roles[s] == PARALLEL_SUM)
+		chunks[k].f.env[s].i = 0;
+	    else if(p->roles[s] == PARALLEL_PRODUCT || p->roles[s] == PARALLEL_CONJUNCTION)
+		chunks[k].f.env[s].i = 1;
+    }
+
+    poolRun(runChunk, chunks, n);
+
+    for(k = 0; k < n; k++)
+	for(s = 0; s < p->nslots; s++)
+	    switch(p->roles[s]){
+	    case PARALLEL_SUM:
+		f->env[s].i = (int)((unsigned)f->env[s].i + (unsigned)chunks[k].f.env[s].i);
+		break;
+	    case PARALLEL_PRODUCT:
+		f->env[s].i = (int)((unsigned)f->env[s].i * (unsigned)chunks[k].f.env[s].i);
+		break;
+	    case PARALLEL_CONJUNCTION:
+		f->env[s].i &= chunks[k].f.env[s].i;
+		break;
+	    case PARALLEL_PRIVATE:
+		if(k == n -1)
+		    f->env[s].i = chunks[k].f.env[s].i;
+		break;
+	    }
+
+    /* The control variable keeps the value of the counter after the loop. */
+    f->env[c->slot].i = end +1;
+
+    for(k = 0; k < n; k++)
+	free(chunks[k].f.env);
+    free(chunks);
+
+    return 1;
+}
+
+/*
+ * Expressions of the body may not fail, so neither can the
+ * iterations, and their order does not matter.
+ */
+static int eligibleStmts(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	switch(stmt->kind){
+	case IR_ASSIGN:
+	    if(stmt->lt == STRING || stmt->expn->fault || !eligibleExpr(stmt->expn))
+		return 0;
+	    break;
+	case IR_FOR:
+	    if(stmt->expn->fault || stmt->expn2->fault || !eligibleExpr(stmt->expn) ||
+	       !eligibleExpr(stmt->expn2) || !eligibleStmts(stmt->body))
+		return 0;
+	    break;
+	default:
+	    return 0;
+	}
+
+    return 1;
+}
+
+static int eligibleExpr(ir_expr *expn){
+    if(expn == NULL)
+	return 1;
+
+    return expn->lt != STRING && eligibleExpr(expn->l) && eligibleExpr(expn->r);
+}
+
+static int maxSlot(ir_stmt *stmt, int max){
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->slot > max)
+	    max = stmt->slot;
+	max = maxExprSlot(stmt->expn,  max);
+	max = maxExprSlot(stmt->expn2, max);
+	max = maxSlot(stmt->body, max);
+    }
+
+    return max;
+}
+
+static int maxExprSlot(ir_expr *expn, int max){
+    if(expn == NULL)
+	return max;
+
+    if(expn->op == IR_VAR && expn->slot > max)
+	max = expn->slot;
+
+    return maxExprSlot(expn->r, maxExprSlot(expn->l, max));
+}
+
+static void accesses(ir_stmt *stmt, char *defined){
+    parallel_role  role;
+    char          *inner;
+
+    for(; stmt != NULL; stmt = stmt->next){
+	if(stmt->kind == IR_FOR){
+	    reads(stmt->expn,  defined, -1);
+	    reads(stmt->expn2, defined, -1);
+	    plain_write[stmt->slot] = 1;
+	    defined[stmt->slot]     = 1;
+
+	    inner = (char*)memcpy(malloc(nslots), defined, nslots);
+	    accesses(stmt->body, inner);
+	    free(inner);
+	    continue;
+	}
+
+	if(stmt->kind == IR_ASSERT){
+	    reads(stmt->expn, defined, -1);
+	    continue;
+	}
+
+	role = reduction(stmt);
+	reads(stmt->expn, defined, role == PARALLEL_SHARED ? -1 : stmt->slot);
+
+	if(role == PARALLEL_SHARED)
+	    plain_write[stmt->slot] = 1;
+	else if(reduced[stmt->slot] != PARALLEL_SHARED && reduced[stmt->slot] != role)
+	    plain_write[stmt->slot] = 1;
+	else
+	    reduced[stmt->slot] = role;
+
+	defined[stmt->slot] = 1;
+    }
+}
+
+/*
+ * Every read of an undefined slot is exposed. The read of the
+ * slot skip, the operand of a reduction, is not a plain read.
+ */
+static void reads(ir_expr *expn, char *defined, int skip){
+    if(expn == NULL)
+	return;
+
+    if(expn->op == IR_VAR){
+	if(!defined[expn->slot])
+	    exposed[expn->slot] = 1;
+	if(expn->slot != skip)
+	    plain_read[expn->slot] = 1;
+    }
+
+    reads(expn->l, defined, skip);
+    reads(expn->r, defined, skip);
+}
+
+/*
+ * Returns the role of the target of the assignment *stmt if it
+ * is a reduction, and PARALLEL_SHARED otherwise. The operand other
+ * than the target may not read the target.
+ */
+static parallel_role reduction(ir_stmt *stmt){
+    ir_expr *e = stmt->expn, *operand;
+
+    if(e->l == NULL || e->r == NULL)
+	return PARALLEL_SHARED;
+
+    if(e->l->op == IR_VAR && e->l->slot == stmt->slot)
+	operand = e->r;
+    else if(e->r->op == IR_VAR && e->r->slot == stmt->slot && e->op != IR_SUB)
+	operand = e->l;
+    else
+	return PARALLEL_SHARED;
+
+    if(readsSlot(operand, stmt->slot))
+	return PARALLEL_SHARED;
+
+    switch(e->op){
+    case IR_ADD:
+    case IR_SUB:
+	return stmt->lt == INT  ? PARALLEL_SUM         : PARALLEL_SHARED;
+    case IR_MUL:
+	return stmt->lt == INT  ? PARALLEL_PRODUCT     : PARALLEL_SHARED;
+    case IR_AND:
+	return stmt->lt == BOOL ? PARALLEL_CONJUNCTION : PARALLEL_SHARED;
+    default:
+	return PARALLEL_SHARED;
+    }
+}
+
+static int readsSlot(ir_expr *expn, int slot){
+    if(expn == NULL)
+	return 0;
+
+    if(expn->op == IR_VAR)
+	return expn->slot == slot;
+
+    return readsSlot(expn->l, slot) || readsSlot(expn->r, slot);
+}
+
+static void runChunk(void *arg, int k){
+    chunk *ch = (chunk*)arg + k;
+
+    if(ch->c->vector != NULL){
+	vectorRun(ch->c, &ch->f, ch->start, ch->end);
+	return;
+    }
+
+    for(int i = ch->start; i <= ch->end; i++){
+	ch->f.env[ch->c->slot].i = i;
+	execClosures(ch->c->body, &ch->f);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef PARALLEL_HEADER
+#define PARALLEL_HEADER
+
+#include "ir.h"
+#include "closure.h"
+
+/*
+ * This file contains the declarations of the parallel execution
+ * of reduction loops. A for loop can be run in parallel if its
+ * iterations only depend on each other through reductions: integer
+ * +, - and *, and boolean &. The body may contain only integer and
+ * boolean assignments and other such loops, and no expression of
+ * it may fail.
+ *
+ * The range is split into chunks, which are run with the closures
+ * of the body on the thread pool, each with a copy of the frame.
+ * The partial results are combined in the order of the chunks.
+ * The arithmetic wraps around, so the operators are associative
+ * and commutative, and every variable gets exactly the value the
+ * serial loop would give it.
+ */
+
+/*
+ * Loops with fewer iterations than this are run serially. A
+ * chunk has at least PARALLEL_CHUNK iterations and every thread
+ * gets at most PARALLEL_CHUNKS chunks.
+ */
+#define PARALLEL_MIN_TRIPS 4096
+#define PARALLEL_CHUNK     1024
+#define PARALLEL_CHUNKS    4
+
+/*
+ * The roles of the variable slots in a parallel loop. A shared
+ * slot is not written by the loop. A private slot is written
+ * before it is read in every iteration, so its final value is the
+ * one of the last iteration. The control variable is private.
+ */
+typedef enum PARALLEL_ROLE {
+    PARALLEL_SHARED = 0,
+    PARALLEL_PRIVATE,
+    PARALLEL_SUM,           // r := r + e and r := r - e
+    PARALLEL_PRODUCT,       // r := r * e
+    PARALLEL_CONJUNCTION    // r := r & e
+} parallel_role;
+
+/* The slots 0 .. nslots -1 cover every slot the loop uses. */
+typedef struct PARALLEL_LOOP{
+    int            nslots;
+    parallel_role  roles[];
+} parallel_loop;
+
+/*
+ * Returns the roles of the slots in the for statement *forstmt,
+ * or NULL if the loop can not be run in parallel.
+ */
+extern parallel_loop *parallelLoop (ir_stmt *forstmt);
+
+/*
+ * Returns the roles of the slots in the for statement *forstmt,
+ * whose body may contain only assignments, asserts and for loops,
+ * or NULL if some slot written by the loop has no role.
+ */
+extern parallel_loop *loopRoles    (ir_stmt *forstmt);
+
+/*
+ * Runs the iterations from start to end of the loop *c, whose
+ * roles are in c->parallel, and updates the frame *f as the
+ * serial loop would. Returns 0 without running anything if the
+ * loop should be run serially: there is one thread only, the
+ * range is short, or the loop is inside another parallel loop.
+ */
+extern int            parallelRun  (stmt_closure *c, frame *f, int start, int end);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "tokens.h"
 #include "tree.h"
@@ -28,15 +29,22 @@ static binary_expression_node   *binaryExpression   (void);
 static operand_node             *operand            (void);
 static operand_suffix_node      *operandSuffix      (void);
 static enclosed_expression_node *enclosedExpression (void);
+static operand_node            **firstOperand       (expression_node *expn);
+static operand_node            **nextOperand        (expression_node *expn, operand_node **opern);
 static assert_node              *assert             (void);
 static read_node                *read               (void);
 static print_node               *print              (void);
+static index_node               *indexSuffix        (token *array);
+static index_node               *openIndex          (token *array);
+static length_node              *length             (void);
 
 
 /* These are the declarations of the helper functions used in parser. */
 static void                      printError         (token *t                          );
 static void                      discardTokens      (enum discard_option o             );
 static token                    *match              (token_type tt, consumption_type ct);
+static token                    *closeOperand       (operand_node *opern               );
+static int                       lengthFollows      (void                              );
 
 
 static token_list *global_tlist;  // Points to the next unhandled token.
@@ -130,16 +138,25 @@ static program_node *program(void){
 }
 
 static stmts_node *stmts(void){
-    stmts_node *sln = newStmtsNode();
+    stmts_node *head = NULL, **tail = &head;
     token *t;
 
-    if((t = match(TOKEN_VARKEY,     NO_CONSUME))  != NULL ||
-       (t = match(TOKEN_IDENTIFIER, NO_CONSUME))  != NULL ||
-       (t = match(TOKEN_FORKEY,     NO_CONSUME))  != NULL ||
-       (t = match(TOKEN_READKEY,    NO_CONSUME))  != NULL ||
-       (t = match(TOKEN_PRINTKEY,   NO_CONSUME))  != NULL ||
-       (t = match(TOKEN_ASSERTKEY,  NO_CONSUME))  != NULL
-       ){
+    /*
+     * The statements are parsed in a loop and linked to the end of
+     * the list, so that the depth of the C stack does not depend on
+     * the length of the program.
+     */
+    while((t = match(TOKEN_VARKEY,     NO_CONSUME))  != NULL ||
+	  (t = match(TOKEN_IDENTIFIER, NO_CONSUME))  != NULL ||
+	  (t = match(TOKEN_FORKEY,     NO_CONSUME))  != NULL ||
+	  (t = match(TOKEN_READKEY,    NO_CONSUME))  != NULL ||
+	  (t = match(TOKEN_PRINTKEY,   NO_CONSUME))  != NULL ||
+	  (t = match(TOKEN_ASSERTKEY,  NO_CONSUME))  != NULL
+	  ){
+	stmts_node *sln = newStmtsNode();
+
+	*tail = sln;
+	tail  = &sln->stmtsn;
 
 	/*
 	 * If the statement() function returns an error, the parser tries to recover
@@ -164,17 +181,9 @@ static stmts_node *stmts(void){
 	    fprintf(stderr, "Syntax  error in line %3d: Expected semicolon.\n", t->line_number);
 	    discardTokens(AFTER_SEMICOLON);
 	}
-
-	if((sln->stmtsn = stmts()) != error)
-	    return sln;
-	    
-	freeStmts(sln);
-	return error;
-	    
     }
     
-    freeStmts(sln);
-    return NULL;
+    return head;
 }
 
 static statement_node *statement(void){
@@ -238,8 +247,9 @@ static declaration_node *declaration(void){
 	if((decn->id                                        = match(TOKEN_IDENTIFIER,      CONSUME)) != NULL )
 	    if((decn->col                                   = match(TOKEN_COL,             CONSUME)) != NULL )
 		if((decn->typeKey                           = match(TOKEN_TYPEKEY,         CONSUME)) != NULL )
-		    if((decn->asn                           = declarationSuffix()                  ) != error)
-			return decn;
+		    if((decn->dimn                          = indexSuffix(decn->id)                ) != error)
+			if((decn->asn                       = declarationSuffix()                  ) != error)
+			    return decn;
     }
     	
     freeDeclaration(decn);
@@ -251,9 +261,10 @@ static assignment_node *assignment(void){
     assignment_node *assn = newAssignmentNode();
 
     if((assn->id                                            = match(TOKEN_IDENTIFIER,      CONSUME)) != NULL ){
-	if((assn->assOp                                     = match(TOKEN_ASSIGN,          CONSUME)) != NULL )
-	    if((assn->expn                                  = expression()                         ) != error)
-		return assn;
+	if((assn->indexn                                    = indexSuffix(assn->id)                ) != error)
+	    if((assn->assOp                                 = match(TOKEN_ASSIGN,          CONSUME)) != NULL )
+		if((assn->expn                              = expression()                         ) != error)
+		    return assn;
     }
 
     freeAssignment(assn);
@@ -276,40 +287,116 @@ static declaration_suffix_node *declarationSuffix(void){
     return NULL;
 }
 
+/*
+ * An expression in parentheses, or the index of an element, is an
+ * operand of the enclosing expression. The expressions are parsed
+ * in a loop, and the operands whose parentheses or brackets are
+ * open are kept in an explicit stack instead of the C stack, so
+ * that deeply nested expressions can be parsed. Every new node is
+ * linked to the tree at once, so that the whole tree can be freed
+ * with the root in case of error.
+ */
+typedef struct OPEN_OPERAND{
+    expression_node  *expn;    // The enclosing expression.
+    operand_node    **opern;   // The operand in parentheses or brackets.
+} open_operand;
+
 static expression_node *expression(void){
-    expression_node *expn = newExpressionNode();
-    
-    if((                                                      match(TOKEN_UN_OP,        NO_CONSUME)) != NULL ){
-	if((expn->unaryen                                   = unaryExpression()                    ) != error)
-	    return expn;
+    expression_node  *root  = newExpressionNode();
+    expression_node  *expn  = root;
+    operand_node    **opern = firstOperand(expn), **next;
+    open_operand     *open  = NULL;
+    int               depth = 0, size = 0, closed = 1;
+
+    while((*opern = operand()) != error){
+
+	/* An opening parenthesis or bracket starts a new expression. */
+	if((*opern)->expren != NULL || (*opern)->indexn != NULL){
+	    if(depth == size){
+		size = size == 0 ? 16 : 2 * size;
+		open = (open_operand*)realloc(open, size * sizeof(open_operand));
+	    }
+	    open[depth].expn    = expn;
+	    open[depth++].opern = opern;
+
+	    if((*opern)->expren != NULL)
+		expn = (*opern)->expren->expn = newExpressionNode();
+	    else
+		expn = (*opern)->indexn->expn = newExpressionNode();
+	    opern = firstOperand(expn);
+	    continue;
+	}
+
+	/*
+	 * The operand is followed by the next operand of the same
+	 * expression, or it completes the expression and the
+	 * closing parenthesis or bracket of the enclosing operand
+	 * follows.
+	 */
+	while((next = nextOperand(expn, opern)) == NULL && depth > 0){
+	    expn  = open[--depth].expn;
+	    opern = open[depth].opern;
+	    if((closed = closeOperand(*opern) != NULL) == 0)
+		break;
+	}
+
+	if(next != NULL){
+	    opern = next;
+	    continue;
+	}
+
+	if(!closed)
+	    break;
+
+	free(open);
+	return root;
     }
-    else if ((expn->binaryen                                = binaryExpression()                   ) != error)
-	return expn;
 
-    freeExpression(expn);
+    free(open);
+    freeExpression(root);
     return error;
 }
 
+/*
+ * Starts the expression *expn and returns the place of its
+ * first operand. Only the operator of a unary expression is
+ * parsed here.
+ */
+static operand_node **firstOperand(expression_node *expn){
+    if(match(TOKEN_UN_OP, NO_CONSUME) != NULL){
+	expn->unaryen = unaryExpression();
+	return &expn->unaryen->opern;
+    }
+
+    expn->binaryen = binaryExpression();
+    return &expn->binaryen->opern;
+}
+
+/*
+ * Returns the place of the operand that follows the operand
+ * *opern in the expression *expn, or NULL if the expression is
+ * complete.
+ */
+static operand_node **nextOperand(expression_node *expn, operand_node **opern){
+    if(expn->binaryen == NULL || opern != &expn->binaryen->opern)
+	return NULL;
+
+    if((expn->binaryen->osn = operandSuffix()) == NULL)
+	return NULL;
+
+    return &expn->binaryen->osn->opn;
+}
+
 static unary_expression_node *unaryExpression(void){
     unary_expression_node *uexpn = newUnaryExpressionNode();
 
-    if((uexpn->unop                                         = match(TOKEN_UN_OP,           CONSUME)) != NULL )
-	if((uexpn->opern                                    = operand()                            ) != error)
-	    return uexpn;
+    uexpn->unop = match(TOKEN_UN_OP, CONSUME);
 
-    freeUnaryExpression(uexpn);
-    return error;
+    return uexpn;
 }
 
 static binary_expression_node *binaryExpression(void){
-    binary_expression_node *bexpn = newBinaryExpressionNode();
-
-    if((bexpn->opern                                        = operand()                            ) != error)
-	if((bexpn->osn                                      = operandSuffix()                      ) != error)
-	    return bexpn;
-
-    freeBinaryExpression(bexpn);
-    return error;
+    return newBinaryExpressionNode();
 }
 
 static operand_node *operand(void){
@@ -319,9 +406,15 @@ static operand_node *operand(void){
 	return operandn;
     if((operandn->strLit                                    = match(TOKEN_STRING_LITERAL,  CONSUME)) != NULL )
 	return operandn;
-    if((operandn->id                                        = match(TOKEN_IDENTIFIER,      CONSUME)) != NULL )
+    if(lengthFollows()){
+	if((operandn->lengthn                               = length()                             ) != error)
+	    return operandn;
+    }
+    else if((operandn->id                                   = match(TOKEN_IDENTIFIER,      CONSUME)) != NULL ){
+	operandn->indexn                                    = openIndex(operandn->id);
 	return operandn;
-    if((operandn->expren                                    = enclosedExpression()                 ) != error)
+    }
+    else if((operandn->expren                               = enclosedExpression()                 ) != error)
 	return operandn;
 
     freeOperand(operandn);
@@ -331,24 +424,22 @@ static operand_node *operand(void){
 static operand_suffix_node *operandSuffix(void){
     operand_suffix_node *osn = newOperandSuffixNode();
 
-    if((osn->op                                             = match(TOKEN_BIN_OP,          CONSUME)) != NULL ){
-	if((osn->opn                                        = operand()                            ) != error)
-	    return osn;
-
-	return error;
-    }
+    if((osn->op                                             = match(TOKEN_BIN_OP,          CONSUME)) != NULL )
+	return osn;
     
     freeOperandSuffix(osn);
     return NULL;
 }
 
+/*
+ * Only the opening parenthesis is parsed here. The expression
+ * and the closing parenthesis are parsed by expression().
+ */
 static enclosed_expression_node *enclosedExpression(void){
     enclosed_expression_node *expen = newEnclosedExpressionNode();
 
     if((expen->lPar                                         = match(TOKEN_LPAR,            CONSUME)) != NULL )
-	if((expen->expn                                     = expression()                         ) != error)
-	    if((expen->rPar                                 = match(TOKEN_RPAR,            CONSUME)) != NULL )
-		return expen;
+	return expen;
 
     freeEnclosedExpression(expen);
     return error;
@@ -372,7 +463,8 @@ static read_node *read(void){
 
     if((readn->read                                        = match(TOKEN_READKEY,          CONSUME)) != NULL)
 	if((readn->id                                      = match(TOKEN_IDENTIFIER,       CONSUME)) != NULL)
-	    return readn;
+	    if((readn->indexn                              = indexSuffix(readn->id)                ) != error)
+		return readn;
 
     freeRead(readn);
     return error;
@@ -389,6 +481,55 @@ static print_node *print(void){
     return error;
 }
 
+/*
+ * The index that may follow the array of an assignment or a read
+ * statement. Returns NULL if there is no index. The indexes in its
+ * expression are parsed by expression() without recursion.
+ */
+static index_node *indexSuffix(token *array){
+    index_node *indexn;
+
+    if((indexn = openIndex(array)) == NULL)
+	return NULL;
+
+    if((indexn->expn                                       = expression()                          ) != error)
+	if((indexn->rBracket                               = match(TOKEN_RBRACKET,         CONSUME)) != NULL )
+	    return indexn;
+
+    freeIndex(indexn);
+    return error;
+}
+
+/*
+ * Only the opening bracket of an index is parsed here, as in
+ * enclosedExpression(). Returns NULL if there is no index.
+ */
+static index_node *openIndex(token *array){
+    index_node *indexn;
+
+    if(match(TOKEN_LBRACKET, NO_CONSUME) == NULL)
+	return NULL;
+
+    indexn           = newIndexNode();
+    indexn->array    = array;
+    indexn->lBracket = match(TOKEN_LBRACKET, CONSUME);
+
+    return indexn;
+}
+
+static length_node *length(void){
+    length_node *lengthn = newLengthNode();
+
+    if((lengthn->len                                       = match(TOKEN_IDENTIFIER,       CONSUME)) != NULL )
+	if((lengthn->lPar                                  = match(TOKEN_LPAR,             CONSUME)) != NULL )
+	    if((lengthn->id                                = match(TOKEN_IDENTIFIER,       CONSUME)) != NULL )
+		if((lengthn->rPar                          = match(TOKEN_RPAR,             CONSUME)) != NULL )
+		    return lengthn;
+
+    freeLength(lengthn);
+    return error;
+}
+
 /*
  * This function checks whether the next token in the
  * stream is that the caller is looking for. Parameter
@@ -413,6 +554,30 @@ static token *match(token_type tt, consumption_type ct){
     return NULL;
 }
 
+/*
+ * Matches the closing parenthesis or bracket of the operand that
+ * was opened in expression(). Returns NULL if it is missing.
+ */
+static token *closeOperand(operand_node *opern){
+    if(opern->expren != NULL)
+	return opern->expren->rPar = match(TOKEN_RPAR, CONSUME);
+
+    return opern->indexn->rBracket = match(TOKEN_RBRACKET, CONSUME);
+}
+
+/*
+ * The length of an array is len(a). len is not a keyword, so a
+ * variable may be called len; an identifier is never followed by
+ * a parenthesis otherwise, so the parenthesis tells them apart.
+ */
+static int lengthFollows(void){
+    token *t = match(TOKEN_IDENTIFIER, NO_CONSUME);
+
+    return t != NULL && strncmp(t->value, "len", TOKEN_MAX_LENGTH) == 0 &&
+	global_tlist->next != NULL && global_tlist->next->value != NULL &&
+	global_tlist->next->value->type == TOKEN_LPAR;
+}
+
 /*
  * This function is used to discard all following tokens
  * to the next semicolon. This way the syntax analyzing 
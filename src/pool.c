@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/* Helper functions used only in this translation unit. */
+static void  start  (void);
+static void  stop   (void);
+static void *worker (void *unused);
+static void  work   (void);
+
+static int        threads;
+static pthread_t *workers;
+static int        nworkers;
+
+/*
+ * The job being run. The tasks are handed out in the order of
+ * their numbers. A new job is announced by incrementing the
+ * generation. Everything is guarded by lock.
+ */
+static pthread_mutex_t lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  posted  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  done    = PTHREAD_COND_INITIALIZER;
+static void          (*job)(void *arg, int k);
+static void           *job_arg;
+static int             job_size;
+static int             job_next;
+static int             job_left;
+static unsigned        generation;
+static int             stopping;
+
+void poolOptions(int n){
+    threads = n;
+}
+
+int poolThreads(void){
+    if(threads < 1){
+	long n  = sysconf(_SC_NPROCESSORS_ONLN);
+	threads = n < 1 ? 1 : (int)n;
+    }
+
+    return threads;
+}
+
+void poolRun(void (*task)(void *arg, int k), void *arg, int ntasks){
+    if(ntasks <= 1 || poolThreads() == 1){
+	for(int k = 0; k < ntasks; k++)
+	    task(arg, k);
+	return;
+    }
+
+    if(workers == NULL)
+	start();
+
+    pthread_mutex_lock(&lock);
+    job      = task;
+    job_arg  = arg;
+    job_size = ntasks;
+    job_next = 0;
+    job_left = ntasks;
+    generation++;
+    pthread_cond_broadcast(&posted);
+
+    work();
+    while(job_left > 0)
+	pthread_cond_wait(&done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * If a thread can not be created, the pool goes on with the
+ * threads it has.
+ */
+static void start(void){
+    workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+
+    for(nworkers = 0; nworkers < threads -1; nworkers++)
+	if(pthread_create(&workers[nworkers], NULL, worker, NULL) != 0)
+	    break;
+
+    atexit(stop);
+}
+
+static void stop(void){
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&posted);
+    pthread_mutex_unlock(&lock);
+
+    for(int i = 0; i < nworkers; i++)
+	pthread_join(workers[i], NULL);
+
+    free(workers);
+    workers  = NULL;
+    nworkers = 0;
+    stopping = 0;
+}
+
+static void *worker(void *unused){
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&lock);
+    for(;;){
+	while(generation == seen && !stopping)
+	    pthread_cond_wait(&posted, &lock);
+	if(stopping)
+	    break;
+	seen = generation;
+	work();
+    }
+    pthread_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+/* Runs the tasks of the job that are left. Called with lock held. */
+static void work(void){
+    int k;
+
+    while(job_next < job_size){
+	k = job_next++;
+	pthread_mutex_unlock(&lock);
+	job(job_arg, k);
+	pthread_mutex_lock(&lock);
+	if(--job_left == 0)
+	    pthread_cond_broadcast(&done);
+    }
+}
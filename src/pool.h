@@ -0,0 +1,30 @@
+#ifndef POOL_HEADER
+#define POOL_HEADER
+
+/*
+ * This file contains the declarations of the thread pool. The
+ * pool runs the tasks of one job at a time: the tasks are numbered
+ * from 0 and every task is a call of the same function with its
+ * number. The calling thread takes part in running the tasks.
+ *
+ * The worker threads are started when the first job with more
+ * than one task is run, and they are stopped at exit.
+ */
+
+/*
+ * Sets the number of threads, the caller included. A number less
+ * than 1 selects the number of processors online.
+ */
+extern void poolOptions (int threads);
+
+/* Returns the number of threads. */
+extern int  poolThreads (void);
+
+/*
+ * Runs task(arg, k) for every k from 0 to ntasks -1 and returns
+ * when all of them have returned. The tasks may run in any order
+ * and concurrently, so they may not write the same memory.
+ */
+extern void poolRun     (void (*task)(void *arg, int k), void *arg, int ntasks);
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * This file contains the runtime of the programs compiled with
+ * minipl --emit-asm. The runtime is freestanding: it does not use
+ * the C library and talks to the Linux kernel with system calls,
+ * so the compiled programs can be linked with ld alone:
+ *
+ *     as -o program.o program.s
+ *     ld -o program program.o minipl_rt.o
+ *
+ * The generated code calls the functions below with the System V
+ * calling convention. Strings are null terminated and immutable.
+ */
+
+#define SYS_READ   0
+#define SYS_WRITE  1
+#define SYS_BRK   12
+#define SYS_EXIT  60
+
+#define BUFFER_SIZE 65536
+
+enum error_type {SEMANTIC_ERROR, RUNTIME_ERROR};
+
+/* The function main of the compiled program. */
+extern int mpl_main(void);
+
+/* Helper functions used only in this translation unit. */
+static long  syscall3  (long n, long a, long b, long c);
+static void  flush     (void);
+static void  put       (const char *s, long n);
+static int   next      (void);
+static char *allocate  (long n);
+static long  length    (const char *s);
+
+static char output[BUFFER_SIZE];
+static long output_size;
+
+static char input[BUFFER_SIZE];
+static long input_size;
+static long input_position;
+static int  input_eof;
+
+static char *heap;
+static char *heap_end;
+
+/*
+ * Entry point of the program. The stack is aligned by the
+ * call, as the calling convention expects.
+ */
+__asm__(".globl _start\n"
+	"_start:\n"
+	"\txorl %ebp, %ebp\n"
+	"\tcall mpl_start\n"
+	"\thlt\n");
+
+void mpl_start(void){
+    int tmp = mpl_main();
+
+    flush();
+    syscall3(SYS_EXIT, tmp, 0, 0);
+}
+
+/*
+ * OUTPUT --------------------------------------------------------------
+ */
+
+void mpl_print_string(const char *s){
+    put(s, length(s));
+}
+
+void mpl_print_int(int v){
+    char          tmp[12];
+    int           i = 12;
+    unsigned int  u = v < 0 ? -(unsigned int)v : (unsigned int)v;
+
+    do{
+	tmp[--i] = '0' + u % 10;
+	u /= 10;
+    } while(u != 0);
+
+    if(v < 0)
+	tmp[--i] = '-';
+
+    put(tmp + i, 12 - i);
+}
+
+/*
+ * Error messages are written directly to the standard error,
+ * in the same format as the interpreter uses.
+ */
+void mpl_write_error(const char *s){
+    syscall3(SYS_WRITE, 2, (long)s, length(s));
+}
+
+void mpl_error(int line, const char *message, int et){
+    char  tmp[256];
+    char  number[12];
+    long  n = 0, i = 12;
+    const char *s;
+
+    for(s = et == SEMANTIC_ERROR ? "Semantic error in line " : "Runtime error  in line "; *s; s++)
+	tmp[n++] = *s;
+
+    do{
+	number[--i] = '0' + line % 10;
+	line /= 10;
+    } while(line != 0);
+    for(; i > 9; i--)
+	number[i -1] = ' ';
+    for(; i < 12; i++)
+	tmp[n++] = number[i];
+
+    tmp[n++] = ':';
+    tmp[n++] = ' ';
+    for(s = message; *s && n < 250; s++)
+	tmp[n++] = *s;
+    tmp[n++] = '.';
+    tmp[n++] = '\n';
+
+    syscall3(SYS_WRITE, 2, (long)tmp, n);
+}
+
+/*
+ * INPUT ---------------------------------------------------------------
+ *
+ * The input is parsed like scanf("%d") and scanf("%s") would do,
+ * except that an integer that does not fit in an int is not read.
+ */
+
+static int space(int c){
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+int mpl_read_int(int *v, int line){
+    unsigned value = 0, limit = 0x7fffffffU;
+    int      c, negative = 0, digits = 0;
+
+    while((c = next()) >= 0 && space(c))
+	input_position++;
+
+    if(c == '+' || c == '-'){
+	negative = c == '-';
+	input_position++;
+	c = next();
+    }
+
+    limit += negative;
+    for(; c >= '0' && c <= '9'; c = next()){
+	if(value > (limit - (c - '0')) / 10){
+	    digits = 0;
+	    break;
+	}
+	input_position++;
+	digits++;
+	value = value * 10 + (c - '0');
+    }
+
+    if(digits == 0){
+	mpl_error(line, "Failed to read integer", RUNTIME_ERROR);
+	return 0;
+    }
+
+    *v = (int)(negative ? 0U - value : value);
+    return 1;
+}
+
+int mpl_read_string(char **v, int line){
+    long n = 0;
+    int  c;
+
+    while((c = next()) >= 0 && space(c))
+	input_position++;
+
+    if(c < 0){
+	mpl_error(line, "Failed to read string", RUNTIME_ERROR);
+	return 0;
+    }
+
+    /*
+     * The word is collected to the heap one character at a time.
+     * Nothing else is allocated meanwhile, so the word stays contiguous.
+     */
+    char *s = allocate(1);
+    for(; c >= 0 && !space(c); c = next()){
+	input_position++;
+	allocate(1);
+	s[n++] = (char)c;
+    }
+    s[n] = '\0';
+
+    *v = s;
+    return 1;
+}
+
+/*
+ * STRINGS -------------------------------------------------------------
+ */
+
+char *mpl_concat(const char *l, const char *r){
+    long  ll = length(l), rl = length(r), i;
+    char *s = allocate(ll + rl +1);
+
+    for(i = 0; i < ll; i++)
+	s[i] = l[i];
+    for(i = 0; i <= rl; i++)
+	s[ll + i] = r[i];
+
+    return s;
+}
+
+int mpl_less(const char *l, const char *r){
+    for(; *l && *l == *r; l++, r++)
+	;
+
+    return (unsigned char)*l < (unsigned char)*r;
+}
+
+int mpl_equal(const char *l, const char *r){
+    for(; *l && *l == *r; l++, r++)
+	;
+
+    return *l == *r;
+}
+
+/*
+ * HELPERS -------------------------------------------------------------
+ */
+
+static long syscall3(long n, long a, long b, long c){
+    long r;
+
+    __asm__ volatile("syscall"
+		     : "=a"(r)
+		     : "a"(n), "D"(a), "S"(b), "d"(c)
+		     : "rcx", "r11", "memory");
+    return r;
+}
+
+static void flush(void){
+    long i = 0, r;
+
+    while(i < output_size){
+	r = syscall3(SYS_WRITE, 1, (long)(output + i), output_size - i);
+	if(r <= 0)
+	    break;
+	i += r;
+    }
+
+    output_size = 0;
+}
+
+static void put(const char *s, long n){
+    for(long i = 0; i < n; i++){
+	if(output_size == BUFFER_SIZE)
+	    flush();
+	output[output_size++] = s[i];
+    }
+}
+
+/* Returns the next input character without consuming it, or -1. */
+static int next(void){
+    if(input_position == input_size){
+	if(input_eof)
+	    return -1;
+
+	input_size     = syscall3(SYS_READ, 0, (long)input, BUFFER_SIZE);
+	input_position = 0;
+	if(input_size <= 0){
+	    input_size = 0;
+	    input_eof  = 1;
+	    return -1;
+	}
+    }
+
+    return (unsigned char)input[input_position];
+}
+
+/*
+ * The memory is never freed. The heap grows with brk in
+ * steps of at least one megabyte.
+ */
+static char *allocate(long n){
+    char *r;
+
+    if(heap == 0)
+	heap = heap_end = (char*)syscall3(SYS_BRK, 0, 0, 0);
+
+    if(heap + n > heap_end){
+	long grow = n > (1 << 20) ? n : (1 << 20);
+	heap_end  = (char*)syscall3(SYS_BRK, (long)(heap_end + grow), 0, 0);
+    }
+
+    r     = heap;
+    heap += n;
+    return r;
+}
+
+static long length(const char *s){
+    long n = 0;
+
+    while(s[n])
+	n++;
+
+    return n;
+}
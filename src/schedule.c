@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "label.h"
+#include "ir.h"
+#include "closure.h"
+#include "schedule.h"
+#include "pool.h"
+
+/*
+ * Level l has the statements stmts[starts[l]] .. stmts[starts[l +1] -1]
+ * in the order of the program. The arrays are allocated in one block
+ * with the schedule.
+ */
+struct SCHEDULE{
+    int            nlevels ;
+    int            width   ;   // Number of statements on the widest level.
+    stmt_closure **stmts   ;
+    int           *starts  ;
+};
+
+/* A statement run on the thread pool, and its frame. */
+typedef struct TASK{
+    stmt_closure  *c  ;
+    frame          f  ;
+    int            ok ;
+} task;
+
+/* Helper functions used only in this translation unit. */
+static int   ordered     (ir_stmt *stmt                    );
+static int   orderedExpr (ir_expr *expn                    );
+static void  place       (ir_stmt *stmt, int update        );
+static void  placeExpr   (ir_expr *expn, int update        );
+static void  access      (int slot, int write, int update  );
+static int   loops       (schedule *s, int l               );
+static void  runTask     (void *arg, int k                 );
+
+/*
+ * The levels of the last statements that wrote and read every
+ * slot so far, and the level of the statement being placed.
+ */
+static int *last_write;
+static int *last_read;
+static int  level;
+
+/*
+ * A statement is placed in two passes over its accesses. The first
+ * one finds its level, and the second one records the accesses.
+ */
+schedule *scheduleStatements(ir_stmt *stmts, stmt_closure *c, int nslots){
+    schedule  *s;
+    ir_stmt   *stmt;
+    int       *levels, *next, n = 0, nlevels = 0, last_ordered = -1, k;
+
+    for(stmt = stmts; stmt != NULL; stmt = stmt->next)
+	n++;
+
+    levels     = (int*)malloc(sizeof(int) * (n +1));
+    last_write = (int*)malloc(sizeof(int) * (nslots +1));
+    last_read  = (int*)malloc(sizeof(int) * (nslots +1));
+
+    for(k = 0; k <= nslots; k++)
+	last_write[k] = last_read[k] = -1;
+
+    for(stmt = stmts, k = 0; stmt != NULL; stmt = stmt->next, k++){
+	level = 0;
+	place(stmt, 0);
+	if(ordered(stmt)){
+	    if(level <= last_ordered)
+		level = last_ordered +1;
+	    last_ordered = level;
+	}
+	place(stmt, 1);
+
+	levels[k] = level;
+	if(level >= nlevels)
+	    nlevels = level +1;
+    }
+
+    free(last_write);
+    free(last_read);
+
+    if(nlevels == n){
+	free(levels);
+	return NULL;
+    }
+
+    s = (schedule*)malloc(sizeof(schedule) + sizeof(stmt_closure*) * n +
+			  sizeof(int) * (nlevels +1));
+    s->nlevels = nlevels;
+    s->width   = 0;
+    s->stmts   = (stmt_closure**)(s +1);
+    s->starts  = (int*)(s->stmts + n);
+
+    /* The statements are sorted by their level, keeping their order. */
+    memset(s->starts, 0, sizeof(int) * (nlevels +1));
+    for(k = 0; k < n; k++)
+	s->starts[levels[k] +1]++;
+    for(k = 0; k < nlevels; k++){
+	if(s->starts[k +1] > s->width)
+	    s->width = s->starts[k +1];
+	s->starts[k +1] += s->starts[k];
+    }
+
+    next = (int*)memcpy(malloc(sizeof(int) * nlevels), s->starts, sizeof(int) * nlevels);
+    for(k = 0; c != NULL; c = c->next, k++)
+	s->stmts[next[levels[k]]++] = c;
+
+    free(next);
+    free(levels);
+
+    return s;
+}
+
+/*
+ * A level with fewer than two loops is not worth the threads, and
+ * its statements are run in their order. Every loop of a level run
+ * on the pool is run serially by its thread.
+ */
+int runSchedule(schedule *s, frame *f){
+    task *tasks = (task*)malloc(sizeof(task) * s->width);
+    int   l, k, n, tmp = 1;
+
+    for(l = 0; l < s->nlevels && tmp; l++){
+	n = s->starts[l +1] - s->starts[l];
+
+	if(loops(s, l) < 2){
+	    for(k = s->starts[l]; k < s->starts[l +1] && tmp; k++)
+		tmp = s->stmts[k]->exec(s->stmts[k], f);
+	    continue;
+	}
+
+	for(k = 0; k < n; k++){
+	    tasks[k].c          = s->stmts[s->starts[l] + k];
+	    tasks[k].f          = *f;
+	    tasks[k].f.fault    = 0;
+	    tasks[k].f.parallel = 1;
+	}
+
+	poolRun(runTask, tasks, n);
+
+	for(k = 0; k < n; k++)
+	    tmp &= tasks[k].ok;
+    }
+
+    free(tasks);
+
+    return tmp;
+}
+
+static int loops(schedule *s, int l){
+    int k, n = 0;
+
+    for(k = s->starts[l]; k < s->starts[l +1]; k++)
+	n += s->stmts[k]->body != NULL;
+
+    return n;
+}
+
+static void runTask(void *arg, int k){
+    task *t = (task*)arg + k;
+
+    t->ok = t->c->exec(t->c, &t->f);
+}
+
+/*
+ * Reads, prints, asserts and the statements whose expressions
+ * may fail are ordered, and so are the loops containing them.
+ */
+static int ordered(ir_stmt *stmt){
+    ir_stmt *s;
+
+    switch(stmt->kind){
+    case IR_READ:
+    case IR_PRINT:
+    case IR_ASSERT:
+    case IR_TRAP:
+	return 1;
+    case IR_FOR:
+	for(s = stmt->body; s != NULL; s = s->next)
+	    if(ordered(s))
+		return 1;
+	return orderedExpr(stmt->expn) || orderedExpr(stmt->expn2);
+    default:
+	return orderedExpr(stmt->expn);
+    }
+}
+
+static int orderedExpr(ir_expr *expn){
+    return expn != NULL && expn->fault;
+}
+
+static void place(ir_stmt *stmt, int update){
+    ir_stmt *s;
+
+    placeExpr(stmt->expn,  update);
+    placeExpr(stmt->expn2, update);
+
+    switch(stmt->kind){
+    case IR_DECLARE:
+    case IR_ASSIGN:
+    case IR_READ:
+	access(stmt->slot, 1, update);
+	break;
+    case IR_FOR:
+	access(stmt->slot, 1, update);
+	for(s = stmt->body; s != NULL; s = s->next)
+	    place(s, update);
+	break;
+    }
+}
+
+/*
+ * Every slot owns its string, and a concatenation writes to a
+ * buffer of its own closure, so reading a string only reads the
+ * buffer of the slot. A statement that stores to the slot later
+ * is ordered after the read by access().
+ */
+static void placeExpr(ir_expr *expn, int update){
+    if(expn == NULL)
+	return;
+
+    if(expn->op == IR_VAR)
+	access(expn->slot, 0, update);
+
+    placeExpr(expn->l, update);
+    placeExpr(expn->r, update);
+}
+
+static void access(int slot, int write, int update){
+    if(update){
+	if(write && level > last_write[slot])
+	    last_write[slot] = level;
+	if(!write && level > last_read[slot])
+	    last_read[slot] = level;
+    } else {
+	if(last_write[slot] >= level)
+	    level = last_write[slot] +1;
+	if(write && last_read[slot] >= level)
+	    level = last_read[slot] +1;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SCHEDULE_HEADER
+#define SCHEDULE_HEADER
+
+#include "ir.h"
+#include "closure.h"
+
+/*
+ * This file contains the declarations of the concurrent execution
+ * of the top level statements. A statement depends on an earlier
+ * one if one of them writes a variable the other one reads or
+ * writes. A statement that reads or prints, or that may fail, is
+ * ordered: it depends on every earlier ordered statement.
+ *
+ * The statements are put on levels, every statement on the level
+ * after the last statement it depends on. The levels are run one
+ * after another, and the statements of a level concurrently on the
+ * thread pool. Since a level has at most one ordered statement, the
+ * input and the output keep their order, and the first error stops
+ * the program as in the sequential execution. The other statements
+ * may run earlier than in the sequential execution, but they have
+ * no effect anybody could see before the next ordered statement.
+ */
+
+typedef struct SCHEDULE schedule;
+
+/*
+ * Puts the top level statements *stmts, whose closures are *c,
+ * on levels. Returns NULL if every level would have only one
+ * statement. The schedule is freed with free().
+ */
+extern schedule *scheduleStatements (ir_stmt *stmts, stmt_closure *c, int nslots);
+
+/*
+ * Runs the scheduled statements with the frame *f. Returns 0 if
+ * a statement failed, 1 otherwise.
+ */
+extern int       runSchedule        (schedule *s, frame *f);
+
+#endif
@@ -6,6 +6,9 @@
 #include "tree.h"
 #include "label.h"
 #include "memory.h"
+#include "tier.h"
+#include "output.h"
+#include "input.h"
 
 
 /*
@@ -13,36 +16,64 @@
  */
 static int         insert             (token *id, value v        );
 static int         update             (token *id, value new_value);
-static void        forceUpdate        (token *id, value new_value);
+static void        forceUpdate        (token *id, value new_value, int constant);
 static int         isConstant         (token *id                 );
 static label_type  findLabelType      (token *id                 );
-static value       findLabelValue     (token *id                 );
 static int         getIntValue        (char  *data               );
 static label_list *findLabel          (token *id                 );
+static label_list *lookup             (token *id                 );
 static void        printValue         (value  v                  );
+static int        *element            (token *id, index_node *indexn);
+static int        *elementAt          (token *id, index_node *indexn, array *a, value *i);
+static array      *findArray          (token *id                 );
+static int         copyArray          (token *id, array *to, array *from);
+
+/*
+ * The expression functions return the status of the value they
+ * produce. An empty value means that the optional part of the
+ * tree was missing, and an error value that the evaluation failed
+ * (the error is already reported). In both cases the value has
+ * type UNDEF, so the type checks of the caller fail.
+ */
+enum value_status {VALUE_EMPTY, VALUE_ERROR, VALUE_OK};
+static enum value_status emptyValue   (value *v);
+static enum value_status errorValue   (value *v);
+static enum value_status operandError (value *v, value *suffix);
+
+/*
+ * Every string value owns a reference to its string. The
+ * references are taken and dropped with these functions.
+ */
+static void retain  (value *v);
+static void release (value *v);
 
 
 /*
  * The following function declarations represents the non-terminals
- * in the grammar. Each of them returns 0 if error is encountered.
- * 1 otherwise.
+ * in the grammar. Each of the statement functions returns 0 if error
+ * is encountered, 1 otherwise. The expression functions store their
+ * value to *v and return its status.
  */
-static int   program            (program_node             *pn     );
-static int   stmts              (stmts_node               *stmtsn );
-static int   statement          (statement_node           *stmtn  );
-static int   for_               (for_node                 *forn   );
-static int   declaration        (declaration_node         *decn   );
-static int   assignment         (assignment_node          *assn   );
-static value declarationSuffix  (declaration_suffix_node  *asn    );
-static value expression         (expression_node          *expn   );
-static value unaryExpression    (unary_expression_node    *uen    );
-static value binaryExpression   (binary_expression_node   *ben    );
-static value operand            (operand_node             *opn    );
-static value operandSuffix      (operand_suffix_node      *osn    );
-static value enclosedExpression (enclosed_expression_node *een    );
-static int   assert             (assert_node              *assertn);
-static int   read               (read_node                *readn  );
-static int   print              (print_node               *printn );
+static int               program            (program_node             *pn     );
+static int               stmts              (stmts_node               *stmtsn );
+static int               statement          (statement_node           *stmtn  );
+static int               for_               (for_node                 *forn   );
+static int               declaration        (declaration_node         *decn   );
+static int               assignment         (assignment_node          *assn   );
+static enum value_status declarationSuffix  (declaration_suffix_node  *asn    , value *v);
+static enum value_status expression         (expression_node          *expn   , value *v);
+static enum value_status unaryExpression    (unary_expression_node    *uen    , value *v);
+static enum value_status binaryExpression   (binary_expression_node   *ben    , value *v,
+					     enum value_status oper_status, value *suffix, enum value_status suffix_status);
+static enum value_status operand            (operand_node             *opn    , value *v);
+static enum value_status elementOperand     (operand_node             *opn    , value *v, enum value_status status);
+static int               assert             (assert_node              *assertn);
+static int               read               (read_node                *readn  );
+static int               print              (print_node               *printn );
+static int               arrayDeclaration   (declaration_node         *decn   );
+static int               elementAssignment  (assignment_node          *assn   );
+static int               readElement        (read_node                *readn  );
+static enum value_status length             (length_node              *lengthn, value *v);
 
 /*
  * Definition of type error_type and declaration od printError()
@@ -57,11 +88,92 @@ static void printError (token *t,  char *message, enum error_type et );
 static label_list *global_list;
 
 /*
- * The template values used in the functions.
+ * The assignment whose expression is being evaluated. In
+ * s := s + e the variable s hands its string over to the
+ * concatenation, see binaryExpression().
+ */
+static assignment_node *target;
+
+/*
+ * Expressions are evaluated with an explicit stack instead of
+ * recursion, so that deeply nested parentheses do not exhaust the
+ * C stack. There is an evaluation for every expression whose
+ * operands are being evaluated. The operands are evaluated in the
+ * order the interpreter has always used: the right operand of a
+ * binary expression before the left one.
  */
-static value default_value = {0, 0, NULL, 0, 0, 0, 0};
-static value empty_value   = {0, 0, NULL, 1, 0, 0, 0};
-static value error_value   = {0, 0, NULL, 0, 1, 0, 0};
+typedef struct EVALUATION{
+    expression_node   *expn;
+    int                stage;           // Number of operands evaluated.
+    value              oper;            // The operand of a unary expression or
+    enum value_status  oper_status;     // the left operand of a binary one.
+    value              suffix;          // The right operand of a binary expression.
+    enum value_status  suffix_status;
+} evaluation;
+
+static evaluation *evaluations;
+static int         evaluations_size;
+static int         evaluations_depth;
+
+static operand_node     *nextOperand (evaluation *e);
+static void              setOperand  (evaluation *e, value v, enum value_status status);
+static enum value_status evaluate    (evaluation *e, value *v);
+
+/*
+ * The bounds checks of the indexes a[i] in the body of a for
+ * statement, where i is its control variable, are done once when
+ * the loop is entered. See hoist().
+ */
+static void              hoist        (for_node *forn, int start, int end);
+static void              unhoist      (for_node *forn);
+static int               collectStmts (stmts_node *stmtsn);
+static void              collectExpr  (expression_node *expn);
+static void              collectIndex (index_node *indexn);
+static void              collectCheck (index_node *indexn);
+
+static token       *control;      // Control variable of the loop being collected.
+static index_node **checks;       // The indexes collected so far.
+static int          nchecks;
+
+/*
+ * The stream where the error messages are printed. NULL means
+ * stderr. See diagnose().
+ */
+static FILE *error_stream;
+
+/*
+ * The template value used in the functions.
+ */
+static value default_value = {UNDEF, {0}};
+
+/*
+ * Runs the program once and frees its symbols, but leaves the
+ * syntax tree so that the batch mode can run it for every record.
+ * The strings of the pool live until releaseInterpreter(), because
+ * the literals of the tree refer to them.
+ */
+int interpret(program_node *pn){
+    int tmp;
+
+    global_list = NULL;
+
+    tmp = program(pn);
+
+    tierRelease();
+    freeLabelList(global_list);
+    global_list = NULL;
+
+    return tmp;
+}
+
+/* Frees what the runs of interpret() left. */
+void releaseInterpreter(void){
+    freeStringPool();
+    freeScratch();
+    free(evaluations);
+    evaluations      = NULL;
+    evaluations_size = 0;
+}
 
 /*
  * Main function of semantic analysis and running the interpreter.
@@ -73,18 +185,46 @@ static value error_value   = {0, 0, NULL, 0, 1, 0, 0};
  * Returns 1 if there was no errors, 0 otherwise.
  */
 int run(program_node *pn){
-    int tmp;
-    
-    global_list = NULL;
+    int tmp = interpret(pn);
 
-    tmp = program(pn);
-
-    freeLabelList(global_list);
     freeSyntaxTree(pn, NULL);
+    releaseInterpreter();
 
     return tmp;
 }
 
+/*
+ * Executes a single statement against the symbol list *scope and
+ * returns the error messages it printed, or NULL if the statement
+ * was executed successfully. The symbol list is freed.
+ *
+ * This is used by the lowering in ir.c to find out what a statement
+ * that fails the static checks reports when it is executed.
+ */
+char *diagnose(statement_node *stmtn, label_list *scope){
+    label_list *saved = global_list;
+    char       *msg   = NULL;
+    size_t      size;
+    int         tmp;
+
+    global_list  = scope;
+    error_stream = open_memstream(&msg, &size);
+
+    tmp = statement(stmtn);
+
+    fclose(error_stream);
+    error_stream = NULL;
+    freeLabelList(global_list);
+    global_list  = saved;
+
+    if(tmp){
+	free(msg);
+	return NULL;
+    }
+
+    return msg;
+}
+
 /*
  * There are function for every non-leaf node in the parse
  * tree. If there is a semantic error, 0 is returned,
@@ -95,11 +235,26 @@ static int program(program_node *pn){
     return stmts(pn->sln);
 }
 
+/*
+ * The statements are executed in a loop, so that the depth of the
+ * C stack does not depend on the length of the program.
+ *
+ * The temporary strings of a statement are freed after it. A for
+ * statement holds no strings while its body is executed, so the
+ * statements of the body can free all of them.
+ */
 static int stmts(stmts_node *stmtsn){
 
-    if(stmtsn == NULL) return 1;
+    for(; stmtsn != NULL; stmtsn = stmtsn->stmtsn){
+	int tmp = statement(stmtsn->stmtn);
+
+	resetScratch();
+
+	if(tmp == 0)
+	    return 0;
+    }
 
-    return statement(stmtsn->stmtn) && stmts(stmtsn->stmtsn);
+    return 1;
 }
 
 static int statement(statement_node *stmtn){
@@ -130,32 +285,185 @@ static int for_(for_node *forn){
 	return 0;
     }
 
-    value range_start = expression(forn->expn1);
-    value range_end   = expression(forn->expn2);
+    value range_start, range_end;
+
+    expression(forn->expn1, &range_start);
+    expression(forn->expn2, &range_end);
+    release(&range_start);
+    release(&range_end);
 
     if(range_start.lt != INT || range_end.lt != INT){
 	printError(forn->id, "For range should be integer", SEMANTIC_ERROR);
 	return 0;
     }
 
-    value counter = default_value;
+    value      counter = default_value;
+    tier_loop *t;
+    int        tmp = 1;
 
     /* The control variable is integer by definition. */
     counter.lt = INT;
-    counter.constant = 1;
+
+    hoist(forn, range_start.i, range_end.i);
     
+    /*
+     * Once the loop is hot, the rest of it is run compiled. The
+     * statements executed by diagnose() are not compiled, because
+     * the lowering is in progress then.
+     */
     for(counter.i = range_start.i; counter.i <= range_end.i; counter.i++){
-	forceUpdate(forn->id, counter);
-	if(stmts(forn->stmtsn) == 0)
-	    return 0;
+	forceUpdate(forn->id, counter, 1);
+	if(error_stream == NULL && (t = tierUp(forn, global_list)) != NULL){
+	    tmp = tierRun(t, &counter.i, range_end.i);
+	    break;
+	}
+	if((tmp = stmts(forn->stmtsn)) == 0)
+	    break;
     }
+
+    unhoist(forn);
+
+    if(tmp == 0)
+	return 0;
     
-    counter.constant = 0;
-    forceUpdate(forn->id, counter);
+    forceUpdate(forn->id, counter, 0);
+
+    return 1;
+}
+
+/*
+ * The indexes a[i] of the body are collected on the first execution
+ * of the loop. When the loop is entered, an index is in bounds for
+ * every iteration if the whole range start..end is, and it is not
+ * checked again until the loop ends. This holds because the control
+ * variable can not be modified in the body and the length of an
+ * array never changes. An array declared in the body is not there
+ * yet, and its indexes are checked as usual.
+ */
+static void hoist(for_node *forn, int start, int end){
+    label_list *l;
+
+    if(forn->nchecks < 0){
+	control = forn->id;
+	checks  = NULL;
+	nchecks = 0;
+
+	if(collectStmts(forn->stmtsn)){
+	    forn->checks  = checks;
+	    forn->nchecks = nchecks;
+	} else{
+	    free(checks);
+	    forn->nchecks = 0;
+	}
+	checks = NULL;
+    }
+
+    if(start > end || start < 0)
+	return;
+
+    for(int k = 0; k < forn->nchecks; k++)
+	if((l = lookup(forn->checks[k]->array)) != NULL && l->v.lt == ARRAY && end < l->v.a->length)
+	    forn->checks[k]->unchecked = 1;
+}
+
+static void unhoist(for_node *forn){
+    for(int k = 0; k < forn->nchecks; k++)
+	forn->checks[k]->unchecked = 0;
+}
+
+/*
+ * Collects the indexes of the statements that are the control
+ * variable alone. Returns 0 if there is a loop with the same
+ * control variable, which changes the variable in the body.
+ */
+static int collectStmts(stmts_node *stmtsn){
+    statement_node *stmtn;
+
+    for(; stmtsn != NULL; stmtsn = stmtsn->stmtsn){
+	stmtn = stmtsn->stmtn;
+
+	if(stmtn->decn != NULL){
+	    if(stmtn->decn->dimn != NULL)
+		collectExpr(stmtn->decn->dimn->expn);
+	    if(stmtn->decn->asn != NULL)
+		collectExpr(stmtn->decn->asn->expn);
+	} else if(stmtn->assn != NULL){
+	    collectIndex(stmtn->assn->indexn);
+	    collectExpr(stmtn->assn->expn);
+	} else if(stmtn->forn != NULL){
+	    if(strncmp(stmtn->forn->id->value, control->value, TOKEN_MAX_LENGTH +1) == 0)
+		return 0;
+	    collectExpr(stmtn->forn->expn1);
+	    collectExpr(stmtn->forn->expn2);
+	    if(collectStmts(stmtn->forn->stmtsn) == 0)
+		return 0;
+	} else if(stmtn->readn != NULL)
+	    collectIndex(stmtn->readn->indexn);
+	else if(stmtn->printn != NULL)
+	    collectExpr(stmtn->printn->expn);
+	else if(stmtn->assertn != NULL)
+	    collectExpr(stmtn->assertn->expn);
+    }
 
     return 1;
 }
 
+/*
+ * The expressions in parentheses and the indexes are kept in a
+ * work stack, so that deep nesting does not exhaust the C stack.
+ */
+static void collectExpr(expression_node *expn){
+    expression_node **stack = NULL;
+    expression_node  *sub;
+    operand_node     *opns[2];
+    int               depth = 0, size = 0, k;
+
+    for(;;){
+	opns[0] = expn->unaryen != NULL ? expn->unaryen->opern : expn->binaryen->opern;
+	opns[1] = expn->binaryen != NULL && expn->binaryen->osn != NULL ? expn->binaryen->osn->opn : NULL;
+
+	for(k = 0; k < 2 && opns[k] != NULL; k++){
+	    if(opns[k]->indexn != NULL){
+		collectCheck(opns[k]->indexn);
+		sub = opns[k]->indexn->expn;
+	    } else if(opns[k]->expren != NULL)
+		sub = opns[k]->expren->expn;
+	    else
+		continue;
+	    if(depth == size){
+		size  = size == 0 ? 16 : 2 * size;
+		stack = (expression_node**)realloc(stack, size * sizeof(expression_node*));
+	    }
+	    stack[depth++] = sub;
+	}
+
+	if(depth == 0)
+	    break;
+	expn = stack[--depth];
+    }
+
+    free(stack);
+}
+
+static void collectIndex(index_node *indexn){
+    if(indexn == NULL)
+	return;
+
+    collectCheck(indexn);
+    collectExpr(indexn->expn);
+}
+
+/* Collects the index if it is the control variable alone. */
+static void collectCheck(index_node *indexn){
+    binary_expression_node *ben = indexn->expn->binaryen;
+
+    if(ben != NULL && ben->osn == NULL && ben->opern->id != NULL && ben->opern->indexn == NULL &&
+       strncmp(ben->opern->id->value, control->value, TOKEN_MAX_LENGTH +1) == 0){
+	checks = (index_node**)realloc(checks, sizeof(index_node*) * (nchecks +1));
+	checks[nchecks++] = indexn;
+    }
+}
+
 /*
  * The declaration statement must check that the symbol to be
  * declared does not exist in the symbol table already.
@@ -167,6 +475,8 @@ static int declaration(declaration_node *decn){
 
     if(decn == NULL)          return 1;
 
+    if(decn->dimn != NULL)    return arrayDeclaration(decn);
+
     label_type expected;
     if(strncmp(decn->typeKey->value,      "int",    TOKEN_MAX_LENGTH) == 0)
 	expected = INT;
@@ -175,19 +485,18 @@ static int declaration(declaration_node *decn){
     else if(strncmp(decn->typeKey->value, "bool",   TOKEN_MAX_LENGTH) == 0)
 	expected = BOOL;
 
-    value v = declarationSuffix(decn->asn);
+    value v;
 
-    if(v.empty){
+    if(declarationSuffix(decn->asn, &v) == VALUE_EMPTY){
 	v = default_value;
 	v.lt = expected;
-	if(expected == STRING){
-	    v.s = malloc(sizeof(char));
-	    v.s[0] = '\0';
-	}
+	if(expected == STRING)
+	    v.s = constantString("");
     }
     
     if(v.lt != expected){
 	printError(decn->id, "Incompatible types in declaration", SEMANTIC_ERROR);
+	release(&v);
 	return 0;
     }
 
@@ -201,10 +510,68 @@ static int declaration(declaration_node *decn){
     return 1;
 }
 
-static value declarationSuffix(declaration_suffix_node *asn){
-    if(asn == NULL) return empty_value;
+static enum value_status declarationSuffix(declaration_suffix_node *asn, value *v){
+    if(asn == NULL) return emptyValue(v);
     
-    return expression(asn->expn);
+    return expression(asn->expn, v);
+}
+
+/*
+ * An array has integer elements and an integer length. It is
+ * initialized with the elements of another array of the same
+ * length, or with zeros.
+ */
+static int arrayDeclaration(declaration_node *decn){
+    value             n, v;
+    enum value_status status;
+    array            *a;
+
+    if(strncmp(decn->typeKey->value, "int", TOKEN_MAX_LENGTH) != 0){
+	printError(decn->id, "Arrays must have integer elements", SEMANTIC_ERROR);
+	return 0;
+    }
+
+    if((status = expression(decn->dimn->expn, &n)) == VALUE_ERROR)
+	return 0;
+
+    if(n.lt != INT){
+	printError(decn->id, "Array length should be integer", SEMANTIC_ERROR);
+	release(&n);
+	return 0;
+    }
+
+    if(n.i < 0){
+	printError(decn->id, "Negative array length", RUNTIME_ERROR);
+	return 0;
+    }
+
+    if((a = newArray(n.i)) == NULL){
+	printError(decn->id, "Out of memory for the array", RUNTIME_ERROR);
+	return 0;
+    }
+
+    if(decn->asn != NULL){
+	if((status = expression(decn->asn->expn, &v)) == VALUE_OK && v.lt != ARRAY)
+	    printError(decn->id, "Incompatible types in declaration", SEMANTIC_ERROR);
+	if(status != VALUE_OK || v.lt != ARRAY || copyArray(decn->id, a, v.a) == 0){
+	    release(&v);
+	    freeArray(a);
+	    return 0;
+	}
+    }
+
+    v    = default_value;
+    v.lt = ARRAY;
+    v.a  = a;
+
+    if(insert(decn->id, v) == 0){
+	char msg[TOKEN_MAX_LENGTH + 25];
+	sprintf(msg, "Redeclaration of symbol %s", decn->id->value);
+	printError(decn->id, msg, SEMANTIC_ERROR);
+	return 0;
+    }
+
+    return 1;
 }
 
 /*
@@ -214,6 +581,8 @@ static value declarationSuffix(declaration_suffix_node *asn){
 static int assignment(assignment_node *assn){
 
     if(assn == NULL)        return 1;
+
+    if(assn->indexn != NULL) return elementAssignment(assn);
     
     label_type lt = findLabelType(assn->id);
     if(lt == UNDEF){
@@ -224,52 +593,172 @@ static int assignment(assignment_node *assn){
     }
 
 
-    value v = expression(assn->expn);
+    value             v;
+    enum value_status status;
+
+    target = assn;
+    status = expression(assn->expn, &v);
+    target = NULL;
 
     if(lt != v.lt){
 	printError(assn->id, "Incompatible types in assignment", SEMANTIC_ERROR);
+	release(&v);
 	return 0;
     }
 
-    if(v.error != 1 && v.empty != 1)
+    if(status == VALUE_OK && lt == ARRAY)
+	return copyArray(assn->id, findArray(assn->id), v.a);
+
+    if(status == VALUE_OK)
 	return update(assn->id, v);
     
     return 0;
 }
 
-static value expression(expression_node *expn){
+/*
+ * The index is evaluated before the assigned expression, and
+ * both of them must be integers.
+ */
+static int elementAssignment(assignment_node *assn){
+    value             v;
+    enum value_status status;
+    int              *e;
 
-    if(expn == NULL) return empty_value;
+    if((e = element(assn->id, assn->indexn)) == NULL)
+	return 0;
 
-    value uexp = unaryExpression(expn->unaryen);
+    status = expression(assn->expn, &v);
 
-    if (uexp.empty != 1)
-	return uexp;
+    if(v.lt != INT){
+	printError(assn->id, "Incompatible types in assignment", SEMANTIC_ERROR);
+	release(&v);
+	return 0;
+    }
 
-    value v = binaryExpression(expn->binaryen);
+    if(status != VALUE_OK)
+	return 0;
 
-    return v;
+    *e = v.i;
+    return 1;
+}
+
+static enum value_status expression(expression_node *expn, value *v){
+
+    if(expn == NULL) return emptyValue(v);
+
+    int               base = evaluations_depth;
+    evaluation       *e;
+    operand_node     *opn;
+    enum value_status status;
+
+    for(;;){
+	/* The expression expn is started. */
+	if(expn != NULL){
+	    if(evaluations_depth == evaluations_size){
+		evaluations_size = evaluations_size == 0 ? 16 : 2 * evaluations_size;
+		evaluations = (evaluation*)realloc(evaluations, evaluations_size * sizeof(evaluation));
+	    }
+	    e = &evaluations[evaluations_depth++];
+	    e->expn  = expn;
+	    e->stage = 0;
+	    expn     = NULL;
+	}
+
+	e = &evaluations[evaluations_depth -1];
+
+	if((opn = nextOperand(e)) != NULL){
+	    /* An expression in parentheses or an index is evaluated first. */
+	    if(opn->expren != NULL && opn->expren->expn != NULL){
+		expn = opn->expren->expn;
+		continue;
+	    }
+	    if(opn->indexn != NULL){
+		if(findArray(opn->id) != NULL){
+		    expn = opn->indexn->expn;
+		    continue;
+		}
+		*v     = default_value;
+		status = VALUE_ERROR;
+	    } else
+		status = operand(opn, v);
+	} else{
+	    status = evaluate(e, v);
+
+	    if(--evaluations_depth == base)
+		return status;
+
+	    e   = &evaluations[evaluations_depth -1];
+	    opn = nextOperand(e);
+	    if(opn->indexn != NULL)
+		status = elementOperand(opn, v, status);
+	    else if(status == VALUE_EMPTY)
+		status = operand(opn, v);
+	}
+
+	setOperand(e, *v, status);
+    }
 }
 
 /*
- * The unary expression must check that the argument is
- * of type bool.
+ * Returns the operand of the evaluation *e that is evaluated
+ * next, or NULL if all of them have been evaluated.
  */
-static value unaryExpression(unary_expression_node *uen){
+static operand_node *nextOperand(evaluation *e){
+    unary_expression_node  *uen = e->expn->unaryen;
+    binary_expression_node *ben = e->expn->binaryen;
 
-    if(uen == NULL) return empty_value;
+    if(uen != NULL)
+	return e->stage == 0 ? uen->opern : NULL;
 
-    if(uen->unop){
-	value v = operand(uen->opern);
-	if(v.lt != BOOL){
-	    printError(uen->unop, "The argument type of unary expression must be bool", SEMANTIC_ERROR);
-	    return error_value;
-	}
-	v.b ^= 1;
-	return v;
+    if(ben == NULL)
+	return NULL;
+
+    if(e->stage == 0 && ben->osn == NULL)
+	setOperand(e, default_value, VALUE_EMPTY);
+
+    switch(e->stage){
+    case 0:  return ben->osn->opn;
+    case 1:  return ben->opern;
+    default: return NULL;
+    }
+}
+
+static void setOperand(evaluation *e, value v, enum value_status status){
+    if(e->stage++ == 0 && e->expn->binaryen != NULL){
+	e->suffix        = v;
+	e->suffix_status = status;
+    } else{
+	e->oper          = v;
+	e->oper_status   = status;
     }
+}
+
+/* Stores the value of the evaluated expression to *v. */
+static enum value_status evaluate(evaluation *e, value *v){
+    *v = e->oper;
+
+    if(e->expn->unaryen != NULL && e->expn->unaryen->unop != NULL)
+	return unaryExpression(e->expn->unaryen, v);
+    if(e->expn->unaryen != NULL)
+	return e->oper_status;
+    if(e->expn->binaryen != NULL)
+	return binaryExpression(e->expn->binaryen, v, e->oper_status, &e->suffix, e->suffix_status);
 
-    return operand(uen->opern);
+    return emptyValue(v);
+}
+
+/*
+ * The unary expression must check that the argument is
+ * of type bool. The value of the argument is in *v.
+ */
+static enum value_status unaryExpression(unary_expression_node *uen, value *v){
+
+    if(v->lt != BOOL){
+	printError(uen->unop, "The argument type of unary expression must be bool", SEMANTIC_ERROR);
+	return errorValue(v);
+    }
+    v->b ^= 1;
+    return VALUE_OK;
 }
 
 /*
@@ -278,179 +767,214 @@ static value unaryExpression(unary_expression_node *uen){
  * data types. In addition all binary operators can only operate
  * with the same data types.
  */
-static value binaryExpression(binary_expression_node *ben){
-
-    if(ben == NULL) return empty_value;
-
-    value suffix = operandSuffix(ben->osn);
-    value oper   = operand(ben->opern);
+static enum value_status binaryExpression(binary_expression_node *ben, value *v,
+					  enum value_status oper_status, value *suffix_value, enum value_status suffix_status){
 
-    suffix.constant = 0;
-    oper.constant = 0;
+    /* The value of the left operand is in *v. */
+    value             suffix = *suffix_value;
+    int               b = 0;
 
-    if(oper.empty == 1 || suffix.error == 1 || oper.error == 1)
-	return error_value;
+    if(oper_status == VALUE_EMPTY || suffix_status == VALUE_ERROR || oper_status == VALUE_ERROR)
+	return operandError(v, &suffix);
 
-    if(suffix.empty != 1){
-	if(suffix.lt != oper.lt){
+    if(suffix_status != VALUE_EMPTY){
+	if(suffix.lt != v->lt){
 	    printError(ben->osn->op, "Mismatched types in expression", SEMANTIC_ERROR);
-	    return error_value;
+	    return operandError(v, &suffix);
+	}
+
+	if(suffix.lt == ARRAY){
+	    printError(ben->osn->op, "Arrays can not be operands of binary operators", SEMANTIC_ERROR);
+	    return operandError(v, &suffix);
 	}
 	
 	if(strncmp(ben->osn->op->value, "+", 1) == 0){
 	    
 	    if(suffix.lt == INT){
-		suffix.i += oper.i;
-		return suffix;
+		v->i += suffix.i;
+		return VALUE_OK;
 	    } else if(suffix.lt == STRING){
-		oper.s = realloc(oper.s, strlen(suffix.s) + strlen(oper.s));
-		strcat(oper.s, suffix.s);
+		/*
+		 * The variable of s := s + e is overwritten with the
+		 * result. If it and the left operand have the only
+		 * references to the string, the variable drops its
+		 * reference here and the string is appended in place.
+		 */
+		label_list *l;
+		if(target != NULL && target->expn->binaryen == ben && v->s->refs == 2 &&
+		   (l = findLabel(target->id)) != NULL && l->v.lt == STRING && l->v.s == v->s){
+		    releaseString(l->v.s);
+		    l->v.s = constantString("");
+		}
+		v->s = appendString(v->s, suffix.s);
+		release(&suffix);
 	    } else{
 		printError(ben->osn->op, "Trying to use addition operator with boolean values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	} else if(strncmp(ben->osn->op->value, "-", 1) == 0){
 	    if(suffix.lt == INT){
-		suffix.i = oper.i - suffix.i;
-		return suffix;
+		v->i -= suffix.i;
+		return VALUE_OK;
 	    } else{
 		printError(ben->osn->op, "Trying to use subtraction operator with non integer values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	} else if(strncmp(ben->osn->op->value, "*", 1) == 0){
 	    if(suffix.lt == INT){
-		suffix.i *= oper.i;
-		return suffix;
+		v->i *= suffix.i;
+		return VALUE_OK;
 	    } else{
 		printError(ben->osn->op, "Trying to use multiplication operator with non integer values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	} else if(strncmp(ben->osn->op->value, "/", 1) == 0){
-	    if(suffix.i == 0){
+	    /*
+	     * The divisor is checked before its type. A string
+	     * divisor has no integer value and counts as zero, and
+	     * so does a false boolean divisor.
+	     */
+	    if(suffix.lt == STRING || (suffix.lt == INT && suffix.i == 0) ||
+	       (suffix.lt == BOOL && suffix.b == 0)){
 		printError(ben->osn->op, "Division by zero", RUNTIME_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	    if(suffix.lt == INT){
-		suffix.i = oper.i / suffix.i;
-		return suffix;
+		v->i /= suffix.i;
+		return VALUE_OK;
 	    } else{
 		printError(ben->osn->op, "trying to use division operator with non integer values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	} else if(strncmp(ben->osn->op->value, "&", 1) == 0){
 	    if(suffix.lt == BOOL){
-		suffix.b &= oper.b;
-		return suffix;
+		v->b &= suffix.b;
+		return VALUE_OK;
 	    } else{
 		printError(ben->osn->op, "Trying to use logical and operator with non boolean values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	} else if(strncmp(ben->osn->op->value, "<", 1) == 0){
 	    if(suffix.lt == UNDEF){
 		printError(ben->osn->op, "Trying to use boolean operator < with non boolean values", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	    switch(suffix.lt){
 	    case INT:
-		if(oper.i < suffix.i)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = v->i < suffix.i;
 		break;
 	    case STRING:
-		if(strcmp(oper.s, suffix.s) < 0)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = lessStrings(v->s, suffix.s);
 		break;
 	    case BOOL:
-		if(oper.b < suffix.b)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = v->b < suffix.b;
 		break;
 	    }
-	    suffix.lt = BOOL;
-	    return suffix;
+	    release(v);
+	    release(&suffix);
+	    v->lt = BOOL;
+	    v->b  = b;
+	    return VALUE_OK;
 	    
 	} else if(strncmp(ben->osn->op->value, "=", 1) == 0){
 	    if(suffix.lt == UNDEF){
 		printError(ben->osn->op, "Trying to compare types with undefined types", SEMANTIC_ERROR);
-		return error_value;
+		return operandError(v, &suffix);
 	    }
 	    switch(suffix.lt){
 	    case INT:
-		if(oper.i == suffix.i)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = v->i == suffix.i;
 		break;
 	    case STRING:
-		if(strcmp(suffix.s, oper.s) == 0)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = equalStrings(suffix.s, v->s);
 		break;
 	    case BOOL:
-		if(oper.b == suffix.b)
-		    suffix.b = 1;
-		else
-		    suffix.b = 0;
+		b = v->b == suffix.b;
 		break;
 	    }
-	    suffix.lt = BOOL;
-	    return suffix;
+	    release(v);
+	    release(&suffix);
+	    v->lt = BOOL;
+	    v->b  = b;
+	    return VALUE_OK;
 	}
     }
 
-    return oper;
+    return VALUE_OK;
 }
 
-static value operandSuffix(operand_suffix_node *osn){
-    if(osn == NULL) return empty_value;
-
-    return operand(osn->opn);
-}
+/*
+ * The operand is a literal, a variable or the length of an array.
+ * The expressions in parentheses and the indexes of the elements
+ * are evaluated by expression(). An array variable is borrowed,
+ * not retained.
+ */
+static enum value_status operand(operand_node *opn, value *v){
 
-static value operand (operand_node *opn){
+    if(opn->lengthn != NULL)
+	return length(opn->lengthn, v);
+    else if(opn->intLit != NULL){
+	v->lt = INT;
+	v->i = getIntValue(opn->intLit->value);
+    } else if(opn->strLit != NULL){
+	/* The literal is looked up from the pool only once. */
+	if(opn->constant == NULL)
+	    opn->constant = constantString(opn->strLit->value);
+	v->lt = STRING;
+	v->s  = opn->constant;
+    } else {
+	label_list *l = findLabel(opn->id);
 
-    value v = enclosedExpression(opn->expren);
+	if(l == NULL)
+	    return errorValue(v);
 
-    if(v.empty != 1)
-	return v;
+	*v = l->v;
+	retain(v);
+    }
 
-    v = default_value;
+    return VALUE_OK;
+}
 
-    if(opn->intLit != NULL){
-	v.lt = INT;
-	v.i = getIntValue(opn->intLit->value);
-    } else if(opn->strLit != NULL){
-	v.lt = STRING;
-	v.s = (char*)malloc(sizeof(char)*strlen(opn->strLit->value)+1);
-	memset(v.s, '\0', strlen(opn->strLit->value) +1);
-	strcpy(v.s, opn->strLit->value);
-    } else {
-	v = findLabelValue(opn->id);
+/*
+ * Replaces the value *v of the index of the operand *opn with the
+ * element. The array was found before the index was evaluated.
+ */
+static enum value_status elementOperand(operand_node *opn, value *v, enum value_status status){
+    int *e;
 
-	if(v.empty)
-	    v = error_value;
+    if(status == VALUE_ERROR || (e = elementAt(opn->id, opn->indexn, findArray(opn->id), v)) == NULL){
+	*v = default_value;
+	return VALUE_ERROR;
     }
 
-    return v;
+    v->lt = INT;
+    v->i  = *e;
+    return VALUE_OK;
 }
 
-static value enclosedExpression(enclosed_expression_node *een){
-    if(een == NULL) return empty_value;
+static enum value_status length(length_node *lengthn, value *v){
+    array *a = findArray(lengthn->id);
+
+    if(a == NULL){
+	*v = default_value;
+	return VALUE_ERROR;
+    }
 
-    return expression(een->expn);
+    v->lt = INT;
+    v->i  = a->length;
+    return VALUE_OK;
 }
 
 static int assert(assert_node *assertn){
 
     if(assertn == NULL) return 1;
-    value v = expression(assertn->expn);
+    value v;
+
+    expression(assertn->expn, &v);
 
-    if(v.b != 1){
+    release(&v);
+
+    if(v.lt != BOOL || v.b != 1){
 	printError(assertn->assert, "Assertion failed", SEMANTIC_ERROR);
 	return 0;
     }
@@ -461,11 +985,15 @@ static int assert(assert_node *assertn){
 static int read(read_node *readn){
 
     if(readn == NULL) return 1;
+
+    if(readn->indexn != NULL) return readElement(readn);
+
     value v = default_value;
     v.lt = findLabelType(readn->id);
 
-    char tmp[512];
-    
+    char   *s;
+    size_t  n;
+
     if(v.lt == UNDEF){
 	printError(readn->id, "Undefined label in read statement", SEMANTIC_ERROR);
 	return 0;
@@ -473,45 +1001,58 @@ static int read(read_node *readn){
 
     switch(v.lt){
     case INT:
-	if(scanf("%d", &(v.i)) != 1){
+	if(inputInt(&(v.i)) != 1){
 	    printError(readn->id, "Failed to read integer", RUNTIME_ERROR);
 	    return 0;
 	}
 	return update(readn->id, v);
 
     case STRING:
-	if(scanf("%s", tmp) != 1){
+	if(inputWord(&s, &n) != 1){
 	    printError(readn->id, "Failed to read string", RUNTIME_ERROR);
 	    return 0;
 	}
-	v.s = (char*)malloc(sizeof(char)*512);
-	strncpy(v.s, tmp, 512);
+	v.s = internString(s, n);
 	return update(readn->id, v);
 
+    case ARRAY:
+	printError(readn->id, "Cannot read a whole array", SEMANTIC_ERROR);
+	return 0;
+
     default:
 	printError(readn->id, "Cannot read boolean value", RUNTIME_ERROR);
 	return 0;
     }
 }
 
+static int readElement(read_node *readn){
+    int *e, i;
+
+    if((e = element(readn->id, readn->indexn)) == NULL)
+	return 0;
+
+    if(inputInt(&i) != 1){
+	printError(readn->id, "Failed to read integer", RUNTIME_ERROR);
+	return 0;
+    }
+
+    *e = i;
+    return 1;
+}
+
 static int print(print_node *printn){
 
     if(printn == NULL) return 1;
-    value v = expression(printn->expn);
+    value v;
 
-    if(v.error == 1 || v.empty == 1 || (v.lt != STRING && v.lt != INT)){
+    if(expression(printn->expn, &v) != VALUE_OK || (v.lt != STRING && v.lt != INT)){
 	printError(printn->print, "Invalid value in printable expression", RUNTIME_ERROR);
+	release(&v);
 	return 0;
     }
 
-    /*
-     * The error message is casted by the function findLabel()
-     */
-    if (v.empty == 1)
-	return 0;
-
-    
     printValue(v);
+    release(&v);
     return 1;
 }
 
@@ -521,21 +1062,29 @@ static int print(print_node *printn){
 static int update(token *id, value new_value){
     if(isConstant(id)){
 	printError(id, "Cannot modify the loop control variable", SEMANTIC_ERROR);
+	release(&new_value);
 	return 0;
     }
 
-    forceUpdate(id, new_value);
+    forceUpdate(id, new_value, 0);
 
     return 1;
 }
 
 /*
- * Updates the value of the symbol even when its constant indicator is set.
+ * Updates the value and the constant indicator of the symbol
+ * even when its constant indicator is set.
  */
-static void forceUpdate(token *id, value new_value){
+static void forceUpdate(token *id, value new_value, int constant){
     for(label_list *tmp = global_list; tmp != NULL; tmp = tmp->next)
 	if(strncmp((char*)tmp->l, id->value, TOKEN_MAX_LENGTH +1) == 0){
-	    tmp->v = new_value;
+	    /* A temporary string is moved to the old string of the variable. */
+	    if(new_value.lt == STRING && new_value.s->refs == STRING_SCRATCH)
+		new_value.s = promoteString(new_value.s, tmp->v.lt == STRING ? tmp->v.s : NULL);
+	    else
+		release(&tmp->v);
+	    tmp->v        = new_value;
+	    tmp->constant = constant;
 	    return;
 	}
 }
@@ -545,8 +1094,9 @@ static void forceUpdate(token *id, value new_value){
  * If the constant indicator is set return 1, otherwise return 0.
  */
 static int isConstant(token *id){
-    value v = findLabelValue(id);
-    if(v.constant == 0)
+    label_list *l = findLabel(id);
+
+    if(l == NULL || l->constant == 0)
 	return 0;
     return 1;
 }
@@ -559,8 +1109,12 @@ static int isConstant(token *id){
  * called insert(). No error messages is generated here.
  */
 static int insert(token *id, value v){
-    label_list *tmp = newLabelListNode(&global_list, (label*)id->value, v);
-    label_list *prev;
+    label_list *tmp, *prev;
+
+    if(v.lt == STRING && v.s->refs == STRING_SCRATCH)
+	v.s = promoteString(v.s, NULL);
+
+    tmp = newLabelListNode(&global_list, (label*)id->value, v);
 
     global_list = tmp;
 
@@ -572,6 +1126,9 @@ static int insert(token *id, value v){
 	
 	if(strncmp((char*)tmp->l, id->value, TOKEN_MAX_LENGTH +1) == 0){
 	    prev->next = tmp->next;
+	    release(&tmp->v);
+	    if(tmp->v.lt == ARRAY)
+		freeArray(tmp->v.a);
 	    free(tmp);
 	    return 0;
 	}
@@ -593,15 +1150,34 @@ static label_type findLabelType(token *id){
 }
 
 /*
- * Search value for label *id and return its value.
+ * Set *v to the value of an empty or failed expression
+ * and return the corresponding status.
  */
-static value findLabelValue(token *id){
-    label_list *l = findLabel(id);
-    
-    if(l == NULL)
-	return empty_value;
+static enum value_status emptyValue(value *v){
+    *v = default_value;
+    return VALUE_EMPTY;
+}
 
-    return l->v;
+static enum value_status errorValue(value *v){
+    release(v);
+    *v = default_value;
+    return VALUE_ERROR;
+}
+
+/* Both operands of a failed binary expression are released. */
+static enum value_status operandError(value *v, value *suffix){
+    release(suffix);
+    return errorValue(v);
+}
+
+static void retain(value *v){
+    if(v->lt == STRING)
+	retainString(v->s);
+}
+
+static void release(value *v){
+    if(v->lt == STRING)
+	releaseString(v->s);
 }
 
 /*
@@ -611,15 +1187,93 @@ static value findLabelValue(token *id){
  * and returns NULL.
  */
 static label_list *findLabel(token *id){
+    label_list *l = lookup(id);
+
+    if(l != NULL)
+	return l;
+
+    char msg[TOKEN_MAX_LENGTH +31];
+    sprintf(msg, "Reference to unknown variable %s", id->value);
+    printError(id, msg, SEMANTIC_ERROR);
+    return NULL;
+}
+
+/*
+ * Returns the element of the array *id at the index *indexn,
+ * or NULL if the index can not be evaluated or it is out of
+ * bounds. The bounds are not checked if a loop has hoisted
+ * the check.
+ */
+static int *element(token *id, index_node *indexn){
+    array *a = findArray(id);
+    value  i;
+
+    if(a == NULL)
+	return NULL;
+
+    if(expression(indexn->expn, &i) == VALUE_ERROR)
+	return NULL;
+
+    return elementAt(id, indexn, a, &i);
+}
+
+/* The same as element() for the index *i that is already evaluated. */
+static int *elementAt(token *id, index_node *indexn, array *a, value *i){
+    if(i->lt != INT){
+	printError(indexn->lBracket, "Array index should be integer", SEMANTIC_ERROR);
+	release(i);
+	return NULL;
+    }
+
+    if(!indexn->unchecked && (unsigned)i->i >= (unsigned)a->length){
+	char msg[TOKEN_MAX_LENGTH +60];
+	sprintf(msg, "Index %d out of bounds of array %s of length %d", i->i, id->value, a->length);
+	printError(indexn->lBracket, msg, RUNTIME_ERROR);
+	return NULL;
+    }
+
+    return &a->elements[i->i];
+}
+
+/*
+ * Returns the array of the symbol in *id. If the symbol is
+ * not an array, prints the error message and returns NULL.
+ */
+static array *findArray(token *id){
+    label_list *l = findLabel(id);
+
+    if(l == NULL)
+	return NULL;
+
+    if(l->v.lt != ARRAY){
+	char msg[TOKEN_MAX_LENGTH +25];
+	sprintf(msg, "Variable %s is not an array", id->value);
+	printError(id, msg, SEMANTIC_ERROR);
+	return NULL;
+    }
+
+    return l->v.a;
+}
+
+/* Copies the elements of the array *from to the array *to of *id. */
+static int copyArray(token *id, array *to, array *from){
+    if(to->length != from->length){
+	printError(id, "Array lengths differ in assignment", RUNTIME_ERROR);
+	return 0;
+    }
+
+    memmove(to->elements, from->elements, sizeof(int) * to->length);
+    return 1;
+}
+
+/* Returns the label of the symbol in *id, or NULL. */
+static label_list *lookup(token *id){
 
     for(label_list *tmp = global_list; tmp != NULL; tmp = tmp->next){
 	if(strncmp(id->value, (char*)tmp->l, TOKEN_MAX_LENGTH +1) == 0)
 	    return tmp;
     }
 
-    char msg[TOKEN_MAX_LENGTH +31];
-    sprintf(msg, "Reference to unknown variable %s", id->value);
-    printError(id, msg, SEMANTIC_ERROR);
     return NULL;
 }
 
@@ -638,16 +1292,16 @@ static int getIntValue (char *data){
 static void printValue(value v){
     switch(v.lt){
     case INT:
-	printf("%d", v.i);
+	outputInt(v.i);
 	break;
     case STRING:
-	printf("%s", v.s);
+	outputString(v.s->chars, v.s->length);
 	break;
     case BOOL:
-	printf("BOOL: %s\n", v.b == 1 ? "True" : "False");
+	outputString(v.b == 1 ? "BOOL: True\n" : "BOOL: False\n", v.b == 1 ? 11 : 12);
 	break;
     default:
-	printf("Value is invalid\n");
+	outputString("Value is invalid\n", 17);
     }
 }
 
@@ -655,11 +1309,15 @@ static void printValue(value v){
  * This function prints the error information associated to the token.
  */
 static void printError(token *t, char *message, enum error_type et){
+    FILE *out = error_stream != NULL ? error_stream : stderr;
+
+    if(out == stderr)
+	outputFlush();
 
     if(et == SEMANTIC_ERROR)
-	fprintf(stderr, "Semantic error in line %3d: %s.\n", t->line_number, message);
+	fprintf(out, "Semantic error in line %3d: %s.\n", t->line_number, message);
     else
-	fprintf(stderr, "Runtime error  in line %3d: %s.\n", t->line_number, message);
+	fprintf(out, "Runtime error  in line %3d: %s.\n", t->line_number, message);
     
  }
 
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tokens.h"
+#include "tree.h"
+#include "label.h"
+#include "ir.h"
+#include "closure.h"
+#include "parallel.h"
+#include "vector.h"
+#include "tier.h"
+#include "memory.h"
+
+/*
+ * A compiled loop. The slot of the n:th symbol of the list scope
+ * is n and its symbol is labels[n]. The frame is reused every
+ * time the loop is entered; a loop can not be entered again while
+ * it runs, because the statements of its body are compiled too.
+ */
+struct TIER_LOOP{
+    for_node          *forn    ;
+    label_list        *scope   ;
+    label_list       **labels  ;
+    str              **fresh   ;   // New strings of the symbols, see leave().
+    ir_program        *ir      ;
+    stmt_closure      *loop    ;
+    int                control ;   // Slot of the control variable.
+    frame              f       ;
+    struct TIER_LOOP  *next    ;
+};
+
+/* Helper functions used only in this translation unit. */
+static tier_loop *compile (for_node  *forn, label_list *scope);
+static void       enter   (tier_loop *t                     );
+static void       leave   (tier_loop *t                     );
+static double     now     (void                             );
+
+/* All the compiled loops, freed by tierRelease(). */
+static tier_loop *loops;
+
+static int        threshold = TIER_THRESHOLD;
+static int        stats;
+
+/* The totals written with the stats. */
+static int        compiled;
+static int        failed;
+static double     compile_time;
+static long long  iterations;
+
+void tierOptions(int t, int s){
+    threshold = t;
+    stats     = s;
+}
+
+/*
+ * A compiled loop is valid while the symbol list is the one it was
+ * compiled against. Symbols are only added to the head of the list,
+ * so a declaration since then makes the loop stale, and it is
+ * compiled again on its next iteration. A loop that can not be
+ * compiled is not tried again.
+ */
+tier_loop *tierUp(for_node *forn, label_list *scope){
+    double start;
+
+    if(forn->tier != NULL && forn->tier->scope == scope)
+	return forn->tier;
+
+    if(threshold <= 0 || forn->iterations < 0 || ++forn->iterations < threshold)
+	return NULL;
+
+    start        = now();
+    forn->tier   = compile(forn, scope);
+    start        = now() - start;
+    compile_time += start;
+
+    if(forn->tier == NULL){
+	failed++;
+	if(stats)
+	    fprintf(stderr, "Tier up in line %d at iteration %d: the loop can not be compiled\n",
+		    forn->id->line_number, forn->iterations);
+	forn->iterations = -1;
+	return NULL;
+    }
+
+    compiled++;
+    if(stats)
+	fprintf(stderr, "Tier up in line %d at iteration %d: compiled in %.3f ms\n",
+		forn->id->line_number, forn->iterations, start);
+
+    return forn->tier;
+}
+
+/*
+ * The control variable is set before every iteration, as the
+ * interpreter does. The loop is left at the first failing
+ * statement, and the symbols get the values they had then.
+ */
+int tierRun(tier_loop *t, int *counter, int end){
+    int start = *counter, tmp = 1;
+
+    enter(t);
+
+    if(t->loop->parallel != NULL && parallelRun(t->loop, &t->f, *counter, end))
+	*counter = end +1;
+    else if(t->loop->vector != NULL){
+	tmp      = vectorRun(t->loop, &t->f, *counter, end);
+	*counter = tmp ? end +1 : t->f.env[t->control].i;
+    }else
+	for(; *counter <= end; (*counter)++){
+	    t->f.env[t->control].i = *counter;
+	    if(execClosures(t->loop->body, &t->f) == 0){
+		tmp = 0;
+		break;
+	    }
+	}
+
+    leave(t);
+    iterations += (long long)*counter - start;
+
+    return tmp;
+}
+
+void tierRelease(void){
+    tier_loop *tmp;
+
+    if(stats)
+	fprintf(stderr, "Tiered execution: %d loops compiled in %.3f ms, %d not compiled, "
+		"%lld of their iterations run compiled\n", compiled, compile_time, failed, iterations);
+
+    while(loops != NULL){
+	tmp = loops->next;
+	loops->forn->tier = NULL;
+	freeStmtClosures(loops->loop);
+	freeIr(loops->ir);
+	free(loops->labels);
+	free(loops->fresh);
+	free(loops->f.env);
+	free(loops->f.buffers);
+	free(loops);
+	loops = tmp;
+    }
+
+    compiled     = 0;
+    failed       = 0;
+    compile_time = 0;
+    iterations   = 0;
+}
+
+/*
+ * The body is wrapped in a for statement, so that a reduction loop
+ * is compiled to run in parallel. Its range is never evaluated.
+ */
+static tier_loop *compile(for_node *forn, label_list *scope){
+    ir_program *ir = lowerLoop(forn, scope);
+    ir_stmt    *stmt;
+    tier_loop  *t;
+    int         n  = 0;
+
+    if(ir == NULL)
+	return NULL;
+
+    t = (tier_loop*)malloc(sizeof(tier_loop));
+    t->forn       = forn;
+    t->scope      = scope;
+    t->labels     = (label_list**)malloc(sizeof(label_list*) * (ir->nslots +1));
+    t->fresh      = (str**)malloc(sizeof(str*) * (ir->nslots +1));
+    t->ir         = ir;
+    t->control    = 0;
+    t->f.env      = (cell*)calloc(ir->nslots +1, sizeof(cell));
+    t->f.buffers  = (buffer*)calloc(ir->nslots +1, sizeof(buffer));
+    t->f.fault    = 0;
+    t->f.parallel = 0;
+    t->next       = loops;
+    loops         = t;
+
+    for(; scope != NULL; scope = scope->next, n++){
+	t->labels[n] = scope;
+	if(strncmp((char*)scope->l, forn->id->value, TOKEN_MAX_LENGTH +1) == 0)
+	    t->control = n;
+    }
+
+    stmt        = newIrStmt(IR_FOR);
+    stmt->line  = forn->id->line_number;
+    stmt->slot  = t->control;
+    stmt->lt    = INT;
+    stmt->expn  = newIrExpr(IR_CONST);
+    stmt->expn2 = newIrExpr(IR_CONST);
+    stmt->body  = ir->stmts;
+    stmt->expn->lt = stmt->expn2->lt = INT;
+    ir->stmts   = stmt;
+    t->loop     = compileClosures(stmt);
+
+    return t;
+}
+
+/*
+ * The slots share the strings of the symbols. The strings are
+ * not owned by the slots, so the closures copy them before
+ * appending to them. The arrays have no slot values, because
+ * a loop that uses them is not compiled.
+ */
+static void enter(tier_loop *t){
+    for(int n = 0; n < t->ir->nslots; n++)
+	if(t->labels[n]->v.lt == STRING){
+	    t->f.env[n].s = t->labels[n]->v.s->chars;
+	    t->f.buffers[n].capacity = 0;
+	} else if(t->labels[n]->v.lt != ARRAY)
+	    t->f.env[n].i = t->labels[n]->v.i;
+}
+
+/*
+ * A slot may share the string of another symbol, so all the new
+ * strings are copied before any old string is released. The
+ * buffers the slots own are freed.
+ */
+static void leave(tier_loop *t){
+    int n;
+
+    for(n = 0; n < t->ir->nslots; n++){
+	t->fresh[n] = NULL;
+	if(t->labels[n]->v.lt != STRING){
+	    if(t->labels[n]->v.lt != ARRAY)
+		t->labels[n]->v.i = t->f.env[n].i;
+	    continue;
+	}
+	if(t->f.env[n].s != t->labels[n]->v.s->chars)
+	    t->fresh[n] = newString(t->f.env[n].s, strlen(t->f.env[n].s));
+    }
+
+    for(n = 0; n < t->ir->nslots; n++){
+	if(t->f.buffers[n].capacity != 0){
+	    free(t->f.env[n].s);
+	    t->f.buffers[n].capacity = 0;
+	}
+	if(t->fresh[n] != NULL){
+	    releaseString(t->labels[n]->v.s);
+	    t->labels[n]->v.s = t->fresh[n];
+	}
+    }
+}
+
+/* Returns the time in milliseconds. */
+static double now(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,59 @@
+#ifndef TIER_HEADER
+#define TIER_HEADER
+
+#include "tree.h"
+#include "label.h"
+
+/*
+ * This file contains the declarations of the tiered execution of
+ * the tree walking interpreter. The interpreter counts the
+ * iterations of every for loop. When a loop has run enough
+ * iterations, its body is lowered and compiled to closures, and
+ * the rest of its iterations are executed with the closures.
+ *
+ * The loop is switched in the middle (on-stack replacement): the
+ * values of the symbols and the counter are copied to the frame
+ * of the closures when the compiled loop is entered, and back to
+ * the symbols when it is left. A loop that is entered again runs
+ * compiled from its first iteration, as long as no symbol has
+ * been declared since it was compiled.
+ */
+
+/*
+ * The number of iterations after which a loop is compiled.
+ * A threshold of 0 turns the tiered execution off.
+ */
+#define TIER_THRESHOLD 1000
+
+typedef struct TIER_LOOP tier_loop;
+
+/*
+ * Sets the threshold. If stats is set, every tier up and its
+ * compile time are written to the standard error when it happens,
+ * and the totals when the program ends.
+ */
+extern void       tierOptions (int threshold, int stats);
+
+/*
+ * Counts an iteration of the loop *forn, whose control variable
+ * has been set, against the symbol list *scope. Returns the
+ * compiled loop that runs the rest of the iterations, or NULL if
+ * the interpreter goes on with this iteration.
+ */
+extern tier_loop *tierUp      (for_node *forn, label_list *scope);
+
+/*
+ * Runs the iterations from *counter to end with the compiled
+ * loop. On return *counter is the value of the counter when the
+ * loop was left. Returns 0 if a statement failed, 1 otherwise.
+ */
+extern int        tierRun     (tier_loop *t, int *counter, int end);
+
+/*
+ * Frees all the compiled loops and writes the totals. The loops
+ * of the syntax tree are left without them, so that it can be run
+ * again.
+ */
+extern void       tierRelease (void);
+
+#endif
@@ -30,6 +30,8 @@
 #define TOKEN_UN_OP         19
 #define TOKEN_EOF           20
 #define TOKEN_RANGE         21
+#define TOKEN_LBRACKET      22
+#define TOKEN_RBRACKET      23
 
 /* 
  * This is the size of the input buffer. Any token,
@@ -49,11 +51,14 @@ typedef char token_value[TOKEN_MAX_LENGTH +1];
  * integer and defines how the token value is used. Additionally
  * the line number is associated to the token in order to improve
  * the produced error messages.
+ *
+ * The value is stored after the other fields in the same
+ * allocation, and only takes as much memory as it needs.
  */
 typedef struct{
     token_type  type;
-    token_value value;
     int         line_number;
+    char        value[];
 } token;
 
 /*
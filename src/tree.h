@@ -30,6 +30,8 @@ typedef struct OPERAND_SUFFIX_NODE      operand_suffix_node     ;
 typedef struct ASSERT_NODE              assert_node             ;
 typedef struct READ_NODE                read_node               ;
 typedef struct PRINT_NODE               print_node              ;
+typedef struct INDEX_NODE               index_node              ;
+typedef struct LENGTH_NODE              length_node             ;
 
 /*
  * Definitons:
@@ -67,6 +69,10 @@ struct FOR_NODE{
     stmts_node                *stmtsn     ;
     token                     *endKey     ;
     token                     *forKeyEnd  ;
+    int                        iterations ;   // Iterations run by the interpreter.
+    struct TIER_LOOP          *tier       ;   // Compiled body, see tier.h.
+    index_node               **checks     ;   // Hoisted bounds checks, see hoist() in semantics.c.
+    int                        nchecks    ;   // -1 until the checks are collected.
 };
 
 struct DECLARATION_NODE{
@@ -74,6 +80,7 @@ struct DECLARATION_NODE{
     token                     *id         ;
     token                     *col        ;
     token                     *typeKey    ;
+    index_node                *dimn       ;   // Length of an array.
     declaration_suffix_node   *asn        ;
 };
 
@@ -84,6 +91,7 @@ struct DECLARATION_SUFFIX_NODE {
 
 struct ASSIGNMENT_NODE{
      token                    *id         ;
+     index_node               *indexn     ;
      token                    *assOp      ;
      expression_node          *expn       ;
 };
@@ -107,7 +115,10 @@ struct OPERAND_NODE{
     token                     *intLit     ;
     token                     *strLit     ;
     token                     *id         ;
+    index_node                *indexn     ;
+    length_node               *lengthn    ;
     enclosed_expression_node  *expren     ;
+    struct STR                *constant   ;   // Pooled value of strLit.
 };
 
 struct ENCLOSED_EXPRESSION_NODE{
@@ -131,6 +142,7 @@ struct ASSERT_NODE{
 struct READ_NODE{
     token                     *read       ;
     token                     *id         ;
+    index_node                *indexn     ;
 };
 
 struct PRINT_NODE{
@@ -138,4 +150,25 @@ struct PRINT_NODE{
     expression_node           *expn       ;
 };
 
+/*
+ * The index of an array element, or the length of an array in
+ * its declaration. The array is the identifier before the index.
+ * The flag unchecked is set while an enclosing loop has checked
+ * the bounds of the index for its whole range.
+ */
+struct INDEX_NODE{
+    token                     *lBracket   ;
+    expression_node           *expn       ;
+    token                     *rBracket   ;
+    token                     *array      ;
+    int                        unchecked  ;
+};
+
+struct LENGTH_NODE{
+    token                     *len        ;
+    token                     *lPar       ;
+    token                     *id         ;
+    token                     *rPar       ;
+};
+
 #endif
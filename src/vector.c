@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "label.h"
+#include "ir.h"
+#include "closure.h"
+#include "parallel.h"
+#include "vector.h"
+
+/*
+ * A register holds one value of every lane. The arithmetic is done
+ * with unsigned lanes to get the same wrap around behaviour as in
+ * the interpreter, and the comparisons with signed ones.
+ */
+typedef unsigned lanes        __attribute__((vector_size(VECTOR_LANES * sizeof(unsigned))));
+typedef int      signed_lanes __attribute__((vector_size(VECTOR_LANES * sizeof(int))));
+
+typedef enum VECTOR_OPCODE {
+    V_CONST,    // Broadcast of the constant i, done once before the loop.
+    V_MOVE,
+    V_NOT,
+    V_ADD,
+    V_SUB,
+    V_MUL,
+    V_DIV,      // Fails if a divisor is zero or the quotient overflows.
+    V_AND,
+    V_LESS,
+    V_EQ,
+    V_MAX,
+    V_ASSERT    // Fails if some lane of register a is not 1.
+} vector_opcode;
+
+/*
+ * The registers d, a and b are the destination and the operands.
+ * The first registers are the variable slots, numbered as the slots.
+ */
+typedef struct VECTOR_OP{
+    vector_opcode  op ;
+    int            d  ;
+    int            a  ;
+    int            b  ;
+    int            i  ;
+} vector_op;
+
+/*
+ * The lane operations of a loop body. The slots the body writes
+ * are listed in written, so that they can be saved before every
+ * vector and restored if it fails. Everything is allocated in one
+ * block with the loop, which is freed with free().
+ */
+struct VECTOR_LOOP{
+    int             nslots   ;
+    int             nregs    ;
+    int             nconsts  ;
+    int             nwritten ;
+    parallel_role  *roles    ;
+    vector_op      *consts   ;
+    int            *written  ;
+    int             nops     ;
+    vector_op       ops[]    ;
+};
+
+/* Helper functions used only in this translation unit. */
+static int  eligibleStmts (ir_stmt *stmt                              );
+static int  eligibleExpr  (ir_expr *expn                              );
+static void compileStmts  (ir_stmt *stmt                              );
+static int  compileExpr   (ir_expr *expn, int target                  );
+static int  emit          (vector_opcode op, int d, int a, int b      );
+static int  scalar        (stmt_closure *c, frame *f, int start, int end);
+static int  executeSse    (vector_loop *v, lanes *r                   );
+static int  executeAvx2   (vector_loop *v, lanes *r                   );
+
+static vector_isa  isa;
+static int       (*execute)(vector_loop *v, lanes *r);
+
+/* The loop being compiled. */
+static vector_op  *ops;
+static int         nops;
+static vector_op  *consts;
+static int         nconsts;
+static int         nregs;
+
+/*
+ * The instruction set is resolved when the first loop is compiled,
+ * so that the processor is not queried if nothing is vectorized.
+ */
+void vectorOptions(vector_isa i){
+    isa     = i;
+    execute = NULL;
+}
+
+vector_loop *vectorLoop(ir_stmt *forstmt){
+    parallel_loop *roles;
+    vector_loop   *v;
+    int            s, n;
+
+    if(execute == NULL){
+	if(isa == VECTOR_AUTO || isa == VECTOR_AVX2){
+#if defined(__x86_64__)
+	    __builtin_cpu_init();
+	    isa = __builtin_cpu_supports("avx2") ? VECTOR_AVX2 : VECTOR_SSE;
+#else
+	    isa = VECTOR_SSE;
+#endif
+	}
+	execute = isa == VECTOR_AVX2 ? executeAvx2 : executeSse;
+    }
+
+    if(isa == VECTOR_OFF || forstmt->expn->fault || forstmt->expn2->fault ||
+       !eligibleStmts(forstmt->body) || (roles = loopRoles(forstmt)) == NULL)
+	return NULL;
+
+    n     = roles->nslots;
+    nregs = n;
+    compileStmts(forstmt->body);
+
+    v = (vector_loop*)malloc(sizeof(vector_loop) + sizeof(vector_op) * (nops + nconsts) +
+			     (sizeof(parallel_role) + sizeof(int)) * n);
+    v->nslots   = n;
+    v->nregs    = nregs;
+    v->nconsts  = nconsts;
+    v->nwritten = 0;
+    v->nops     = nops;
+    v->consts   = v->ops + nops;
+    v->roles    = (parallel_role*)(v->consts + nconsts);
+    v->written  = (int*)(v->roles + n);
+
+    /* The arrays of an empty list may be NULL, which memcpy() does not take. */
+    if(nops > 0)
+	memcpy(v->ops,    ops,    sizeof(vector_op) * nops);
+    if(nconsts > 0)
+	memcpy(v->consts, consts, sizeof(vector_op) * nconsts);
+    if(n > 0)
+	memcpy(v->roles,  roles->roles, sizeof(parallel_role) * n);
+
+    for(s = 0; s < n; s++)
+	if(roles->roles[s] != PARALLEL_SHARED)
+	    v->written[v->nwritten++] = s;
+
+    free(roles);
+    free(ops);
+    free(consts);
+    ops    = consts  = NULL;
+    nops   = nconsts = 0;
+
+    return v;
+}
+
+/*
+ * The loop is run one vector at a time while a full vector of
+ * iterations is left. The reductions start from their identity in
+ * every lane, and the shared variables and the constants have the
+ * same value in all of them. After the vectors, the partial results
+ * of the lanes are combined in their order, and the private slots
+ * get the values of the last lane.
+ */
+int vectorRun(stmt_closure *c, frame *f, int start, int end){
+    vector_loop *v = c->vector;
+    lanes       *r, *saved, iota, zero = {0};
+    int          i = start, k, s, n = v->nslots, full = 0;
+
+    if(end == INT_MAX || (long long)end - start + 1 < VECTOR_LANES)
+	return scalar(c, f, start, end);
+
+    r     = (lanes*)aligned_alloc(sizeof(lanes), sizeof(lanes) * v->nregs);
+    saved = (lanes*)aligned_alloc(sizeof(lanes), sizeof(lanes) * n);
+
+    for(k = 0; k < VECTOR_LANES; k++)
+	iota[k] = k;
+
+    for(s = 0; s < n; s++)
+	switch(v->roles[s]){
+	case PARALLEL_SUM:
+	    r[s] = zero;
+	    break;
+	case PARALLEL_PRODUCT:
+	case PARALLEL_CONJUNCTION:
+	    r[s] = zero + 1;
+	    break;
+	default:
+	    r[s] = zero + (unsigned)f->env[s].i;
+	}
+
+    for(k = 0; k < v->nconsts; k++)
+	r[v->consts[k].d] = zero + (unsigned)v->consts[k].i;
+
+    for(; (long long)end - i + 1 >= VECTOR_LANES; i += VECTOR_LANES){
+	for(k = 0; k < v->nwritten; k++)
+	    saved[v->written[k]] = r[v->written[k]];
+
+	r[c->slot] = iota + (unsigned)i;
+
+	if(execute(v, r) == 0){
+	    for(k = 0; k < v->nwritten; k++)
+		r[v->written[k]] = saved[v->written[k]];
+	    break;
+	}
+
+	full++;
+    }
+
+    for(s = 0; s < n; s++)
+	for(k = 0; k < VECTOR_LANES; k++)
+	    switch(v->roles[s]){
+	    case PARALLEL_SUM:
+		f->env[s].i = (int)((unsigned)f->env[s].i + r[s][k]);
+		break;
+	    case PARALLEL_PRODUCT:
+		f->env[s].i = (int)((unsigned)f->env[s].i * r[s][k]);
+		break;
+	    case PARALLEL_CONJUNCTION:
+		f->env[s].i &= (int)r[s][k];
+		break;
+	    case PARALLEL_PRIVATE:
+		if(full > 0 && k == VECTOR_LANES -1)
+		    f->env[s].i = (int)r[s][k];
+		break;
+	    }
+
+    free(r);
+    free(saved);
+
+    return scalar(c, f, i, end);
+}
+
+/*
+ * The control variable keeps the value of
+ * the counter after the loop, as in for_().
+ */
+static int scalar(stmt_closure *c, frame *f, int start, int end){
+    int i;
+
+    for(i = start; i <= end; i++){
+	f->env[c->slot].i = i;
+	if(execClosures(c->body, f) == 0)
+	    return 0;
+    }
+
+    f->env[c->slot].i = i;
+    return 1;
+}
+
+/*
+ * COMPILATION ---------------------------------------------------------
+ */
+
+static int eligibleStmts(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	switch(stmt->kind){
+	case IR_ASSIGN:
+	    if(stmt->lt == STRING || !eligibleExpr(stmt->expn))
+		return 0;
+	    break;
+	case IR_ASSERT:
+	    if(!eligibleExpr(stmt->expn))
+		return 0;
+	    break;
+	default:
+	    return 0;
+	}
+
+    return 1;
+}
+
+static int eligibleExpr(ir_expr *expn){
+    if(expn == NULL)
+	return 1;
+
+    if(expn->lt == STRING || expn->op == IR_TRIPS || expn->op == IR_SUM)
+	return 0;
+
+    return eligibleExpr(expn->l) && eligibleExpr(expn->r);
+}
+
+static void compileStmts(ir_stmt *stmt){
+    for(; stmt != NULL; stmt = stmt->next)
+	if(stmt->kind == IR_ASSERT)
+	    emit(V_ASSERT, 0, compileExpr(stmt->expn, -1), 0);
+	else
+	    compileExpr(stmt->expn, stmt->slot);
+}
+
+/*
+ * Returns the register of the value of the expression. The value
+ * of the whole expression of an assignment is computed directly to
+ * the register target of the variable; otherwise target is -1.
+ */
+static int compileExpr(ir_expr *expn, int target){
+    static const vector_opcode opcodes[] = {
+	[IR_NOT] = V_NOT, [IR_ADD] = V_ADD, [IR_SUB]  = V_SUB, [IR_MUL] = V_MUL,
+	[IR_DIV] = V_DIV, [IR_AND] = V_AND, [IR_LESS] = V_LESS, [IR_EQ] = V_EQ,
+	[IR_MAX] = V_MAX
+    };
+    int a, b = 0;
+
+    switch(expn->op){
+    case IR_CONST:
+	consts = (vector_op*)realloc(consts, sizeof(vector_op) * (nconsts +1));
+	consts[nconsts].op = V_CONST;
+	consts[nconsts].d  = a = nregs++;
+	consts[nconsts].i  = expn->i;
+	nconsts++;
+	break;
+    case IR_VAR:
+	a = expn->slot;
+	break;
+    default:
+	a = compileExpr(expn->l, -1);
+	if(expn->r != NULL)
+	    b = compileExpr(expn->r, -1);
+	return emit(opcodes[expn->op], target < 0 ? nregs++ : target, a, b);
+    }
+
+    return target < 0 ? a : emit(V_MOVE, target, a, 0);
+}
+
+static int emit(vector_opcode op, int d, int a, int b){
+    ops = (vector_op*)realloc(ops, sizeof(vector_op) * (nops +1));
+    ops[nops].op = op;
+    ops[nops].d  = d;
+    ops[nops].a  = a;
+    ops[nops].b  = b;
+    ops[nops].i  = 0;
+    nops++;
+
+    return d;
+}
+
+/*
+ * EXECUTION -----------------------------------------------------------
+ *
+ * The same lane operations are compiled twice, once for each
+ * instruction set. Returns 0 if some lane failed; the registers
+ * of the variables are then partially updated.
+ */
+
+static inline __attribute__((always_inline)) int lanesOps(vector_loop *v, lanes *r){
+    vector_op *op = v->ops, *end = v->ops + v->nops;
+    lanes      tmp;
+    int        k;
+
+    for(; op < end; op++)
+	switch(op->op){
+	case V_MOVE:
+	    r[op->d] = r[op->a];
+	    break;
+	case V_NOT:
+	    r[op->d] = r[op->a] ^ 1;
+	    break;
+	case V_ADD:
+	    r[op->d] = r[op->a] + r[op->b];
+	    break;
+	case V_SUB:
+	    r[op->d] = r[op->a] - r[op->b];
+	    break;
+	case V_MUL:
+	    r[op->d] = r[op->a] * r[op->b];
+	    break;
+	case V_AND:
+	    r[op->d] = r[op->a] & r[op->b];
+	    break;
+	case V_LESS:
+	    r[op->d] = (lanes)((signed_lanes)r[op->a] < (signed_lanes)r[op->b]) & 1;
+	    break;
+	case V_EQ:
+	    r[op->d] = (lanes)(r[op->a] == r[op->b]) & 1;
+	    break;
+	case V_MAX:
+	    tmp = (lanes)((signed_lanes)r[op->a] > (signed_lanes)r[op->b]);
+	    r[op->d] = (r[op->a] & tmp) | (r[op->b] & ~tmp);
+	    break;
+	case V_DIV:
+	    /* There is no integer division instruction for lanes. */
+	    for(k = 0; k < VECTOR_LANES; k++){
+		int l = (int)r[op->a][k], d = (int)r[op->b][k];
+		if(d == 0 || (d == -1 && l == INT_MIN))
+		    return 0;
+		tmp[k] = (unsigned)(l / d);
+	    }
+	    r[op->d] = tmp;
+	    break;
+	case V_ASSERT:
+	    tmp = r[op->a] ^ 1;
+	    for(k = 0; k < VECTOR_LANES; k++)
+		if(tmp[k] != 0)
+		    return 0;
+	    break;
+	}
+
+    return 1;
+}
+
+static int executeSse(vector_loop *v, lanes *r){
+    return lanesOps(v, r);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+#endif
+static int executeAvx2(vector_loop *v, lanes *r){
+    return lanesOps(v, r);
+}
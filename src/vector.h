@@ -0,0 +1,62 @@
+#ifndef VECTOR_HEADER
+#define VECTOR_HEADER
+
+#include "ir.h"
+#include "closure.h"
+
+/*
+ * This file contains the declarations of the vectorized execution
+ * of for loops. A loop whose body contains only integer and boolean
+ * assignments and asserts, and whose variables all have a role in
+ * the sense of parallel.h, is run VECTOR_LANES iterations at a time.
+ * The control variable becomes a vector of consecutive values and
+ * every operator is applied to all the lanes at once. A reduction
+ * keeps a partial result in every lane, and the lanes are combined
+ * after the loop.
+ *
+ * The lane operations are compiled both for AVX2 and for SSE2, and
+ * the best instruction set the processor supports is selected at
+ * runtime. If a division fails or an assert does not hold in some
+ * lane, the iterations of the vector are run again one at a time
+ * with the closures, which report the first failing iteration
+ * exactly as the interpreter does.
+ */
+
+/*
+ * The number of iterations run at a time. A vector is two AVX2
+ * or four SSE2 registers, which pays for the dispatch of every
+ * lane operation.
+ */
+#define VECTOR_LANES 16
+
+/*
+ * The instruction sets of the lane operations. With VECTOR_AUTO
+ * the best supported one is used, and VECTOR_OFF turns the
+ * vectorization off.
+ */
+typedef enum VECTOR_ISA {VECTOR_AUTO, VECTOR_OFF, VECTOR_SSE, VECTOR_AVX2} vector_isa;
+
+typedef struct VECTOR_LOOP vector_loop;
+
+/*
+ * Selects the instruction set. If the processor does not support
+ * the one selected, SSE2 is used instead.
+ */
+extern void         vectorOptions (vector_isa isa);
+
+/*
+ * Compiles the body of the for statement *forstmt to lane
+ * operations. Returns NULL if the loop can not be vectorized
+ * or the vectorization is off.
+ */
+extern vector_loop *vectorLoop    (ir_stmt *forstmt);
+
+/*
+ * Runs the iterations from start to end of the loop *c, whose lane
+ * operations are in c->vector, as for_() of the closures would. The
+ * iterations left over from the last full vector are run with the
+ * closures. Returns 0 if a statement failed, 1 otherwise.
+ */
+extern int          vectorRun     (stmt_closure *c, frame *f, int start, int end);
+
+#endif
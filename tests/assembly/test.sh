@@ -0,0 +1,62 @@
+#!/bin/bash
+
+#this test script translates every test program of the semantics tests to
+#x86-64 assembly with --emit-asm, assembles it with as and links it with ld
+#against the runtime object. the standard output, the standard error and the
+#return value of the executable are compared to the ones produced by the
+#interpreter. the input of the program is taken from the semantics test.cfg.
+#programs that can not be translated are skipped.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+runtime="../../target/minipl_rt.o"
+units="../semantics/units"
+tests="../semantics/test.cfg"
+tmp=/tmp/minipl_assembly
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING ASSEMBLY PROGRAMS:"
+
+failed=0
+skipped=0
+
+for test in $(cat $tests | cut -f1 -d' '); do
+
+    input=$(cat $tests | grep $test | cut -f3 -d' ');
+
+    $bin --emit-asm $units/$test > $tmp.s 2> /dev/null;
+    if [ $? != 1 ] ; then
+	skipped=$((skipped + 1));
+	continue;
+    fi;
+
+    if ! as -o $tmp.o $tmp.s || ! ld -o $tmp $tmp.o $runtime ; then
+	echo -e test $test ${red} FAILED! ${NC} the generated code does not build;
+	failed=1;
+	continue;
+    fi;
+
+    expected_out=$(echo $input | $bin $units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+    actual_out=$(echo $input | $tmp 2> ${tmp}_actual_err);
+    actual=$?;
+
+    if [ "$actual" != "$expected" ] ||
+       [ "$actual_out" != "$expected_out" ] ||
+       ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	echo -e test $test ${red} FAILED! ${NC};
+	failed=1;
+    fi;
+
+done
+
+if [ $failed == 0 ] ; then
+    echo -e assembly programs ${green} PASSED! ${NC} "($skipped skipped)";
+fi;
+
+rm -f $tmp $tmp.s $tmp.o ${tmp}_expected_err ${tmp}_actual_err
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+#there is test.cfg file which contains the name of one source file per row. the
+#input records of the program are in the file of the same name with the suffix .in.
+
+#this test script runs each program in batch mode with the options below, and
+#compares the standard output, the standard error and the return value to the ones
+#of running the closure engine once for every record. the return value of the
+#batch is 1 if every record succeeded. some records fail or take different paths
+#through the loops, which makes them leave the lockstep.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+tmp=/tmp/minipl_batch
+options=("--batch" "--batch -O2" "--batch --batch-width=1" "--batch --batch-width=3")
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING BATCH MODE:"
+
+for test in $(cat test.cfg); do
+
+    records=units/${test%.mpl}.in;
+    failed=0;
+    expected=1;
+
+    rm -f ${tmp}_expected_out ${tmp}_expected_err
+    while IFS= read -r record; do
+	echo "$record" | $bin --engine=closure units/$test >> ${tmp}_expected_out 2>> ${tmp}_expected_err;
+	if [ $? != 1 ]; then
+	    expected=0;
+	fi;
+    done < $records
+
+    for option in "${options[@]}"; do
+	$bin $option units/$test < $records > ${tmp}_actual_out 2> ${tmp}_actual_err;
+	actual=$?;
+
+	if [ "$actual" != "$expected" ] ||
+	   ! cmp -s ${tmp}_expected_out ${tmp}_actual_out ||
+	   ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	    echo -e test $test with $option ${red} FAILED! ${NC};
+	    failed=1;
+	fi;
+    done
+
+    if [ $failed == 0 ] ; then
+	echo -e test $test ${green} PASSED! ${NC};
+    fi;
+
+done
+
+rm -f ${tmp}_expected_out ${tmp}_expected_err ${tmp}_actual_out ${tmp}_actual_err
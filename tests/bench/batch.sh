@@ -0,0 +1,35 @@
+#!/bin/bash
+
+#this script runs every program in batch over n records of three random integers,
+#in lockstep and record by record, and once in its own process for each of the first
+#m records, and prints the elapsed wall clock time in seconds.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+n=100000
+m=1000
+records=/tmp/minipl_batch_records
+
+for ((k = 0; k < n; k++)); do
+    echo "$RANDOM $RANDOM $RANDOM"
+done > $records
+
+TIMEFORMAT="%R"
+
+echo " "
+echo "BATCH MODE BENCHMARKS:"
+
+for unit in batch/*.mpl; do
+    echo "$(basename $unit):"
+    elapsed=$( { time $bin --batch $unit < $records > /dev/null 2>&1 ; } 2>&1 );
+    printf "    %-40s %9s\n" "--batch, $n records" "$elapsed";
+    elapsed=$( { time $bin --batch --batch-width=1 $unit < $records > /dev/null 2>&1 ; } 2>&1 );
+    printf "    %-40s %9s\n" "--batch --batch-width=1, $n records" "$elapsed";
+    elapsed=$( { time head -n $m $records | while read -r record; do
+		     echo "$record" | $bin --engine=closure $unit > /dev/null 2>&1 ;
+		 done ; } 2>&1 );
+    printf "    %-40s %9s\n" "one process per record, $m records" "$elapsed";
+done
+
+rm -f $records
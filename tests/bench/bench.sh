@@ -0,0 +1,25 @@
+#!/bin/bash
+
+#there is bench.cfg file which contains one row per execution engine. each
+#row contains the command line options that select the engine.
+
+#this script runs every program in units with each engine and prints the
+#elapsed wall clock time in seconds. the output of the programs is discarded.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+
+TIMEFORMAT="%R"
+
+echo " "
+echo "BENCHMARKS:"
+
+for unit in units/*.mpl; do
+    echo "$(basename $unit):"
+    while read -r options; do
+	[ -z "$options" ] && continue
+	elapsed=$( { time $bin $options $unit > /dev/null 2>&1 < /dev/null ; } 2>&1 );
+	printf "    %-40s %8s s\n" "$options" "$elapsed";
+    done < bench.cfg
+done
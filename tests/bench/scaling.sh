@@ -0,0 +1,34 @@
+#!/bin/bash
+
+#this script runs every program in scaling with each engine of bench.cfg for
+#growing sizes of the problem and prints the elapsed wall clock time in seconds.
+#the programs read the size n from the standard input. the time of a loop the
+#optimizer replaces with its closed form should not grow with n.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+sizes="1000 10000 100000 1000000 10000000"
+
+TIMEFORMAT="%R"
+
+echo " "
+echo "SCALING BENCHMARKS:"
+
+for unit in scaling/*.mpl; do
+    echo "$(basename $unit):"
+    printf "    %-30s" "n"
+    for n in $sizes; do
+	printf " %9s" $n;
+    done
+    echo
+    while read -r options; do
+	[ -z "$options" ] && continue
+	printf "    %-30s" "$options"
+	for n in $sizes; do
+	    elapsed=$( { time echo $n | $bin $options $unit > /dev/null 2>&1 ; } 2>&1 );
+	    printf " %9s" "$elapsed";
+	done
+	echo
+    done < bench.cfg
+done
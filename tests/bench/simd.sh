@@ -0,0 +1,35 @@
+#!/bin/bash
+
+#this script runs every program in simd with the engines below, first with the
+#scalar loops and then with every instruction set of the vectorized ones, and
+#prints the elapsed wall clock time in seconds. the programs read the size n from
+#the standard input. the loops run on one thread, so that only the vectors count.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+n=200000
+engines=("--engine=closure" "--engine=tree")
+isas=("--simd=off" "--simd=sse" "--simd=avx2")
+
+TIMEFORMAT="%R"
+
+echo " "
+echo "VECTORIZED LOOP BENCHMARKS (n = $n):"
+
+for unit in simd/*.mpl; do
+    echo "$(basename $unit):"
+    printf "    %-30s" ""
+    for isa in "${isas[@]}"; do
+	printf " %12s" $isa;
+    done
+    echo
+    for options in "${engines[@]}"; do
+	printf "    %-30s" "$options"
+	for isa in "${isas[@]}"; do
+	    elapsed=$( { time echo $n | $bin $options $isa --threads=1 $unit > /dev/null 2>&1 ; } 2>&1 );
+	    printf " %12s" "$elapsed";
+	done
+	echo
+    done
+done
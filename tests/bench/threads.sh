@@ -0,0 +1,43 @@
+#!/bin/bash
+
+#this script runs every program in threads with the engines below on one thread
+#and on every power of two up to the number of processors, and prints the elapsed
+#wall clock time in seconds. the programs read the size n from the standard input.
+#the reduction loops are split across the threads, and the independent phases of
+#the closure engine run concurrently, so the time should fall as the number of
+#threads grows.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+n=200000
+engines=("--engine=closure" "--engine=tree")
+
+cores=$(nproc)
+counts=""
+for ((k = 1; k < cores; k *= 2)); do
+    counts="$counts $k"
+done
+counts="$counts $cores"
+
+TIMEFORMAT="%R"
+
+echo " "
+echo "THREAD SCALING BENCHMARKS (n = $n):"
+
+for unit in threads/*.mpl; do
+    echo "$(basename $unit):"
+    printf "    %-30s" "threads"
+    for k in $counts; do
+	printf " %9s" $k;
+    done
+    echo
+    for options in "${engines[@]}"; do
+	printf "    %-30s" "$options"
+	for k in $counts; do
+	    elapsed=$( { time echo $n | $bin $options --threads=$k $unit > /dev/null 2>&1 ; } 2>&1 );
+	    printf " %9s" "$elapsed";
+	done
+	echo
+    done
+done
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+#this test script runs every test program of the semantics tests twice with
+#--cache=<dir> at -O2. the first run optimizes the program and saves the IR to
+#the cache and the second one loads it from there. the standard output, the
+#standard error and the return value of both runs are compared to the ones
+#produced by the interpreter. the input of the program is taken from the
+#semantics test.cfg, and the address space is limited as in the semantics tests.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+units="../semantics/units"
+tests="../semantics/test.cfg"
+tmp=/tmp/minipl_cache
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING THE CACHE OF OPTIMIZED PROGRAMS:"
+
+failed=0
+rm -rf $tmp
+
+for test in $(cat $tests | cut -f1 -d' '); do
+
+    input=$(cat $tests | grep $test | cut -f3 -d' ');
+
+    expected_out=$(ulimit -v 4000000; echo $input | $bin $units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+
+    for run in first second; do
+	actual_out=$(ulimit -v 4000000; echo $input | $bin --engine=closure -O2 --cache=$tmp $units/$test 2> ${tmp}_actual_err);
+	actual=$?;
+
+	if [ "$actual" != "$expected" ] ||
+	   [ "$actual_out" != "$expected_out" ] ||
+	   ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	    echo -e test $test ${red} FAILED! ${NC} in the $run run;
+	    failed=1;
+	fi;
+    done
+
+done
+
+if [ $(ls $tmp | wc -l) == 0 ] ; then
+    echo -e cache ${red} FAILED! ${NC} no program was saved;
+    failed=1;
+fi;
+
+if [ $failed == 0 ] ; then
+    echo -e cached programs ${green} PASSED! ${NC};
+fi;
+
+rm -rf $tmp ${tmp}_expected_err ${tmp}_actual_err
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+#this test script translates every test program of the semantics tests to c
+#with --emit-c, builds it with the system c compiler and runs the executable.
+#the standard output, the standard error and the return value are compared to
+#the ones produced by the interpreter. the input of the program is taken from
+#the semantics test.cfg. programs that can not be translated are skipped.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+units="../semantics/units"
+tests="../semantics/test.cfg"
+cc=${CC:-cc}
+tmp=/tmp/minipl_compiled
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING COMPILED PROGRAMS:"
+
+failed=0
+skipped=0
+
+for test in $(cat $tests | cut -f1 -d' '); do
+
+    input=$(cat $tests | grep $test | cut -f3 -d' ');
+
+    $bin --emit-c $units/$test > $tmp.c 2> /dev/null;
+    if [ $? != 1 ] ; then
+	skipped=$((skipped + 1));
+	continue;
+    fi;
+
+    if ! $cc -O1 -o $tmp $tmp.c ; then
+	echo -e test $test ${red} FAILED! ${NC} the generated code does not compile;
+	failed=1;
+	continue;
+    fi;
+
+    expected_out=$(echo $input | $bin $units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+    actual_out=$(echo $input | $tmp 2> ${tmp}_actual_err);
+    actual=$?;
+
+    if [ "$actual" != "$expected" ] ||
+       [ "$actual_out" != "$expected_out" ] ||
+       ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	echo -e test $test ${red} FAILED! ${NC};
+	failed=1;
+    fi;
+
+done
+
+if [ $failed == 0 ] ; then
+    echo -e compiled programs ${green} PASSED! ${NC} "($skipped skipped)";
+fi;
+
+rm -f $tmp $tmp.c ${tmp}_expected_err ${tmp}_actual_err
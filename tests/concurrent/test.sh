@@ -0,0 +1,50 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per test. each row consists of
+#two parts: name of the source file and the input of the program.
+
+#this test script runs each program with the engines below on four threads and
+#compares the standard output, the standard error and the return value to the
+#ones of the interpreter on one thread. independent loops of the programs run
+#concurrently, between reads, prints and statements that fail.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+tmp=/tmp/minipl_concurrent
+engines=("--engine=closure" "--engine=closure -O2" "--engine=jit")
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING CONCURRENT STATEMENTS:"
+
+for test in $(cat test.cfg | cut -f1 -d' '); do
+
+    input=$(cat test.cfg | grep $test | cut -f2- -d' ');
+    failed=0;
+
+    expected_out=$(echo $input | $bin --tier-threshold=0 --threads=1 units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+
+    for options in "${engines[@]}"; do
+	actual_out=$(echo $input | $bin $options --threads=4 units/$test 2> ${tmp}_actual_err);
+	actual=$?;
+
+	if [ "$actual" != "$expected" ] ||
+	   [ "$actual_out" != "$expected_out" ] ||
+	   ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	    echo -e test $test with $options ${red} FAILED! ${NC};
+	    failed=1;
+	fi;
+    done
+
+    if [ $failed == 0 ] ; then
+	echo -e test $test ${green} PASSED! ${NC};
+    fi;
+
+done
+
+rm -f ${tmp}_expected_err ${tmp}_actual_err
@@ -0,0 +1,70 @@
+#!/bin/bash
+
+#this test script generates very long and very deeply nested programs and runs
+#them with a small stack. the lexer, the parser, the interpreter and the free
+#functions must not recurse per statement, per parenthesis or per index, so the
+#programs must run to the end instead of overflowing the stack.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+program=/tmp/minipl_deep.mpl
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+statements=5000000
+depth=100000
+
+echo " "
+echo "TESTING LONG AND DEEP PROGRAMS:"
+
+failed=0
+
+#check runs the generated program and compares its output and return value.
+check(){
+    actual_out=$(ulimit -s 8192; $bin $program 2> /dev/null);
+    actual=$?;
+
+    if [ "$actual" != "1" ] || [ "$actual_out" != "$2" ] ; then
+	echo -e test $1 ${red} FAILED! ${NC};
+	failed=1;
+    else
+	echo -e test $1 ${green} PASSED! ${NC};
+    fi;
+}
+
+#five million statements in one statement list.
+{ echo "var x : int := 0;";
+  yes "x := x + 1;" | head -n $statements;
+  echo "print x;"; } > $program
+check long_list $statements
+
+#a hundred thousand nested parentheses and negations.
+{ echo "var x : int := 1;";
+  printf 'print ';
+  printf '%*s' $depth '' | sed 's/ /(x + /g';
+  printf 'x';
+  printf '%*s' $depth '' | tr ' ' ')';
+  echo ";";
+  printf 'assert ';
+  printf '%*s' $depth '' | sed 's/ /(!/g';
+  printf '(x = 1)';
+  printf '%*s' $depth '' | tr ' ' ')';
+  echo ";"; } > $program
+check deep_nesting $((depth + 1))
+
+#a hundred thousand nested indexes in the body of a loop.
+{ echo "var a : int[1];";
+  echo "var i : int;";
+  echo "for i in 0..0 do";
+  printf 'print ';
+  printf '%*s' $depth '' | sed 's/ /a[/g';
+  printf 'i';
+  printf '%*s' $depth '' | tr ' ' ']';
+  echo ";";
+  echo "end for;"; } > $program
+check deep_indexes 0
+
+rm -f $program
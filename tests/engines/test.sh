@@ -0,0 +1,55 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per execution engine. each row
+#contains the command line options that select the engine.
+
+#this test script runs every test program of the semantics tests with each
+#engine and compares the standard output, the standard error and the return
+#value to the ones produced by the default interpreter. the input of the
+#program is taken from the semantics test.cfg.
+#the address space is limited as in the semantics tests.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+units="../semantics/units"
+tests="../semantics/test.cfg"
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING EXECUTION ENGINES:"
+
+while read -r options; do
+
+    [ -z "$options" ] && continue
+
+    failed=0
+
+    for test in $(cat $tests | cut -f1 -d' '); do
+
+	input=$(cat $tests | grep $test | cut -f3 -d' ');
+
+	expected_out=$(ulimit -v 4000000; echo $input | $bin $units/$test 2> /tmp/minipl_expected_err);
+	expected=$?;
+	actual_out=$(ulimit -v 4000000; echo $input | $bin $options $units/$test 2> /tmp/minipl_actual_err);
+	actual=$?;
+
+	if [ "$actual" != "$expected" ] ||
+	   [ "$actual_out" != "$expected_out" ] ||
+	   ! cmp -s /tmp/minipl_expected_err /tmp/minipl_actual_err ; then
+	    echo -e test $test with $options ${red} FAILED! ${NC};
+	    failed=1;
+	fi;
+
+    done
+
+    if [ $failed == 0 ] ; then
+	echo -e engine $options ${green} PASSED! ${NC};
+    fi;
+
+done < test.cfg
+
+rm -f /tmp/minipl_expected_err /tmp/minipl_actual_err
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per test. each row consists of
+#five parts: name of the source file, two values for the number of loop
+#iterations, which the program reads from its input, the measure that is
+#compared: peak for the peak number of live heap blocks, or calls for the
+#number of calls to the allocation functions, and the engine that runs the
+#program: tree, tier for the tree walking interpreter that compiles the loops
+#to closures, or closure.
+
+#this test script runs each program with both inputs and compares the measure.
+#the strings of a loop must be freed as the loop runs, so the peak may not grow
+#with the number of iterations, and a loop that does not grow its strings may
+#not allocate at all once it has run once.
+
+cd "$(dirname "$0")"
+
+bin="../target/memory_test"
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING MEMORY:"
+
+while read test small large measure engine; do
+
+    expected=$(echo $small | $bin units/$test $engine 2>&1 >/dev/null | grep "^$measure " | cut -f2 -d' ');
+    actual=$(echo $large | $bin units/$test $engine 2>&1 >/dev/null | grep "^$measure " | cut -f2 -d' ');
+
+    if [ "$actual" != "$expected" ] ; then
+	echo -e test $test with $engine ${red} FAILED! ${NC} Expected $measure $expected but was $actual;
+    else
+	echo -e test $test with $engine ${green} PASSED! ${NC};
+    fi;
+
+done < test.cfg
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per test. each row consists of
+#three parts: name of the source file, the optimization level and the input of
+#the program. options to add to the level are separated from it with commas.
+
+#this test script optimizes each program with --dump-ir and compares the IR after
+#the last pass to the file units/<name>.ir. if there is a file units/<name>.facts,
+#the facts of --range-report are compared to it. the standard output, the standard
+#error and the return value must be the same as with the interpreter.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+tmp=/tmp/minipl_optimizer
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING OPTIMIZER:"
+
+for test in $(cat test.cfg | cut -f1 -d' '); do
+
+    level=$(cat test.cfg | grep $test | cut -f2 -d' ' | tr ',' ' ');
+    input=$(cat test.cfg | grep $test | cut -f3- -d' ');
+
+    #the statements of the dump start with the line number.
+    echo $input | $bin --engine=closure $level --dump-ir units/$test 2>&1 > /dev/null |
+	awk '/^; IR after/{ir=""; next} /^ *[0-9]+  /{ir=ir $0 "\n"} END{printf "%s", ir}' > $tmp.ir;
+
+    facts=units/${test%.mpl}.facts;
+    if [ -f $facts ]; then
+	echo $input | $bin --engine=closure $level --range-report units/$test 2>&1 > /dev/null |
+	    sed -n '/^Range facts/,$p' | tail -n +2 > $tmp.facts;
+    else
+	facts=$tmp.facts;
+	: > $tmp.facts;
+    fi;
+
+    expected_out=$(echo $input | $bin units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+    actual_out=$(echo $input | $bin --engine=closure $level units/$test 2> ${tmp}_actual_err);
+    actual=$?;
+
+    if ! cmp -s $tmp.ir units/${test%.mpl}.ir ; then
+	echo -e test $test ${red} FAILED! ${NC} the optimized IR differs;
+	diff units/${test%.mpl}.ir $tmp.ir;
+    elif ! cmp -s $tmp.facts $facts ; then
+	echo -e test $test ${red} FAILED! ${NC} the range facts differ;
+	diff $facts $tmp.facts;
+    elif [ "$actual" != "$expected" ] ||
+	 [ "$actual_out" != "$expected_out" ] ||
+	 ! cmp -s ${tmp}_expected_err ${tmp}_actual_err ; then
+	echo -e test $test ${red} FAILED! ${NC} the behaviour differs from the interpreter;
+    else
+	echo -e test $test ${green} PASSED! ${NC};
+    fi;
+
+done
+
+rm -f $tmp.ir $tmp.facts ${tmp}_expected_err ${tmp}_actual_err
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per test. each row consists of
+#two parts: name of the source file and the input of the program.
+
+#this test script runs each program with the engines below and compares the
+#standard output and the standard error, written to the same pipe, to the
+#expected output in the .out file of the program. the printed values must
+#be written before the error messages that follow them.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+engines=("--engine=tree" "--tier-threshold=1" "--engine=closure" "--engine=closure -O2" "--engine=jit")
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING OUTPUT:"
+
+for test in $(cat test.cfg | cut -f1 -d' '); do
+
+    input=$(cat test.cfg | grep $test | cut -f2- -d' ' -s);
+    failed=0;
+
+    for options in "${engines[@]}"; do
+	if ! echo $input | $bin $options units/$test 2>&1 | cmp -s - units/${test%.mpl}.out ; then
+	    echo -e test $test with $options ${red} FAILED! ${NC};
+	    failed=1;
+	fi;
+    done
+
+    if [ $failed == 0 ] ; then
+	echo -e test $test ${green} PASSED! ${NC};
+    fi;
+
+done
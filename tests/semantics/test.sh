@@ -5,6 +5,7 @@
 
 #this test script runs the pregram with input of each file determined in test.cfg
 #it cuts expected result and compares it with actual return value.
+#the programs run with 4 GB of address space, so an array that does not fit fails.
 
 cd "$(dirname "$0")"
 
@@ -21,7 +22,7 @@ for test in $(cat test.cfg | cut -f1 -d' '); do
     
     expected=$(cat test.cfg | grep $test | cut -f2 -d' ');
     input=$(cat test.cfg | grep $test | cut -f3 -d' ' );
-    echo $input | $bin units/$test >> /dev/null 2>&1 ;
+    (ulimit -v 4000000; echo $input | $bin units/$test) >> /dev/null 2>&1 ;
     actual=$?;
 
     if [ "$actual" != "$expected" ] ; then
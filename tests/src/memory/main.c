@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lex.h"
+#include "parser.h"
+#include "tier.h"
+
+extern int run        (program_node *pn);
+extern int runClosures(program_node *pn);
+
+/*
+ * The allocation functions are wrapped by the linker, so that the
+ * number of live blocks and the number of allocations can be
+ * counted. The peak number of live blocks and the number of
+ * allocations are printed to the standard error after the program
+ * has been executed.
+ */
+extern void *__real_malloc  (size_t size);
+extern void *__real_calloc  (size_t n, size_t size);
+extern void *__real_realloc (void *p, size_t size);
+extern void  __real_free    (void *p);
+
+static long live, peak, calls;
+
+static void *count(void *p){
+    calls++;
+    if(p != NULL && ++live > peak)
+	peak = live;
+    return p;
+}
+
+void *__wrap_malloc(size_t size){
+    return count(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t n, size_t size){
+    return count(__real_calloc(n, size));
+}
+
+void *__wrap_realloc(void *p, size_t size){
+    if(p == NULL)
+	return count(__real_realloc(p, size));
+    calls++;
+    return __real_realloc(p, size);
+}
+
+void __wrap_free(void *p){
+    if(p != NULL)
+	live--;
+    __real_free(p);
+}
+
+/*
+ * Usage: memory_test file [tree|tier|closure]
+ *
+ * The program is run with the tree walking interpreter, by default
+ * without compiling any loop, so that the allocations of the
+ * interpreter itself are counted. With tier every loop is compiled
+ * to closures after its first iteration, and with closure the
+ * program is run with the closure engine.
+ */
+int main(int argc, char *argv[]){
+    int (*engine)(program_node *pn) = run;
+    int   threshold = 0;
+    FILE *input = fopen(argv[1], "r");
+    if(input == NULL) return -1;
+    if(argc > 2 && strcmp(argv[2], "tier") == 0)
+	threshold = 1;
+    if(argc > 2 && strcmp(argv[2], "closure") == 0)
+	engine = runClosures;
+    tierOptions(threshold, 0);
+    int r = engine(parse(lex(input))) > 0 ? 1 : 0;
+    fprintf(stderr, "peak %ld\n", peak);
+    fprintf(stderr, "calls %ld\n", calls);
+    return r;
+}
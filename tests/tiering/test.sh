@@ -0,0 +1,50 @@
+#!/bin/bash
+
+#there is test.cfg file which contains one row per test. each row consists of
+#three parts: name of the source file, the tier threshold and the input of the
+#program.
+
+#this test script runs each program with the threshold and --tier-stats, and
+#compares the stats to the file units/<name>.stats, with the compile times left
+#out. the standard output, the standard error and the return value must be the
+#same as without tiered execution.
+
+cd "$(dirname "$0")"
+
+bin="../../target/minipl"
+tmp=/tmp/minipl_tiering
+
+red='\033[0;31m'
+green='\033[0;32m'
+NC='\033[0m'
+
+echo " "
+echo "TESTING TIERED EXECUTION:"
+
+for test in $(cat test.cfg | cut -f1 -d' '); do
+
+    threshold=$(cat test.cfg | grep $test | cut -f2 -d' ');
+    input=$(cat test.cfg | grep $test | cut -f3- -d' ');
+
+    expected_out=$(echo $input | $bin --tier-threshold=0 units/$test 2> ${tmp}_expected_err);
+    expected=$?;
+    actual_out=$(echo $input | $bin --tier-threshold=$threshold --tier-stats units/$test 2> ${tmp}_actual_err);
+    actual=$?;
+
+    grep -E '^Tier(ed)? ' ${tmp}_actual_err | sed -E 's/[0-9]+\.[0-9]+ ms/- ms/' > $tmp.stats;
+    grep -v -E '^Tier(ed)? ' ${tmp}_actual_err > ${tmp}_actual_errors;
+
+    if ! cmp -s $tmp.stats units/${test%.mpl}.stats ; then
+	echo -e test $test ${red} FAILED! ${NC} the stats differ;
+	diff units/${test%.mpl}.stats $tmp.stats;
+    elif [ "$actual" != "$expected" ] ||
+	 [ "$actual_out" != "$expected_out" ] ||
+	 ! cmp -s ${tmp}_expected_err ${tmp}_actual_errors ; then
+	echo -e test $test ${red} FAILED! ${NC} the behaviour differs from the interpreter;
+    else
+	echo -e test $test ${green} PASSED! ${NC};
+    fi;
+
+done
+
+rm -f $tmp.stats ${tmp}_expected_err ${tmp}_actual_err ${tmp}_actual_errors